@@ -1,13 +1,39 @@
 #include "app.hpp"
+#include "asset_pack.hpp"
+#include "process_memory.hpp"
+#include "simd_math.hpp"
+#include "tracer.hpp"
 #include "vulkan_helpers.hpp"
 #include "vulkan_render.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
 #include <SDL.h>
+#include <SDL_vulkan.h>
 
 namespace zealous {
+    //--------------------------------------------------------------------------
+    static const int kWindowWidth = 640;
+    static const int kWindowHeight = 480;
+
     //--------------------------------------------------------------------------
     App::App()
-        : running( false )
+        : running  ( false )
+        , minimized( false )
+        , focused  ( true )
+        , displayHz( 0 )
+        , resizePending( false )
+        , material( 0 )
+        , initStart( 0 )
+        , timeToFirstFrame( 0.0 )
+        , startupMilliseconds( 0.0 )
+        , renderBlockedMilliseconds( 0.0 )
+        , peakDeviceBytes( 0 )
         , window ( nullptr ) {
     }
 
@@ -15,55 +41,482 @@ namespace zealous {
     App::~App() {
     }
 
+    //--------------------------------------------------------------------------
+    void App::ParseCommandLine( int argc, char* argv[] ) {
+        for ( int i = 1; i < argc; ++i ) {
+            if ( std::strcmp( argv[i], "--frames-in-flight" ) == 0 and i + 1 < argc )
+                options.framesInFlight = std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--present-policy" ) == 0 and i + 1 < argc ) {
+                const char* policy = argv[++i];
+                if ( std::strcmp( policy, "throughput" ) == 0 )
+                    options.presentPolicy = PresentPolicy::eThroughput;
+                else if ( std::strcmp( policy, "low-latency" ) == 0 )
+                    options.presentPolicy = PresentPolicy::eLowLatency;
+                else if ( std::strcmp( policy, "vsync" ) == 0 )
+                    options.presentPolicy = PresentPolicy::eVsync;
+                else if ( std::strcmp( policy, "adaptive-vsync" ) == 0 )
+                    options.presentPolicy = PresentPolicy::eAdaptiveVsync;
+            } else if ( std::strcmp( argv[i], "--instances" ) == 0 and i + 1 < argc )
+                options.instances = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--record-threads" ) == 0 and i + 1 < argc )
+                options.recordThreads = ( uint32_t )std::max( 0, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--scene-draws" ) == 0 and i + 1 < argc )
+                options.sceneDraws = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--record-benchmark" ) == 0 and i + 1 < argc )
+                options.recordBenchmarkThreads = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--particles" ) == 0 and i + 1 < argc )
+                options.particles = ( uint32_t )std::max( 0, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--serial-compute" ) == 0 )
+                options.serialCompute = true;
+            else if ( std::strcmp( argv[i], "--gpu-cull" ) == 0 )
+                options.gpuCulling = true;
+            else if ( std::strcmp( argv[i], "--cpu-animate" ) == 0 )
+                options.cpuAnimation = true;
+            else if ( std::strcmp( argv[i], "--particle-benchmark" ) == 0 and i + 1 < argc )
+                options.particleBenchmarkFrames = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--trace" ) == 0 and i + 1 < argc )
+                options.tracePath = argv[++i];
+            else if ( std::strcmp( argv[i], "--fps-cap" ) == 0 and i + 1 < argc )
+                options.fpsCap = ( uint32_t )std::max( 0, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--background-fps" ) == 0 and i + 1 < argc )
+                options.backgroundFps = ( uint32_t )std::max( 0, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--late-start" ) == 0 )
+                options.lateStart = true;
+            else if ( std::strcmp( argv[i], "--headless" ) == 0 and i + 1 < argc )
+                options.headlessFrames = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--report" ) == 0 and i + 1 < argc )
+                options.reportPath = argv[++i];
+            else if ( std::strcmp( argv[i], "--asset-pack" ) == 0 and i + 1 < argc )
+                options.assetPackPath = argv[++i];
+            else if ( std::strcmp( argv[i], "--write-asset-pack" ) == 0 and i + 1 < argc )
+                options.writeAssetPackPath = argv[++i];
+            else if ( std::strcmp( argv[i], "--asset-benchmark" ) == 0 and i + 1 < argc )
+                options.assetBenchmarkMiB = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+            else if ( std::strcmp( argv[i], "--math-benchmark" ) == 0 and i + 1 < argc )
+                options.mathBenchmarkCount = ( uint32_t )std::max( 1, std::atoi( argv[++i] ) );
+        }
+    }
+
     //--------------------------------------------------------------------------
     void App::Init() {
-        // SDL
-        SDL_Init( SDL_INIT_VIDEO );
-        window = SDL_CreateWindow( "LOL", 50, 50, 640, 480, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE );
+        initStart = SDL_GetPerformanceCounter();
+
+        // SDL; loading the Vulkan library up front lets the instance be
+        // created while the window is. Headless runs touch no video at all,
+        // SDL is only there for its timers
+        const bool headless = options.headlessFrames != 0;
+        if ( headless )
+            SDL_Init( SDL_INIT_TIMER );
+        else {
+            SDL_Init( SDL_INIT_VIDEO );
+            SDL_Vulkan_LoadLibrary( nullptr );
+        }
 
-        // Vulkan
         vulkanContext = std::make_unique<VulkanContext>();
-        vulkanContext->SetSDLWindow( window );
-        InitVulkan( *vulkanContext );
+        vulkanContext->SetHeadless( headless );
+        vulkanContext->SetFramesInFlight( options.framesInFlight );
+        vulkanContext->SetPresentPolicy( options.presentPolicy );
+        renderer.SetInstanceCount( options.instances );
+        renderer.SetRecordingThreads( options.recordThreads );
+        renderer.SetSceneDrawCount( options.sceneDraws );
+        renderer.SetParticleCount( options.particles );
+        renderer.SetAsyncCompute( not options.serialCompute );
+        renderer.SetAssetPack( options.assetPackPath );
+        renderer.SetGpuCulling( options.gpuCulling );
+        renderer.SetCpuAnimation( options.cpuAnimation );
+
+        StartupGraph graph;
+        const StartupGraph::StageId windowStage = graph.AddStage( "window", [this, headless] {
+            if ( headless ) {
+                vulkanContext->SetWindowWidth( kWindowWidth );
+                vulkanContext->SetWindowHeight( kWindowHeight );
+                return;
+            }
+            window = SDL_CreateWindow( "LOL", 50, 50, kWindowWidth, kWindowHeight, SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE );
+            vulkanContext->SetSDLWindow( window );
+
+            // late start paces on the display when there is no cap
+            SDL_DisplayMode mode;
+            if ( SDL_GetWindowDisplayMode( window, &mode ) == 0 )
+                displayHz = mode.refresh_rate;
+        }, {}, StartupGraph::Affinity::eMainThread );
+
+        // Vulkan
+        const StartupGraph::StageId vulkanStage = AddInitVulkanStages( graph, *vulkanContext, windowStage );
 
         // Rendering
-        renderer.InitRender( vulkanContext );
+        const StartupGraph::StageId assetStage = graph.AddStage( "renderer assets", [this] {
+            renderer.LoadAssets();
+        } );
+        graph.AddStage( "renderer", [this] {
+            renderer.InitRender( vulkanContext );
+        }, { vulkanStage, assetStage } );
+
+        // the graph is at most a few stages wide
+        const uint32_t workerCount = std::min( 3u, std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+        graph.Run( workerCount );
+        graph.PrintReport( std::cout );
+        startupMilliseconds = graph.TotalMilliseconds();
+
+        // the render thread always has a snapshot to draw
+        Simulate( 0.0 );
     }
 
     //--------------------------------------------------------------------------
     void App::DeInit() {
+        const FrameStats& latencyStats = renderer.AcquireToPresentStats();
+        const double trianglesPerSecond = frameStats.Count() ? renderer.TrianglesPerFrame() * 1000.0 / frameStats.Average() : 0.0;
+        const std::string presentMode = vulkanContext->Headless() ? "none ( headless )" : vk::to_string( vulkanContext->PresentMode() );
+        std::cout << "First frame (ms) : " << timeToFirstFrame << std::endl
+                  << "Present mode     : " << presentMode << std::endl
+                  << "Frames in flight : " << options.framesInFlight << std::endl
+                  << "Frames           : " << frameStats.Count() << std::endl
+                  << "Frame time (ms)  : min " << frameStats.Min()
+                  << " / avg " << frameStats.Average()
+                  << " / p99 " << frameStats.Percentile( 99.0 )
+                  << " / max " << frameStats.Max() << std::endl
+                  << "Acquire to present (ms) : min " << latencyStats.Min()
+                  << " / avg " << latencyStats.Average()
+                  << " / p99 " << latencyStats.Percentile( 99.0 )
+                  << " / max " << latencyStats.Max() << std::endl
+                  << "Triangles/frame  : " << renderer.TrianglesPerFrame()
+                  << " in " << renderer.IndirectDrawCount() << " indirect draws" << std::endl
+                  << "Triangles/sec    : " << trianglesPerSecond << std::endl;
+        if ( options.recordThreads != 0 ) {
+            const FrameStats& recordStats = renderer.RecordStats();
+            std::cout << "Recording (ms)   : " << options.sceneDraws << " draws on " << options.recordThreads << " thread(s), avg "
+                      << recordStats.Average() << " / p99 " << recordStats.Percentile( 99.0 ) << std::endl;
+        }
+        if ( options.particles != 0 ) {
+            const ParticleSimulation& particles = renderer.Particles();
+            std::cout << "Particles        : " << particles.ParticleCount() << ( particles.Async() ? ", async on compute family " : ", serial on graphics family " )
+                      << ( particles.Async() ? vulkanContext->ComputeQueueFamilyIndex() : vulkanContext->GraphicsQueueFamilyIndex() ) << std::endl;
+        }
+        if ( renderer.GpuCullingEnabled() )
+            renderer.Culling().PrintStats( std::cout );
+        if ( renderer.CpuAnimationEnabled() ) {
+            const FrameStats& animationStats = renderer.AnimationStats();
+            std::cout << "Animation (ms)   : " << SimdLevelName( ActiveSimdLevel() ) << ", avg "
+                      << animationStats.Average() << " / p99 " << animationStats.Percentile( 99.0 ) << std::endl;
+        }
+        renderer.FrameData().PrintStats( std::cout );
+        framePacer.PrintStats( std::cout );
+        overlapCounters.Print( std::cout );
+        renderer.Profiler().PrintStats( std::cout );
+        renderer.Heap().PrintStats( std::cout );
+        renderer.Pipelines().PrintStats( std::cout );
+        renderer.Graph().PrintStats( std::cout );
+
+        if ( options.headlessFrames != 0 ) {
+            peakDeviceBytes = vulkanContext->Allocator().PeakBlockBytes();
+            std::ofstream report( options.reportPath, std::ios::trunc );
+            WriteBenchmarkReport( report );
+            if ( report )
+                std::cout << "Report written to " << options.reportPath << std::endl;
+            else
+                std::cerr << "Could not write " << options.reportPath << std::endl;
+        }
+
         // Rendering
         renderer.DeInitRender();
 
         // Vulkan
         DeInitVulkan( *vulkanContext );
 
+        if ( not options.tracePath.empty() )
+            FlushTrace();
+
+        if ( window != nullptr ) {
+            SDL_DestroyWindow( window );
+            SDL_Vulkan_UnloadLibrary();
+        }
         SDL_Quit();
     }
 
     //--------------------------------------------------------------------------
     void App::Run() {
+        TRACE_THREAD_NAME( "main" );
+        // CPU only, neither window nor device
+        if ( not options.writeAssetPackPath.empty() ) {
+            renderer.SetInstanceCount( options.instances );
+            if ( renderer.WriteAssetPack( options.writeAssetPackPath ) )
+                std::cout << "Asset pack written to " << options.writeAssetPackPath << std::endl;
+            else
+                std::cerr << "Could not write asset pack " << options.writeAssetPackPath << std::endl;
+            return;
+        }
+        if ( options.assetBenchmarkMiB != 0 ) {
+            BenchmarkAssetPack( "asset_benchmark.pack", uint64_t( options.assetBenchmarkMiB ) << 20, 10, std::cout );
+            return;
+        }
+        if ( options.mathBenchmarkCount != 0 ) {
+            BenchmarkSimdMath( options.mathBenchmarkCount, 100, std::cout );
+            return;
+        }
+
         running = true;
         Init();
-        while ( OneTick(), running );
+        // measured runs start with every draw in, not skipped while compiling
+        if ( options.recordBenchmarkThreads != 0 or options.particleBenchmarkFrames != 0 or options.headlessFrames != 0 )
+            renderer.WaitForPipelines();
+        if ( options.recordBenchmarkThreads != 0 ) {
+            renderer.BenchmarkRecording( options.recordBenchmarkThreads, 200, std::cout );
+            running = false;
+        } else if ( options.particleBenchmarkFrames != 0 ) {
+            renderer.BenchmarkParticles( options.particleBenchmarkFrames, std::cout );
+            running = false;
+        } else if ( options.headlessFrames != 0 ) {
+            RunHeadless();
+            running = false;
+        } else {
+            std::thread simulationThread( &App::SimulationLoop, this );
+            std::thread renderThread( &App::RenderLoop, this );
+            while ( running )
+                OneTick();
+            renderThread.join();
+            simulationThread.join();
+        }
         assert( !running );
         DeInit();
     }
 
+    //--------------------------------------------------------------------------
+    void App::SimulationLoop() {
+        TRACE_THREAD_NAME( "simulation" );
+        using Clock = std::chrono::steady_clock;
+        const double step = 1.0 / options.simulationHz;
+        const Clock::duration stepDuration = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( step ) );
+
+        Clock::time_point next = Clock::now() + stepDuration;
+        while ( running ) {
+            std::this_thread::sleep_until( next );
+
+            overlapCounters.Begin( OverlapCounters::eSimulation );
+            TRACE_SCOPE( "Simulate" );
+            Simulate( step );
+            overlapCounters.End( OverlapCounters::eSimulation );
+
+            // late steps run back to back to catch up, unless the thread was
+            // held up for long ( debugger, suspended process )
+            next += stepDuration;
+            if ( Clock::now() - next > 8 * stepDuration )
+                next = Clock::now();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void App::RunHeadless() {
+        // everything on this thread and fixed steps, every run renders the
+        // same frames whatever the machine
+        const double step = 1.0 / options.simulationHz;
+        for ( uint32_t i = 0; i < options.headlessFrames; ++i ) {
+            const uint64_t start = SDL_GetPerformanceCounter();
+            Simulate( step );
+            const uint64_t end = SDL_GetPerformanceCounter();
+            simulationStats.AddSample( 1000.0 * ( end - start ) / SDL_GetPerformanceFrequency() );
+
+            Render();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void App::Simulate( double step ) {
+        ++simulation.tick;
+        simulation.time += step;
+
+        const double time = simulation.time;
+        simulation.clearColor[0] = ( float )( 0.5 + 0.5 * SDL_sin( time ) );
+        simulation.clearColor[1] = ( float )( 0.5 + 0.5 * SDL_sin( time + M_PI * 2 / 3 ) );
+        simulation.clearColor[2] = ( float )( 0.5 + 0.5 * SDL_sin( time + M_PI * 4 / 3 ) );
+        simulation.clearColor[3] = 1;
+
+        // with GPU culling the camera drifts and zooms in, part of the scene is
+        // always out of view; otherwise it stays on the whole grid, the
+        // picture benchmarks have always rendered
+        if ( renderer.GpuCullingEnabled() ) {
+            simulation.view[0] = ( float )( 0.5 * SDL_sin( time * 0.3 ) );
+            simulation.view[1] = ( float )( 0.5 * SDL_cos( time * 0.2 ) );
+            simulation.view[2] = ( float )( 1.5 + 0.5 * SDL_sin( time * 0.25 ) );
+        }
+        simulation.material = material.load( std::memory_order_relaxed );
+
+        // the slot may hold an old snapshot, it is overwritten as a whole
+        snapshots.WriteSlot() = simulation;
+        snapshots.Publish();
+    }
+
+    //--------------------------------------------------------------------------
+    void App::RenderLoop() {
+        TRACE_THREAD_NAME( "render" );
+        while ( running ) {
+            // nothing is visible, sleep until the window comes back
+            if ( minimized ) {
+                TRACE_SCOPE( "idle" );
+                std::unique_lock<std::mutex> lock( idleMutex );
+                idleWake.wait( lock, [this] { return not minimized or not running; } );
+                continue;
+            }
+
+            framePacer.SetTarget( PacingTargetHz(), options.lateStart ? FramePacer::Mode::eLateStart : FramePacer::Mode::eCap );
+            {
+                TRACE_SCOPE( "pacing" );
+                framePacer.BeginFrame();
+            }
+            overlapCounters.Begin( OverlapCounters::eRender );
+            Render();
+            overlapCounters.End( OverlapCounters::eRender );
+            framePacer.EndFrame( renderBlockedMilliseconds );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    double App::PacingTargetHz() const {
+        // late start needs a period to fit frames in, the display's when
+        // there is no cap
+        double hz = options.fpsCap;
+        if ( hz == 0.0 and options.lateStart )
+            hz = displayHz;
+        if ( not focused and options.backgroundFps != 0 and ( hz == 0.0 or options.backgroundFps < hz ) )
+            hz = options.backgroundFps;
+        return hz;
+    }
+
+    //--------------------------------------------------------------------------
+    void App::SetMinimized( bool minimized ) {
+        {
+            std::lock_guard<std::mutex> lock( idleMutex );
+            this->minimized = minimized;
+        }
+        idleWake.notify_all();
+    }
+
     //--------------------------------------------------------------------------
     void App::Render() {
-        if ( MustUpdateVulkan( *vulkanContext ) )
-            UpdateVulkan( *vulkanContext );
-        renderer.RenderOnce();
+        TRACE_SCOPE( "App::Render" );
+        const uint64_t start = SDL_GetPerformanceCounter();
+        renderBlockedMilliseconds = 0.0;
+
+        if ( minimized )
+            return;
+
+        if ( resizePending.exchange( false ) )
+            vulkanContext->SetSwapchainOutOfDate( true );
+        bool mustUpdate;
+        {
+            TRACE_SCOPE( "MustUpdateVulkan" );
+            mustUpdate = MustUpdateVulkan( *vulkanContext );
+        }
+        if ( mustUpdate ) {
+            TRACE_SCOPE( "UpdateVulkan" );
+            if ( not UpdateVulkan( *vulkanContext ) )
+                return;
+            renderer.InvalidateRender();
+        }
+        // the newest snapshot, or the previous one again when the simulation
+        // did not step since
+        snapshots.Acquire();
+        renderer.RenderOnce( snapshots.Read() );
+        renderBlockedMilliseconds = renderer.LastBlockedMilliseconds();
+
+        const uint64_t end = SDL_GetPerformanceCounter();
+        if ( frameStats.Count() == 0 )
+            timeToFirstFrame = 1000.0 * ( end - initStart ) / SDL_GetPerformanceFrequency();
+        frameStats.AddSample( 1000.0 * ( end - start ) / SDL_GetPerformanceFrequency() );
+    }
+
+    //--------------------------------------------------------------------------
+    void App::OnWindowEvent( const SDL_WindowEvent& event ) {
+        switch ( event.event ) {
+            case SDL_WINDOWEVENT_SIZE_CHANGED:
+                resizePending = true;
+                break;
+            case SDL_WINDOWEVENT_MINIMIZED:
+            case SDL_WINDOWEVENT_HIDDEN:
+                SetMinimized( true );
+                break;
+            case SDL_WINDOWEVENT_RESTORED:
+            case SDL_WINDOWEVENT_MAXIMIZED:
+            case SDL_WINDOWEVENT_SHOWN:
+                resizePending = true;
+                SetMinimized( false );
+                break;
+            case SDL_WINDOWEVENT_FOCUS_GAINED:
+                focused = true;
+                break;
+            case SDL_WINDOWEVENT_FOCUS_LOST:
+                focused = false;
+                break;
+        }
     }
 
     //--------------------------------------------------------------------------
     void App::OneTick() {
+        // nothing else runs on this thread, block rather than spin, longer
+        // when nobody is looking
         SDL_Event event;
-        while ( SDL_PollEvent( &event ) ) {
-            if ( event.type == SDL_QUIT )
+        const int timeout = minimized or not focused ? 100 : 10;
+        if ( not SDL_WaitEventTimeout( &event, timeout ) )
+            return;
+
+        TRACE_SCOPE( "App::OneTick" );
+        overlapCounters.Begin( OverlapCounters::eEvents );
+        do {
+            TRACE_SCOPE( "SDL event" );
+            if ( event.type == SDL_QUIT ) {
                 running = false;
+                // the render thread may be idling
+                SetMinimized( false );
+            }
+            else if ( event.type == SDL_WINDOWEVENT )
+                OnWindowEvent( event.window );
+            else if ( event.type == SDL_KEYDOWN and event.key.keysym.sym == SDLK_F12 )
+                FlushTrace();
+            else if ( event.type == SDL_KEYDOWN and event.key.keysym.sym == SDLK_F10 )
+                material.fetch_add( 1, std::memory_order_relaxed );
+        } while ( SDL_PollEvent( &event ) );
+        overlapCounters.End( OverlapCounters::eEvents );
+    }
+
+    //--------------------------------------------------------------------------
+    void App::FlushTrace() {
+        const std::string path = options.tracePath.empty() ? "trace.json" : options.tracePath;
+        if ( Tracer::Flush( path ) )
+            std::cout << "Trace written to " << path << std::endl;
+    }
+
+    //--------------------------------------------------------------------------
+    static void WriteStageStats( std::ostream& stream, const char* name, const FrameStats& stats, bool last ) {
+        stream << "    \"" << name << "\": { \"avg\": " << stats.Average()
+               << ", \"median\": " << stats.Percentile( 50.0 )
+               << ", \"p99\": " << stats.Percentile( 99.0 ) << " }" << ( last ? "\n" : ",\n" );
+    }
+
+    //--------------------------------------------------------------------------
+    void App::WriteBenchmarkReport( std::ostream& stream ) const {
+        // flat and stable keys, meant to be diffed against a baseline by CI
+        stream << "{\n"
+               << "  \"device\": \"" << vulkanContext->PhysicalDeviceProperties().deviceName << "\",\n"
+               << "  \"width\": " << vulkanContext->WindowWidth() << ",\n"
+               << "  \"height\": " << vulkanContext->WindowHeight() << ",\n"
+               << "  \"frames\": " << frameStats.Count() << ",\n"
+               << "  \"framesInFlight\": " << options.framesInFlight << ",\n"
+               << "  \"instances\": " << options.instances << ",\n"
+               << "  \"recordThreads\": " << options.recordThreads << ",\n"
+               << "  \"startupMs\": " << startupMilliseconds << ",\n"
+               << "  \"firstFrameMs\": " << timeToFirstFrame << ",\n"
+               << "  \"frameMs\": { \"min\": " << frameStats.Min()
+               << ", \"median\": " << frameStats.Percentile( 50.0 )
+               << ", \"p99\": " << frameStats.Percentile( 99.0 )
+               << ", \"max\": " << frameStats.Max() << " },\n"
+               << "  \"stageCpuMs\": {\n";
+        WriteStageStats( stream, "simulate", simulationStats, false );
+        for ( size_t i = 0; i < ( size_t )FrameStage::eCount; ++i ) {
+            const FrameStage stage = ( FrameStage )i;
+            WriteStageStats( stream, FrameStageName( stage ), renderer.StageStats( stage ), i + 1 == ( size_t )FrameStage::eCount );
         }
-        Render();
+        stream << "  },\n"
+               << "  \"peakResidentBytes\": " << PeakResidentBytes() << ",\n"
+               << "  \"peakDeviceBytes\": " << peakDeviceBytes << "\n"
+               << "}\n";
     }
 }
@@ -1,29 +1,130 @@
 #pragma once
 
+#include "frame_pacer.hpp"
+#include "frame_snapshot.hpp"
+#include "frame_stats.hpp"
+#include "overlap_counters.hpp"
 #include "vulkan_context.hpp"
 #include "vulkan_render.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+
 //--------------------------------------------------------------------------
 // Forward declares
 //--------------------------------------------------------------------------
 struct SDL_Window;
+struct SDL_WindowEvent;
 
 namespace zealous {
+    //--------------------------------------------------------------------------
+    struct AppOptions {
+        uint32_t framesInFlight = 2;
+        // interactive use, latency first
+        PresentPolicy presentPolicy = PresentPolicy::eLowLatency;
+        // one triangle each
+        uint32_t instances = 1 << 20;
+        // 0 replays cached command buffers, otherwise threads recording every frame
+        uint32_t recordThreads = 0;
+        uint32_t sceneDraws = 4096;
+        // records with 1 to N threads and exits instead of running
+        uint32_t recordBenchmarkThreads = 0;
+        // GPU simulated particles drawn instead of the instance grid
+        uint32_t particles = 0;
+        // steps them on the graphics queue even with an async compute queue
+        bool serialCompute = false;
+        // instances culled against the view by a compute pass, drawn with a
+        // single indirect draw; only when replaying cached command buffers
+        bool gpuCulling = false;
+        // the instances move on the CPU, written to mapped memory every frame
+        bool cpuAnimation = false;
+        // renders that many frames serial then async and exits
+        uint32_t particleBenchmarkFrames = 0;
+        // fixed simulation rate, independent from the frame rate
+        uint32_t simulationHz = 120;
+        // 0 leaves the frame rate to the present mode
+        uint32_t fpsCap = 0;
+        // without focus; 0 keeps the focused rate
+        uint32_t backgroundFps = 30;
+        // frames start as late as their CPU time allows, at the cap or the
+        // display refresh rate
+        bool lateStart = false;
+        // CPU trace written on exit, F12 writes one on demand
+        std::string tracePath;
+        // renders that many frames offscreen, without window nor display, and
+        // writes a JSON report to reportPath
+        uint32_t headlessFrames = 0;
+        std::string reportPath = "benchmark.json";
+        // geometry mapped from a pack rather than generated
+        std::string assetPackPath;
+        // writes the generated geometry as a pack and exits
+        std::string writeAssetPackPath;
+        // loads a pack of that many MiB mapped, then read in, and exits
+        uint32_t assetBenchmarkMiB = 0;
+        // runs the math kernels over that many elements at every SIMD level
+        // and exits
+        uint32_t mathBenchmarkCount = 0;
+    };
+
     //--------------------------------------------------------------------------
     class App {
       public:
         App();
         ~App();
 
+        void ParseCommandLine( int argc, char* argv[] );
+
         void Init();
         void DeInit();
 
+        // the calling thread pumps the SDL events, simulation and rendering
+        // run on their own threads until quit
         void Run();
         void OneTick();
+        void Simulate( double step );
         void Render();
 
       private:
-        bool running;
+        void SimulationLoop();
+        void RenderLoop();
+        void RunHeadless();
+        void SetMinimized( bool minimized );
+        double PacingTargetHz() const;
+        void WriteBenchmarkReport( std::ostream& stream ) const;
+        void OnWindowEvent( const SDL_WindowEvent& event );
+        void FlushTrace();
+
+        std::atomic<bool> running;
+        std::atomic<bool> minimized;
+        std::atomic<bool> focused;
+        // the render thread blocks on it while minimized
+        std::mutex idleMutex;
+        std::condition_variable idleWake;
+        int displayHz;
+        // set by the event thread, turned into a swapchain rebuild by the
+        // render thread, the only one touching the Vulkan context
+        std::atomic<bool> resizePending;
+        // F10 switches the instances to the next material
+        std::atomic<uint32_t> material;
+        uint64_t initStart;
+        double timeToFirstFrame;
+        double startupMilliseconds;
+        // the fence and acquire waits of the last Render, left out of the
+        // pacer's work estimate
+        double renderBlockedMilliseconds;
+        AppOptions options;
+        FrameStats frameStats;
+        FramePacer framePacer;
+        FrameStats simulationStats;
+        uint64_t peakDeviceBytes;
+        OverlapCounters overlapCounters;
+
+        // owned by the simulation thread, published to the render thread
+        FrameSnapshot simulation;
+        SnapshotExchange<FrameSnapshot> snapshots;
         std::shared_ptr<VulkanContext> vulkanContext;
         Renderer renderer;
         SDL_Window* window;
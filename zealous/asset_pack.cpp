@@ -0,0 +1,374 @@
+#include "asset_pack.hpp"
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static uint64_t AlignUp( uint64_t value, uint64_t alignment ) {
+        return ( value + alignment - 1 ) & ~( alignment - 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    uint64_t HashAssetName( const char* name ) {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for ( const char* c = name; *c != '\0'; ++c ) {
+            hash ^= ( uint8_t )*c;
+            hash *= 1099511628211ull;
+        }
+        return hash != 0 ? hash : 1;
+    }
+
+    //--------------------------------------------------------------------------
+    void AssetPackWriter::AddBuffer( const char* name, AssetKind kind, const void* data, uint32_t stride, uint32_t count ) {
+        Pending asset = {};
+        asset.entry.nameHash = HashAssetName( name );
+        asset.entry.size = uint64_t( stride ) * count;
+        asset.entry.kind = ( uint32_t )kind;
+        asset.entry.stride = stride;
+        asset.entry.count = count;
+        asset.data = data;
+        assets.push_back( asset );
+    }
+
+    //--------------------------------------------------------------------------
+    void AssetPackWriter::AddTexture( const char* name, const void* data, uint32_t format, uint32_t rowPitch, uint32_t width,
+                                      uint32_t height ) {
+        Pending asset = {};
+        asset.entry.nameHash = HashAssetName( name );
+        asset.entry.size = uint64_t( rowPitch ) * height;
+        asset.entry.kind = ( uint32_t )AssetKind::eTexture;
+        asset.entry.format = format;
+        asset.entry.stride = rowPitch;
+        asset.entry.count = height;
+        asset.entry.width = width;
+        asset.entry.height = height;
+        asset.data = data;
+        assets.push_back( asset );
+    }
+
+    //--------------------------------------------------------------------------
+    bool AssetPackWriter::Write( const std::string& path ) const {
+        // at most half full, probes stay short
+        uint32_t tableSize = 1;
+        while ( tableSize < assets.size() * 2 )
+            tableSize *= 2;
+
+        AssetPackHeader header = {};
+        header.magic = kAssetPackMagic;
+        header.version = kAssetPackVersion;
+        header.entryCount = ( uint32_t )assets.size();
+        header.tableSize = tableSize;
+        header.tableOffset = sizeof( AssetPackHeader );
+
+        std::vector<AssetEntry> table( tableSize, AssetEntry() );
+        uint64_t offset = AlignUp( header.tableOffset + tableSize * sizeof( AssetEntry ), kAssetAlignment );
+        std::vector<uint64_t> offsets;
+        for ( const Pending& asset : assets ) {
+            AssetEntry entry = asset.entry;
+            entry.offset = offset;
+            offsets.push_back( offset );
+            offset = AlignUp( offset + entry.size, kAssetAlignment );
+
+            uint32_t slot = ( uint32_t )entry.nameHash & ( tableSize - 1 );
+            while ( table[slot].nameHash != 0 ) {
+                assert( table[slot].nameHash != entry.nameHash );
+                slot = ( slot + 1 ) & ( tableSize - 1 );
+            }
+            table[slot] = entry;
+        }
+        header.fileSize = offset;
+
+        FILE* file = std::fopen( path.c_str(), "wb" );
+        if ( file == nullptr )
+            return false;
+        bool written = std::fwrite( &header, sizeof( header ), 1, file ) == 1
+                       and std::fwrite( table.data(), sizeof( AssetEntry ), tableSize, file ) == tableSize;
+        uint64_t position = header.tableOffset + tableSize * sizeof( AssetEntry );
+        const std::vector<uint8_t> padding( kAssetAlignment, 0 );
+        for ( size_t i = 0; i < assets.size() and written; ++i ) {
+            const uint64_t size = assets[i].entry.size;
+            written = std::fwrite( padding.data(), 1, offsets[i] - position, file ) == offsets[i] - position
+                      and std::fwrite( assets[i].data, 1, size, file ) == size;
+            position = offsets[i] + size;
+        }
+        // the last asset is padded too, the file ends on a boundary
+        written = written and std::fwrite( padding.data(), 1, header.fileSize - position, file ) == header.fileSize - position;
+        written = std::fclose( file ) == 0 and written;
+        return written;
+    }
+
+    //--------------------------------------------------------------------------
+    AssetPack::AssetPack()
+        : base( nullptr )
+        , size( 0 )
+        , header( nullptr )
+        , table( nullptr )
+#if defined( _WIN32 )
+        , file( INVALID_HANDLE_VALUE )
+        , mapping( nullptr )
+#else
+        , file( -1 )
+#endif
+    {
+    }
+
+    //--------------------------------------------------------------------------
+    AssetPack::~AssetPack() {
+        Close();
+    }
+
+    //--------------------------------------------------------------------------
+    bool AssetPack::Open( const std::string& path ) {
+        Close();
+#if defined( _WIN32 )
+        file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+        LARGE_INTEGER fileSize;
+        if ( file == INVALID_HANDLE_VALUE or not GetFileSizeEx( file, &fileSize ) or fileSize.QuadPart < ( LONGLONG )sizeof( AssetPackHeader ) ) {
+            Close();
+            return false;
+        }
+        size = ( uint64_t )fileSize.QuadPart;
+        mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( mapping != nullptr )
+            base = static_cast<const uint8_t*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+        file = open( path.c_str(), O_RDONLY );
+        struct stat status;
+        if ( file < 0 or fstat( file, &status ) != 0 or status.st_size < ( off_t )sizeof( AssetPackHeader ) ) {
+            Close();
+            return false;
+        }
+        size = ( uint64_t )status.st_size;
+        void* view = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, file, 0 );
+        if ( view != MAP_FAILED ) {
+            base = static_cast<const uint8_t*>( view );
+            // assets are mostly read front to back, once
+            madvise( view, size, MADV_SEQUENTIAL );
+        }
+#endif
+        if ( base == nullptr ) {
+            Close();
+            return false;
+        }
+
+        header = reinterpret_cast<const AssetPackHeader*>( base );
+        table = reinterpret_cast<const AssetEntry*>( base + header->tableOffset );
+        if ( not Validate() ) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    bool AssetPack::Validate() const {
+        if ( header->magic != kAssetPackMagic or header->version != kAssetPackVersion or header->fileSize != size )
+            return false;
+        const uint32_t tableSize = header->tableSize;
+        if ( tableSize == 0 or ( tableSize & ( tableSize - 1 ) ) != 0 or header->tableOffset % alignof( AssetEntry ) != 0
+                or header->tableOffset > size or ( size - header->tableOffset ) / sizeof( AssetEntry ) < tableSize )
+            return false;
+
+        // a pack is opened once, checking every entry here lets Find trust them
+        uint32_t entryCount = 0;
+        for ( uint32_t slot = 0; slot < tableSize; ++slot ) {
+            const AssetEntry& entry = table[slot];
+            if ( entry.nameHash == 0 )
+                continue;
+            if ( entry.offset % kAssetAlignment != 0 or entry.offset > size or entry.size > size - entry.offset )
+                return false;
+            // users size their reads from stride and count, texture rows
+            // being the count
+            if ( entry.kind > ( uint32_t )AssetKind::eTexture or entry.size != uint64_t( entry.stride ) * entry.count
+                    or ( entry.kind == ( uint32_t )AssetKind::eTexture and entry.count != entry.height ) )
+                return false;
+            ++entryCount;
+        }
+        return entryCount == header->entryCount and entryCount < tableSize;
+    }
+
+    //--------------------------------------------------------------------------
+    void AssetPack::Close() {
+#if defined( _WIN32 )
+        if ( base != nullptr )
+            UnmapViewOfFile( base );
+        if ( mapping != nullptr )
+            CloseHandle( mapping );
+        if ( file != INVALID_HANDLE_VALUE )
+            CloseHandle( file );
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if ( base != nullptr )
+            munmap( const_cast<uint8_t*>( base ), size );
+        if ( file >= 0 )
+            close( file );
+        file = -1;
+#endif
+        base = nullptr;
+        size = 0;
+        header = nullptr;
+        table = nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    AssetView AssetPack::Find( const char* name ) const {
+        return Find( HashAssetName( name ) );
+    }
+
+    //--------------------------------------------------------------------------
+    AssetView AssetPack::Find( uint64_t nameHash ) const {
+        AssetView view;
+        if ( not IsOpen() )
+            return view;
+
+        // never full, an empty slot ends every probe
+        const uint32_t mask = header->tableSize - 1;
+        for ( uint32_t slot = ( uint32_t )nameHash & mask; table[slot].nameHash != 0; slot = ( slot + 1 ) & mask ) {
+            if ( table[slot].nameHash == nameHash ) {
+                view.entry = &table[slot];
+                view.data = base + table[slot].offset;
+                break;
+            }
+        }
+        return view;
+    }
+
+    //--------------------------------------------------------------------------
+    // reads every byte, so the pages of the mapping fault in like the upload
+    // would have them
+    static uint64_t Checksum( const void* data, uint64_t size ) {
+        const uint8_t* bytes = static_cast<const uint8_t*>( data );
+        uint64_t sum = 0;
+        uint64_t i = 0;
+        for ( ; i + sizeof( uint64_t ) <= size; i += sizeof( uint64_t ) ) {
+            uint64_t word;
+            std::memcpy( &word, bytes + i, sizeof( word ) );
+            sum += word;
+        }
+        for ( ; i < size; ++i )
+            sum += bytes[i];
+        return sum;
+    }
+
+    //--------------------------------------------------------------------------
+    void BenchmarkAssetPack( const std::string& path, uint64_t bytes, uint32_t iterations, std::ostream& stream ) {
+        // meshes of a 1 MiB vertex buffer and a 256 KiB index buffer, all of
+        // the same content
+        constexpr uint32_t kVertexStride = 24;
+        constexpr uint32_t kVertexCount = ( 1 << 20 ) / kVertexStride;
+        constexpr uint32_t kIndexCount = ( 256 << 10 ) / sizeof( uint16_t );
+        const uint32_t meshCount = ( uint32_t )std::max<uint64_t>( 1, bytes / ( kVertexStride * kVertexCount + kIndexCount * sizeof( uint16_t ) ) );
+        std::vector<uint8_t> vertices( kVertexStride * kVertexCount );
+        for ( size_t i = 0; i < vertices.size(); ++i )
+            vertices[i] = ( uint8_t )( i * 2654435761u >> 24 );
+        std::vector<uint16_t> indices( kIndexCount );
+        for ( uint32_t i = 0; i < kIndexCount; ++i )
+            indices[i] = ( uint16_t )( i % kVertexCount );
+
+        std::vector<std::string> names;
+        AssetPackWriter writer;
+        for ( uint32_t mesh = 0; mesh < meshCount; ++mesh ) {
+            names.push_back( "mesh" + std::to_string( mesh ) + ".vertices" );
+            writer.AddBuffer( names.back().c_str(), AssetKind::eVertices, vertices.data(), kVertexStride, kVertexCount );
+            names.push_back( "mesh" + std::to_string( mesh ) + ".indices" );
+            writer.AddBuffer( names.back().c_str(), AssetKind::eIndices, indices.data(), sizeof( uint16_t ), kIndexCount );
+        }
+        if ( not writer.Write( path ) ) {
+            std::cerr << "Could not write asset pack " << path << std::endl;
+            return;
+        }
+
+        uint64_t assetBytes = 0;
+        FrameStats mappedStats;
+        FrameStats readStats;
+        uint64_t mappedChecksum = 0;
+        uint64_t readChecksum = 0;
+        using Clock = std::chrono::steady_clock;
+        for ( uint32_t i = 0; i < iterations; ++i ) {
+            // mapped: one lookup per asset, its bytes read in place
+            Clock::time_point start = Clock::now();
+            AssetPack pack;
+            if ( not pack.Open( path ) ) {
+                std::cerr << "Could not open asset pack " << path << std::endl;
+                break;
+            }
+            mappedChecksum = 0;
+            assetBytes = 0;
+            for ( const std::string& name : names ) {
+                const AssetView asset = pack.Find( name.c_str() );
+                mappedChecksum += Checksum( asset.data, asset.Size() );
+                assetBytes += asset.Size();
+            }
+            pack.Close();
+            mappedStats.AddSample( std::chrono::duration<double, std::milli>( Clock::now() - start ).count() );
+
+            // the usual loader: the whole file read in, entries looked up by
+            // walking them, each asset copied out into its own allocation
+            start = Clock::now();
+            FILE* file = std::fopen( path.c_str(), "rb" );
+            if ( file == nullptr )
+                break;
+            std::fseek( file, 0, SEEK_END );
+            std::vector<uint8_t> contents( ( size_t )std::ftell( file ) );
+            std::fseek( file, 0, SEEK_SET );
+            const size_t read = std::fread( contents.data(), 1, contents.size(), file );
+            std::fclose( file );
+            AssetPackHeader header;
+            std::memcpy( &header, contents.data(), sizeof( header ) );
+            if ( read != contents.size() or header.magic != kAssetPackMagic )
+                break;
+            readChecksum = 0;
+            for ( const std::string& name : names ) {
+                const uint64_t nameHash = HashAssetName( name.c_str() );
+                for ( uint32_t slot = 0; slot < header.tableSize; ++slot ) {
+                    AssetEntry entry;
+                    std::memcpy( &entry, contents.data() + header.tableOffset + slot * sizeof( AssetEntry ), sizeof( entry ) );
+                    if ( entry.nameHash != nameHash )
+                        continue;
+                    const std::vector<uint8_t> asset( contents.data() + entry.offset, contents.data() + entry.offset + entry.size );
+                    readChecksum += Checksum( asset.data(), asset.size() );
+                    break;
+                }
+            }
+            readStats.AddSample( std::chrono::duration<double, std::milli>( Clock::now() - start ).count() );
+        }
+        std::remove( path.c_str() );
+
+        if ( mappedStats.Count() == 0 or readStats.Count() == 0 ) {
+            stream << "Asset pack       : benchmark failed" << std::endl;
+            return;
+        }
+        if ( mappedChecksum != readChecksum )
+            std::cerr << "Asset pack checksums differ, mapped " << mappedChecksum << " read " << readChecksum << std::endl;
+
+        const double megabytes = assetBytes / double( 1 << 20 );
+        stream << "Loading " << names.size() << " assets, " << megabytes << " MiB, " << iterations
+               << " iterations, warm page cache" << std::endl;
+        stream << "  mmap + lookup : avg " << mappedStats.Average() << " / min " << mappedStats.Min() << " ms, "
+               << megabytes * 1000.0 / mappedStats.Average() << " MiB/s" << std::endl;
+        stream << "  fread + parse : avg " << readStats.Average() << " / min " << readStats.Min() << " ms, "
+               << megabytes * 1000.0 / readStats.Average() << " MiB/s, mapped speedup "
+               << readStats.Average() / mappedStats.Average() << std::endl;
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    enum class AssetKind : uint32_t {
+        eVertices,
+        eIndices,
+        eInstances,
+        eTexture
+    };
+
+    //--------------------------------------------------------------------------
+    // On disk, native endian: the header, the table of contents right after
+    // it, then the assets, each one starting on a kAssetAlignment boundary so
+    // its bytes are whole pages of the mapping.
+    static constexpr uint32_t kAssetPackMagic = 0x4B50415A; // "ZAPK"
+    // 2: the triangle vertices split in position and color streams
+    static constexpr uint32_t kAssetPackVersion = 2;
+    static constexpr uint64_t kAssetAlignment = 4096;
+
+    struct AssetPackHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        // slots of the table, a power of two
+        uint32_t tableSize;
+        uint64_t tableOffset;
+        uint64_t fileSize;
+    };
+    static_assert( sizeof( AssetPackHeader ) == 32 );
+
+    //--------------------------------------------------------------------------
+    // One slot of the table of contents, an open addressing hash table on the
+    // name hash; a zero hash is an empty slot
+    struct AssetEntry {
+        uint64_t nameHash;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t kind;
+        // VkFormat of textures, 0 otherwise
+        uint32_t format;
+        // of the elements: vertices, indices, instances or texture rows
+        uint32_t stride;
+        uint32_t count;
+        uint32_t width;
+        uint32_t height;
+    };
+    static_assert( sizeof( AssetEntry ) == 48 );
+
+    // never 0, that's an empty slot
+    uint64_t HashAssetName( const char* name );
+
+    //--------------------------------------------------------------------------
+    // Lays assets out as a pack. The data passed to Add must stay valid until
+    // Write, nothing is copied before.
+    class AssetPackWriter {
+      public:
+        void AddBuffer( const char* name, AssetKind kind, const void* data, uint32_t stride, uint32_t count );
+        void AddTexture( const char* name, const void* data, uint32_t format, uint32_t rowPitch, uint32_t width, uint32_t height );
+        // false when the file couldn't be written
+        bool Write( const std::string& path ) const;
+
+      private:
+        struct Pending {
+            AssetEntry entry;
+            const void* data;
+        };
+
+        std::vector<Pending> assets;
+    };
+
+    //--------------------------------------------------------------------------
+    // an asset inside the mapping, valid until the pack is closed
+    struct AssetView {
+        const AssetEntry* entry = nullptr;
+        const void* data = nullptr;
+
+        explicit operator bool() const { return data != nullptr; }
+        uint64_t Size() const { return entry->size; }
+    };
+
+    //--------------------------------------------------------------------------
+    // A pack mapped read only as a whole. Nothing is read up front but the
+    // table of contents; Find is a hash and usually a single probe, and hands
+    // out pointers into the mapping, page aligned, that can go straight to
+    // the staging copy. Pages fault in as they're first touched.
+    class AssetPack {
+      public:
+        AssetPack();
+        ~AssetPack();
+        AssetPack( const AssetPack& ) = delete;
+        AssetPack& operator=( const AssetPack& ) = delete;
+
+        // false when missing, truncated or not a pack
+        bool Open( const std::string& path );
+        void Close();
+        bool IsOpen() const { return base != nullptr; }
+
+        AssetView Find( const char* name ) const;
+        AssetView Find( uint64_t nameHash ) const;
+
+        uint32_t EntryCount() const { return header ? header->entryCount : 0; }
+        uint64_t MappedBytes() const { return size; }
+
+      private:
+        bool Validate() const;
+
+        const uint8_t* base;
+        uint64_t size;
+        const AssetPackHeader* header;
+        const AssetEntry* table;
+#if defined( _WIN32 )
+        void* file;
+        void* mapping;
+#else
+        int file;
+#endif
+    };
+
+    //--------------------------------------------------------------------------
+    // Writes a pack of about that many bytes of meshes to path, then loads it
+    // over and over, mapped with table lookups against fread of the whole
+    // file, a scan of its entries and a copy of each asset out, and reports
+    // the throughput of both. The pack was just written, both read it from
+    // the page cache.
+    void BenchmarkAssetPack( const std::string& path, uint64_t bytes, uint32_t iterations, std::ostream& stream );
+}
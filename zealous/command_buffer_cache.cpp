@@ -0,0 +1,65 @@
+#include "command_buffer_cache.hpp"
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    CommandBufferCache::CommandBufferCache()
+        : deletions( nullptr )
+        , recordCount( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void CommandBufferCache::Init( const vk::Device& device, uint32_t queueFamilyIndex, DeletionQueue& deletions ) {
+        this->device = device;
+        this->queueFamilyIndex = queueFamilyIndex;
+        this->deletions = &deletions;
+        commandPool = CreatePool();
+    }
+
+    //--------------------------------------------------------------------------
+    UniqueCommandPool CommandBufferCache::CreatePool() const {
+        // no eResetCommandBuffer: buffers are never reset one by one
+        vk::CommandPoolCreateInfo createInfo = vk::CommandPoolCreateInfo()
+                                               .setQueueFamilyIndex( queueFamilyIndex );
+        return UniqueCommandPool( device, device.createCommandPool( createInfo ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void CommandBufferCache::DeInit() {
+        entries.clear();
+        commandPool.Reset();
+        deletions = nullptr;
+        device = vk::Device();
+    }
+
+    //--------------------------------------------------------------------------
+    void CommandBufferCache::Invalidate( uint64_t retireSerial ) {
+        if ( entries.empty() )
+            return;
+
+        // frames in flight may still execute the recorded buffers, hand the
+        // pool over instead of resetting it under their feet
+        deletions->Retire( std::move( commandPool ), retireSerial );
+        commandPool = CreatePool();
+        entries.clear();
+    }
+
+    //--------------------------------------------------------------------------
+    bool CommandBufferCache::Acquire( uint32_t imageIndex, uint32_t frameIndex, uint64_t renderState, vk::CommandBuffer& commandBuffer ) {
+        const Key key = { imageIndex, frameIndex, renderState };
+        auto it = entries.find( key );
+        if ( it != entries.end() ) {
+            commandBuffer = it->second;
+            return false;
+        }
+
+        vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+                .setCommandPool( commandPool )
+                .setLevel( vk::CommandBufferLevel::eSecondary )
+                .setCommandBufferCount( 1 );
+        commandBuffer = device.allocateCommandBuffers( allocInfo )[0];
+
+        entries.emplace( key, commandBuffer );
+        ++recordCount;
+        return true;
+    }
+}
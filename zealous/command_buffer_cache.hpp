@@ -0,0 +1,59 @@
+#pragma once
+
+#include "deletion_queue.hpp"
+
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Secondary command buffers recorded once per swapchain image, frame slot
+    // and render state, then replayed every frame. Nothing is reset one buffer
+    // at a time: invalidating the cache retires its whole pool to the
+    // deletion queue, which destroys it once the frames that may still
+    // execute it are done.
+    class CommandBufferCache {
+      public:
+        CommandBufferCache();
+
+        void Init( const vk::Device& device, uint32_t queueFamilyIndex, DeletionQueue& deletions );
+        void DeInit();
+
+        // drops every recorded buffer, frames up to retireSerial may still be
+        // executing them
+        void Invalidate( uint64_t retireSerial );
+
+        // returns true when the buffer was not recorded for this key yet, the
+        // caller must then record it before submitting
+        bool Acquire( uint32_t imageIndex, uint32_t frameIndex, uint64_t renderState, vk::CommandBuffer& commandBuffer );
+
+        size_t RecordCount() const { return recordCount; }
+
+      private:
+        struct Key {
+            uint32_t imageIndex;
+            uint32_t frameIndex;
+            uint64_t renderState;
+
+            bool operator==( const Key& other ) const {
+                return imageIndex == other.imageIndex and frameIndex == other.frameIndex and renderState == other.renderState;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()( const Key& key ) const {
+                const uint64_t indices = ( uint64_t( key.imageIndex ) << 32 ) | key.frameIndex;
+                return std::hash<uint64_t>()( indices ) ^ ( std::hash<uint64_t>()( key.renderState ) * 31 );
+            }
+        };
+
+        UniqueCommandPool CreatePool() const;
+
+        vk::Device device;
+        uint32_t queueFamilyIndex;
+        DeletionQueue* deletions;
+        UniqueCommandPool commandPool;
+        std::unordered_map<Key, vk::CommandBuffer, KeyHash> entries;
+        size_t recordCount;
+    };
+}
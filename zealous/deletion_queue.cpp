@@ -0,0 +1,47 @@
+#include "deletion_queue.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <limits>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    DeletionQueue::DeletionQueue()
+        : destroyedCount( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    DeletionQueue::~DeletionQueue() {
+        if ( not entries.empty() )
+            std::cerr << "DeletionQueue : " << entries.size() << " object(s) never destroyed" << std::endl;
+    }
+
+    //--------------------------------------------------------------------------
+    void DeletionQueue::Retire( MemoryAllocator& allocator, Allocation&& allocation, uint64_t frameSerial ) {
+        if ( not allocation )
+            return;
+        MemoryAllocator* owner = &allocator;
+        Defer( frameSerial, [owner, allocation]() mutable { owner->Free( allocation ); } );
+        allocation = Allocation();
+    }
+
+    //--------------------------------------------------------------------------
+    void DeletionQueue::Defer( uint64_t frameSerial, std::function<void()>&& destroy ) {
+        assert( entries.empty() or entries.back().frameSerial <= frameSerial );
+        entries.push_back( Entry{ frameSerial, std::move( destroy ) } );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeletionQueue::Collect( uint64_t completedSerial ) {
+        while ( not entries.empty() and entries.front().frameSerial <= completedSerial ) {
+            entries.front().destroy();
+            entries.pop_front();
+            ++destroyedCount;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void DeletionQueue::Flush() {
+        Collect( std::numeric_limits<uint64_t>::max() );
+    }
+}
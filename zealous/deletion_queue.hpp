@@ -0,0 +1,49 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include "vulkan_handles.hpp"
+
+#include <deque>
+#include <functional>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Objects released while frames in flight may still use them. Each one is
+    // tagged with the serial of the last frame submitted when it was retired
+    // and destroyed by Collect once that frame's fence has signaled, nothing
+    // ever waits on the GPU for it. Render thread only.
+    class DeletionQueue {
+      public:
+        DeletionQueue();
+        ~DeletionQueue();
+
+        template<typename T>
+        void Retire( UniqueHandle<T>&& handle, uint64_t frameSerial ) {
+            if ( not handle )
+                return;
+            const vk::Device device = handle.Device();
+            const T released = handle.Release();
+            Defer( frameSerial, [device, released] { DestroyHandle( device, released ); } );
+        }
+        void Retire( MemoryAllocator& allocator, Allocation&& allocation, uint64_t frameSerial );
+        void Defer( uint64_t frameSerial, std::function<void()>&& destroy );
+
+        // destroys what no frame up to completedSerial can use anymore
+        void Collect( uint64_t completedSerial );
+        // destroys everything, only once the device is idle
+        void Flush();
+
+        size_t PendingCount() const { return entries.size(); }
+        uint64_t DestroyedCount() const { return destroyedCount; }
+
+      private:
+        struct Entry {
+            uint64_t frameSerial;
+            std::function<void()> destroy;
+        };
+
+        // in retire order, serials only grow
+        std::deque<Entry> entries;
+        uint64_t destroyedCount;
+    };
+}
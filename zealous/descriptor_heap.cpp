@@ -0,0 +1,294 @@
+#include "descriptor_heap.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // the other sets of a pipeline layout and the color attachment, taken out
+    // of the per stage resource budget
+    static constexpr uint32_t kReservedStageResources = 4;
+
+    //--------------------------------------------------------------------------
+    DescriptorHeap::DescriptorHeap()
+        : writeCount( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::Init( std::shared_ptr<VulkanContext> context, UploadManager& uploads ) {
+        this->context = context;
+        const vk::Device& device = context->Device();
+        const vk::PhysicalDeviceLimits& limits = context->PhysicalDeviceProperties().limits;
+        const uint32_t frameCount = context->FramesInFlight();
+
+        // as large as the device allows, every stage sees the whole heap
+        const uint32_t budget = std::max( limits.maxPerStageResources, kReservedStageResources + 3 ) - kReservedStageResources;
+        uint32_t samplers = std::min( { kMaxSamplers, limits.maxPerStageDescriptorSamplers, limits.maxDescriptorSetSamplers, budget / 8 } );
+        uint32_t buffers = std::min( { kMaxBuffers, limits.maxPerStageDescriptorStorageBuffers, limits.maxDescriptorSetStorageBuffers,
+                                       ( budget - samplers ) / 2 } );
+        uint32_t images = std::min( { kMaxImages, limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSampledImages,
+                                      budget - samplers - buffers } );
+        InitTable( HeapKind::eBuffer, vk::DescriptorType::eStorageBuffer, std::max( buffers, 1u ) );
+        InitTable( HeapKind::eImage, vk::DescriptorType::eSampledImage, std::max( images, 1u ) );
+        InitTable( HeapKind::eSampler, vk::DescriptorType::eSampler, std::max( samplers, 1u ) );
+
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute;
+        std::array<vk::DescriptorSetLayoutBinding, ( size_t )HeapKind::eCount> bindings;
+        std::array<vk::DescriptorPoolSize, ( size_t )HeapKind::eCount> poolSizes;
+        for ( uint32_t i = 0; i < ( uint32_t )HeapKind::eCount; ++i ) {
+            bindings[i] = vk::DescriptorSetLayoutBinding( i, tables[i].type, tables[i].capacity, stages );
+            poolSizes[i] = vk::DescriptorPoolSize( tables[i].type, tables[i].capacity * frameCount );
+        }
+        vk::DescriptorSetLayoutCreateInfo layoutInfo = vk::DescriptorSetLayoutCreateInfo()
+                .setBindingCount( ( uint32_t )bindings.size() )
+                .setPBindings( bindings.data() );
+        setLayout = UniqueDescriptorSetLayout( device, device.createDescriptorSetLayout( layoutInfo ) );
+
+        vk::DescriptorPoolCreateInfo poolInfo = vk::DescriptorPoolCreateInfo()
+                                                .setMaxSets( frameCount )
+                                                .setPoolSizeCount( ( uint32_t )poolSizes.size() )
+                                                .setPPoolSizes( poolSizes.data() );
+        pool = UniqueDescriptorPool( device, device.createDescriptorPool( poolInfo ) );
+
+        const std::vector<vk::DescriptorSetLayout> setLayouts( frameCount, setLayout.Get() );
+        vk::DescriptorSetAllocateInfo setInfo = vk::DescriptorSetAllocateInfo()
+                                                .setDescriptorPool( pool )
+                                                .setDescriptorSetCount( frameCount )
+                                                .setPSetLayouts( setLayouts.data() );
+        sets = device.allocateDescriptorSets( setInfo );
+
+        // every slot starts out on the defaults, written whole once
+        InitDefaults( uploads );
+        for ( uint32_t kind = 0; kind < ( uint32_t )HeapKind::eCount; ++kind ) {
+            for ( uint32_t index = 0; index < tables[kind].capacity; ++index )
+                ResetSlot( ( HeapKind )kind, index );
+        }
+        std::vector<vk::WriteDescriptorSet> writes;
+        for ( const vk::DescriptorSet& set : sets ) {
+            for ( uint32_t kind = 0; kind < ( uint32_t )HeapKind::eCount; ++kind ) {
+                const Table& table = tables[kind];
+                writes.push_back( vk::WriteDescriptorSet()
+                                  .setDstSet( set )
+                                  .setDstBinding( kind )
+                                  .setDstArrayElement( 0 )
+                                  .setDescriptorCount( table.capacity )
+                                  .setDescriptorType( table.type )
+                                  .setPBufferInfo( table.bufferInfos.empty() ? nullptr : table.bufferInfos.data() )
+                                  .setPImageInfo( table.imageInfos.empty() ? nullptr : table.imageInfos.data() ) );
+            }
+        }
+        device.updateDescriptorSets( writes, nullptr );
+        writeCount += writes.size();
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::InitTable( HeapKind kind, vk::DescriptorType type, uint32_t capacity ) {
+        Table& table = tables[( size_t )kind];
+        table.type = type;
+        table.capacity = capacity;
+        if ( type == vk::DescriptorType::eStorageBuffer )
+            table.bufferInfos.resize( capacity );
+        else
+            table.imageInfos.resize( capacity );
+        table.dirty.assign( context->FramesInFlight(), std::vector<uint32_t>() );
+
+        // lowest indices handed out first
+        table.freeIndices.resize( capacity );
+        for ( uint32_t i = 0; i < capacity; ++i )
+            table.freeIndices[i] = capacity - 1 - i;
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::InitDefaults( UploadManager& uploads ) {
+        const vk::Device& device = context->Device();
+        MemoryAllocator& allocator = context->Allocator();
+        const MemoryUsage usage = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+
+        vk::BufferCreateInfo bufferInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive )
+                                          .setSize( 256 )
+                                          .setUsage( vk::BufferUsageFlagBits::eStorageBuffer );
+        defaultBuffer = UniqueBuffer( device, device.createBuffer( bufferInfo ) );
+        defaultBufferMemory = allocator.AllocateBuffer( defaultBuffer, usage );
+
+        // a single white texel, in the layout sampled images are expected in
+        vk::ImageCreateInfo imageInfo = vk::ImageCreateInfo()
+                                        .setImageType( vk::ImageType::e2D )
+                                        .setFormat( vk::Format::eR8G8B8A8Unorm )
+                                        .setExtent( vk::Extent3D( 1, 1, 1 ) )
+                                        .setMipLevels( 1 )
+                                        .setArrayLayers( 1 )
+                                        .setSamples( vk::SampleCountFlagBits::e1 )
+                                        .setTiling( vk::ImageTiling::eOptimal )
+                                        .setUsage( vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst )
+                                        .setSharingMode( vk::SharingMode::eExclusive )
+                                        .setInitialLayout( vk::ImageLayout::eUndefined );
+        defaultImage = UniqueImage( device, device.createImage( imageInfo ) );
+        defaultImageMemory = allocator.AllocateImage( defaultImage, usage );
+        const uint32_t white = 0xffffffff;
+        uploads.UploadImage( defaultImage, imageInfo.extent, &white, sizeof( white ), vk::ImageLayout::eShaderReadOnlyOptimal,
+                             vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+                             vk::AccessFlagBits::eShaderRead );
+        uploads.Flush();
+
+        vk::ImageViewCreateInfo viewInfo = vk::ImageViewCreateInfo()
+                                           .setImage( defaultImage )
+                                           .setViewType( vk::ImageViewType::e2D )
+                                           .setFormat( imageInfo.format )
+                                           .setSubresourceRange( vk::ImageSubresourceRange( vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 ) );
+        defaultImageView = UniqueImageView( device, device.createImageView( viewInfo ) );
+
+        vk::SamplerCreateInfo samplerInfo = vk::SamplerCreateInfo()
+                                            .setMagFilter( vk::Filter::eLinear )
+                                            .setMinFilter( vk::Filter::eLinear )
+                                            .setMipmapMode( vk::SamplerMipmapMode::eLinear )
+                                            .setAddressModeU( vk::SamplerAddressMode::eRepeat )
+                                            .setAddressModeV( vk::SamplerAddressMode::eRepeat )
+                                            .setAddressModeW( vk::SamplerAddressMode::eRepeat )
+                                            .setMaxLod( VK_LOD_CLAMP_NONE );
+        defaultSampler = UniqueSampler( device, device.createSampler( samplerInfo ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::DeInit() {
+        // the sets go with the pool
+        sets.clear();
+        pool.Reset();
+        setLayout.Reset();
+        for ( Table& table : tables )
+            table = Table();
+
+        MemoryAllocator& allocator = context->Allocator();
+        defaultSampler.Reset();
+        defaultImageView.Reset();
+        defaultImage.Reset();
+        allocator.Free( defaultImageMemory );
+        defaultBuffer.Reset();
+        allocator.Free( defaultBufferMemory );
+
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t DescriptorHeap::LiveCount( HeapKind kind ) const {
+        const Table& table = tables[( size_t )kind];
+        return table.capacity - ( uint32_t )table.freeIndices.size();
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t DescriptorHeap::Allocate( HeapKind kind ) {
+        Table& table = tables[( size_t )kind];
+        assert( not table.freeIndices.empty() );
+        if ( table.freeIndices.empty() )
+            return kInvalidIndex;
+
+        const uint32_t index = table.freeIndices.back();
+        table.freeIndices.pop_back();
+        return index;
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::MarkDirty( HeapKind kind, uint32_t index ) {
+        for ( auto& dirty : tables[( size_t )kind].dirty )
+            dirty.push_back( index );
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::ResetSlot( HeapKind kind, uint32_t index ) {
+        Table& table = tables[( size_t )kind];
+        switch ( kind ) {
+            case HeapKind::eBuffer:
+                table.bufferInfos[index] = vk::DescriptorBufferInfo( defaultBuffer, 0, VK_WHOLE_SIZE );
+                break;
+            case HeapKind::eImage:
+                table.imageInfos[index] = vk::DescriptorImageInfo( vk::Sampler(), defaultImageView, vk::ImageLayout::eShaderReadOnlyOptimal );
+                break;
+            default:
+                table.imageInfos[index] = vk::DescriptorImageInfo( defaultSampler, vk::ImageView(), vk::ImageLayout::eUndefined );
+                break;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t DescriptorHeap::RegisterBuffer( const vk::Buffer& buffer, vk::DeviceSize offset, vk::DeviceSize range ) {
+        const uint32_t index = Allocate( HeapKind::eBuffer );
+        if ( index == kInvalidIndex )
+            return kInvalidIndex;
+
+        tables[( size_t )HeapKind::eBuffer].bufferInfos[index] = vk::DescriptorBufferInfo( buffer, offset, range );
+        MarkDirty( HeapKind::eBuffer, index );
+        return index;
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t DescriptorHeap::RegisterImage( const vk::ImageView& imageView, vk::ImageLayout layout ) {
+        const uint32_t index = Allocate( HeapKind::eImage );
+        if ( index == kInvalidIndex )
+            return kInvalidIndex;
+
+        tables[( size_t )HeapKind::eImage].imageInfos[index] = vk::DescriptorImageInfo( vk::Sampler(), imageView, layout );
+        MarkDirty( HeapKind::eImage, index );
+        return index;
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t DescriptorHeap::RegisterSampler( const vk::Sampler& sampler ) {
+        const uint32_t index = Allocate( HeapKind::eSampler );
+        if ( index == kInvalidIndex )
+            return kInvalidIndex;
+
+        tables[( size_t )HeapKind::eSampler].imageInfos[index] = vk::DescriptorImageInfo( sampler, vk::ImageView(), vk::ImageLayout::eUndefined );
+        MarkDirty( HeapKind::eSampler, index );
+        return index;
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::Release( HeapKind kind, uint32_t index ) {
+        if ( index == kInvalidIndex )
+            return;
+
+        ResetSlot( kind, index );
+        MarkDirty( kind, index );
+        tables[( size_t )kind].freeIndices.push_back( index );
+    }
+
+    //--------------------------------------------------------------------------
+    bool DescriptorHeap::BeginFrame( uint32_t frameIndex ) {
+        // slots changed more than once are written more than once, the
+        // last write has the current value anyway
+        std::vector<vk::WriteDescriptorSet> writes;
+        for ( uint32_t kind = 0; kind < ( uint32_t )HeapKind::eCount; ++kind ) {
+            Table& table = tables[kind];
+            for ( uint32_t index : table.dirty[frameIndex] ) {
+                vk::WriteDescriptorSet write = vk::WriteDescriptorSet()
+                                               .setDstSet( sets[frameIndex] )
+                                               .setDstBinding( kind )
+                                               .setDstArrayElement( index )
+                                               .setDescriptorCount( 1 )
+                                               .setDescriptorType( table.type );
+                if ( table.type == vk::DescriptorType::eStorageBuffer )
+                    write.setPBufferInfo( &table.bufferInfos[index] );
+                else
+                    write.setPImageInfo( &table.imageInfos[index] );
+                writes.push_back( write );
+            }
+            table.dirty[frameIndex].clear();
+        }
+        if ( writes.empty() )
+            return false;
+
+        context->Device().updateDescriptorSets( writes, nullptr );
+        writeCount += writes.size();
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    void DescriptorHeap::PrintStats( std::ostream& stream ) const {
+        stream << "Descriptor heap : "
+               << LiveCount( HeapKind::eBuffer ) << "/" << Capacity( HeapKind::eBuffer ) << " buffer(s), "
+               << LiveCount( HeapKind::eImage ) << "/" << Capacity( HeapKind::eImage ) << " image(s), "
+               << LiveCount( HeapKind::eSampler ) << "/" << Capacity( HeapKind::eSampler ) << " sampler(s), "
+               << writeCount << " descriptor write(s)" << std::endl;
+    }
+}
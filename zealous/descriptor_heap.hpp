@@ -0,0 +1,98 @@
+#pragma once
+
+#include "upload_manager.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_handles.hpp"
+
+#include <array>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    enum class HeapKind {
+        eBuffer,    // storage buffers, binding 0
+        eImage,     // sampled images, binding 1
+        eSampler,   // samplers, binding 2
+        eCount
+    };
+
+    //--------------------------------------------------------------------------
+    // One descriptor set of large storage buffer, sampled image and sampler
+    // arrays, bound once per frame; shaders pick resources by the index they
+    // were registered at, handed over in push constants. Without update after
+    // bind every frame in flight has its own copy of the set: changes are
+    // queued and written into a frame's copy once its fence has signaled, and
+    // the slots nobody uses point at default resources.
+    class DescriptorHeap {
+      public:
+        static constexpr uint32_t kInvalidIndex = uint32_t( -1 );
+        // less when the device limits are lower
+        static constexpr uint32_t kMaxBuffers = 4096;
+        static constexpr uint32_t kMaxImages = 4096;
+        static constexpr uint32_t kMaxSamplers = 64;
+
+        DescriptorHeap();
+
+        // the default image is uploaded through uploads
+        void Init( std::shared_ptr<VulkanContext> context, UploadManager& uploads );
+        void DeInit();
+
+        const vk::DescriptorSetLayout& SetLayout() const { return setLayout.Get(); }
+        const vk::DescriptorSet& Set( uint32_t frameIndex ) const { return sets[frameIndex]; }
+        uint32_t Capacity( HeapKind kind ) const { return tables[( size_t )kind].capacity; }
+        uint32_t LiveCount( HeapKind kind ) const;
+
+        // kInvalidIndex once the heap is full; the resource must outlive its
+        // registration, and the frames in flight when it's released
+        uint32_t RegisterBuffer( const vk::Buffer& buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = VK_WHOLE_SIZE );
+        uint32_t RegisterImage( const vk::ImageView& imageView, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal );
+        uint32_t RegisterSampler( const vk::Sampler& sampler );
+        // the index can be handed out again right away: frames only see the
+        // change once theirs are done with the previous resource
+        void Release( HeapKind kind, uint32_t index );
+
+        // right after the wait on the frame fence; true when the set of that
+        // frame was written, which invalidates anything recorded with it
+        bool BeginFrame( uint32_t frameIndex );
+
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        struct Table {
+            vk::DescriptorType type;
+            uint32_t capacity = 0;
+            std::vector<uint32_t> freeIndices;
+            // one of the two, by type
+            std::vector<vk::DescriptorBufferInfo> bufferInfos;
+            std::vector<vk::DescriptorImageInfo> imageInfos;
+            // per frame, slots changed since that frame's set was written
+            std::vector<std::vector<uint32_t>> dirty;
+        };
+
+        void InitDefaults( UploadManager& uploads );
+        void InitTable( HeapKind kind, vk::DescriptorType type, uint32_t capacity );
+        uint32_t Allocate( HeapKind kind );
+        void MarkDirty( HeapKind kind, uint32_t index );
+        void ResetSlot( HeapKind kind, uint32_t index );
+
+        std::shared_ptr<VulkanContext> context;
+        std::array<Table, ( size_t )HeapKind::eCount> tables;
+
+        UniqueDescriptorSetLayout setLayout;
+        UniqueDescriptorPool pool;
+        std::vector<vk::DescriptorSet> sets;
+
+        // what empty slots point at, never read by a correct shader
+        UniqueBuffer defaultBuffer;
+        Allocation defaultBufferMemory;
+        UniqueImage defaultImage;
+        Allocation defaultImageMemory;
+        UniqueImageView defaultImageView;
+        UniqueSampler defaultSampler;
+
+        uint64_t writeCount;
+    };
+}
@@ -0,0 +1,137 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <thread>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // the latest work durations drive the late start prediction
+    static constexpr size_t kWorkWindow = 64;
+    static constexpr double kSmoothing = 0.1;
+    static constexpr double kMinSpinMargin = 0.2;
+    static constexpr double kMaxSpinMargin = 4.0;
+    // late start keeps that much slack on top of the predicted work
+    static constexpr double kLateStartSlack = 0.5;
+
+    //--------------------------------------------------------------------------
+    static double Milliseconds( std::chrono::steady_clock::duration duration ) {
+        return std::chrono::duration<double, std::milli>( duration ).count();
+    }
+
+    //--------------------------------------------------------------------------
+    FramePacer::FramePacer()
+        : targetHz( 0.0 )
+        , mode( Mode::eCap )
+        , period( 0 )
+        , started( false )
+        , workStats( kWorkWindow )
+        , smoothedInterval( 0.0 )
+        , jitter( 0.0 )
+        , spinMargin( 2.0 )
+        , sleptMilliseconds( 0.0 )
+        , spunMilliseconds( 0.0 )
+        , missedSlots( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void FramePacer::SetTarget( double hz, Mode mode ) {
+        if ( hz == targetHz and mode == this->mode )
+            return;
+
+        targetHz = hz;
+        this->mode = mode;
+        period = hz > 0.0 ? std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / hz ) ) : Clock::duration( 0 );
+        // the next frame starts a new series of slots
+        slotStart = Clock::now();
+    }
+
+    //--------------------------------------------------------------------------
+    void FramePacer::BeginFrame() {
+        if ( period != Clock::duration( 0 ) ) {
+            const Clock::time_point now = Clock::now();
+            if ( now - slotStart > period ) {
+                // more than a whole slot late, catching up would only burst
+                // frames, start over from now
+                if ( started )
+                    ++missedSlots;
+                slotStart = now;
+            }
+
+            Clock::time_point target = slotStart;
+            if ( mode == Mode::eLateStart and workStats.Count() != 0 ) {
+                const double expected = workStats.Percentile( 95.0 ) + kLateStartSlack;
+                const Clock::duration latest = period - std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double, std::milli>( expected ) );
+                if ( latest > Clock::duration( 0 ) )
+                    target += latest;
+            }
+            WaitUntil( target );
+        }
+
+        const Clock::time_point now = Clock::now();
+        if ( started ) {
+            const double interval = Milliseconds( now - frameStart );
+            intervalStats.AddSample( interval );
+            if ( intervalStats.Count() == 1 )
+                smoothedInterval = interval;
+            smoothedInterval += kSmoothing * ( interval - smoothedInterval );
+            jitter += kSmoothing * ( std::abs( interval - smoothedInterval ) - jitter );
+        }
+        frameStart = now;
+        started = true;
+    }
+
+    //--------------------------------------------------------------------------
+    void FramePacer::EndFrame( double blockedMilliseconds ) {
+        workStats.AddSample( std::max( 0.0, Milliseconds( Clock::now() - frameStart ) - blockedMilliseconds ) );
+        if ( period != Clock::duration( 0 ) )
+            slotStart += period;
+    }
+
+    //--------------------------------------------------------------------------
+    void FramePacer::WaitUntil( Clock::time_point target ) {
+        Clock::time_point now = Clock::now();
+        if ( now >= target )
+            return;
+
+        // sleep is coarse, wake up a margin early and spin the rest
+        const double remaining = Milliseconds( target - now );
+        if ( remaining > spinMargin ) {
+            const Clock::time_point wake = target - std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double, std::milli>( spinMargin ) );
+            std::this_thread::sleep_until( wake );
+            const Clock::time_point woken = Clock::now();
+            sleptMilliseconds += Milliseconds( woken - now );
+
+            // a late wake up widens the margin for next time, an early one
+            // lets it shrink slowly
+            const double overshoot = Milliseconds( woken - wake );
+            spinMargin = std::min( kMaxSpinMargin, std::max( { kMinSpinMargin, spinMargin * 0.95, overshoot * 1.25 } ) );
+            now = woken;
+        }
+
+        const Clock::time_point spinStart = now;
+        while ( now < target ) {
+            std::this_thread::yield();
+            now = Clock::now();
+        }
+        spunMilliseconds += Milliseconds( now - spinStart );
+    }
+
+    //--------------------------------------------------------------------------
+    void FramePacer::PrintStats( std::ostream& stream ) const {
+        stream << "Frame pacing     : ";
+        if ( targetHz > 0.0 )
+            stream << targetHz << " Hz, " << ( mode == Mode::eLateStart ? "late start" : "cap" );
+        else
+            stream << "unpaced";
+        stream << ", interval avg " << intervalStats.Average()
+               << " / p99 " << intervalStats.Percentile( 99.0 )
+               << " ms, smoothed " << smoothedInterval
+               << " ms, jitter " << jitter << " ms" << std::endl
+               << "Pacing waits (ms): slept " << sleptMilliseconds
+               << " / spun " << spunMilliseconds
+               << ", spin margin " << spinMargin
+               << ", " << missedSlots << " missed slot(s)" << std::endl;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "frame_stats.hpp"
+
+#include <chrono>
+#include <iosfwd>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Starts frames on a fixed period. Waits sleep until close to the target
+    // then spin the rest, the margin follows how late the OS wakes us up.
+    // Late start delays each frame to the end of its slot minus the expected
+    // CPU work, so it renders the freshest simulation state.
+    class FramePacer {
+      public:
+        enum class Mode {
+            eCap,       // frames start at the beginning of their slot
+            eLateStart  // frames start as late as their CPU time allows
+        };
+
+        FramePacer();
+
+        // 0 Hz leaves frames unpaced, only the statistics are kept
+        void SetTarget( double hz, Mode mode );
+        double TargetHz() const { return targetHz; }
+        Mode PacingMode() const { return mode; }
+
+        // blocks until the next frame should start
+        void BeginFrame();
+        // the frame's CPU work is done, feeds the late start prediction; the
+        // time the frame spent blocked on the GPU or the swapchain is no work,
+        // under FIFO it alone would fill the slot and late start never wait
+        void EndFrame( double blockedMilliseconds = 0.0 );
+
+        // between successive frame starts
+        const FrameStats& IntervalStats() const { return intervalStats; }
+        double SmoothedIntervalMilliseconds() const { return smoothedInterval; }
+        double JitterMilliseconds() const { return jitter; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        using Clock = std::chrono::steady_clock;
+
+        void WaitUntil( Clock::time_point target );
+
+        double targetHz;
+        Mode mode;
+        Clock::duration period;
+        Clock::time_point slotStart;
+        Clock::time_point frameStart;
+        bool started;
+
+        FrameStats intervalStats;
+        FrameStats workStats;
+        double smoothedInterval;
+        double jitter;
+        double spinMargin;
+        double sleptMilliseconds;
+        double spunMilliseconds;
+        uint64_t missedSlots;
+    };
+}
@@ -0,0 +1,139 @@
+#include "frame_ring_buffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // device limits are powers of two, alignof as well, but nothing says the
+    // caller's alignment is
+    static vk::DeviceSize AlignUp( vk::DeviceSize value, vk::DeviceSize alignment ) {
+        return ( value + alignment - 1 ) / alignment * alignment;
+    }
+
+    //--------------------------------------------------------------------------
+    FrameRingBuffer::FrameRingBuffer()
+        : mapped         ( nullptr )
+        , coherent       ( true )
+        , minAlignment   ( 16 )
+        , atomSize       ( 1 )
+        , frameSize      ( 0 )
+        , frameCount     ( 0 )
+        , frameIndex     ( 0 )
+        , head           ( 0 )
+        , flushedHead    ( 0 )
+        , peakFrameBytes ( 0 )
+        , allocationCount( 0 )
+        , failedCount    ( 0 )
+        , flushCount     ( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameRingBuffer::Init( std::shared_ptr<VulkanContext> context, vk::DeviceSize bytesPerFrame, vk::BufferUsageFlags usage ) {
+        this->context = context;
+        const vk::Device& device = context->Device();
+        const vk::PhysicalDeviceLimits& limits = context->PhysicalDeviceProperties().limits;
+
+        // every allocation satisfies every usage, a vec4 at least
+        minAlignment = 16;
+        if ( usage & vk::BufferUsageFlagBits::eUniformBuffer )
+            minAlignment = std::max( minAlignment, limits.minUniformBufferOffsetAlignment );
+        if ( usage & vk::BufferUsageFlagBits::eStorageBuffer )
+            minAlignment = std::max( minAlignment, limits.minStorageBufferOffsetAlignment );
+
+        // partitions start and end on whole atoms so flushes of one never
+        // touch the others
+        atomSize = std::max<vk::DeviceSize>( 1, limits.nonCoherentAtomSize );
+        frameSize = AlignUp( bytesPerFrame, std::max( minAlignment, atomSize ) );
+        frameCount = context->FramesInFlight();
+
+        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive )
+                                          .setSize( frameSize * frameCount )
+                                          .setUsage( usage );
+        buffer = UniqueBuffer( device, device.createBuffer( createInfo ) );
+
+        // written once front to back by the CPU and read by the GPU, device
+        // local when there is host visible such memory; coherence is welcome
+        // but not needed. The block offset is kept on an atom as well
+        vk::MemoryRequirements requirements = device.getBufferMemoryRequirements( buffer );
+        requirements.alignment = std::max( requirements.alignment, atomSize );
+        requirements.size = AlignUp( requirements.size, atomSize );
+        const MemoryUsage memoryUsage = { vk::MemoryPropertyFlagBits::eHostVisible,
+                                          vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostCoherent
+                                        };
+        memory = context->Allocator().Allocate( requirements, memoryUsage, ResourceKind::eLinear );
+        assert( memory and memory.mapped != nullptr );
+        device.bindBufferMemory( buffer, memory.memory, memory.offset );
+
+        const vk::MemoryPropertyFlags flags = context->PhysicalDeviceMemoryProperties().memoryTypes[memory.memoryTypeIndex].propertyFlags;
+        coherent = !!( flags & vk::MemoryPropertyFlagBits::eHostCoherent );
+        mapped = static_cast<uint8_t*>( memory.mapped );
+
+        frameIndex = 0;
+        head = 0;
+        flushedHead = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameRingBuffer::DeInit() {
+        buffer.Reset();
+        context->Allocator().Free( memory );
+        mapped = nullptr;
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameRingBuffer::BeginFrame( uint32_t frameIndex ) {
+        // the fence of that slot was waited on, the GPU is done with all of it
+        assert( frameIndex < frameCount );
+        peakFrameBytes = std::max( peakFrameBytes, head );
+        this->frameIndex = frameIndex;
+        head = 0;
+        flushedHead = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    RingAllocation FrameRingBuffer::Allocate( vk::DeviceSize size, vk::DeviceSize alignment ) {
+        RingAllocation allocation;
+        const vk::DeviceSize start = AlignUp( head, std::max( alignment, minAlignment ) );
+        if ( start + size > frameSize ) {
+            ++failedCount;
+            return allocation;
+        }
+        head = start + size;
+        ++allocationCount;
+
+        allocation.offset = FrameOffset( frameIndex ) + start;
+        allocation.size = size;
+        allocation.data = mapped + allocation.offset;
+        return allocation;
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameRingBuffer::Flush() {
+        if ( coherent or head == flushedHead ) {
+            flushedHead = head;
+            return;
+        }
+
+        // one range over everything written since the last flush, widened to
+        // whole atoms; the partition ends on one so it never spills over
+        const vk::DeviceSize partition = memory.offset + FrameOffset( frameIndex );
+        const vk::DeviceSize begin = flushedHead / atomSize * atomSize;
+        const vk::DeviceSize end = std::min( AlignUp( head, atomSize ), frameSize );
+        const vk::MappedMemoryRange range( memory.memory, partition + begin, end - begin );
+        context->Device().flushMappedMemoryRanges( range );
+        flushedHead = head;
+        ++flushCount;
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameRingBuffer::PrintStats( std::ostream& stream ) const {
+        const vk::DeviceSize peak = std::max( peakFrameBytes, head );
+        stream << "Frame data       : " << frameCount << " x " << frameSize / 1024 << " KiB"
+               << ( coherent ? ", coherent" : ", flushed" ) << ", peak " << peak / 1024 << " KiB a frame, "
+               << allocationCount << " allocations, " << failedCount << " failed, " << flushCount << " flushes" << std::endl;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_handles.hpp"
+
+#include <iosfwd>
+#include <memory>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Part of the current frame's partition, written through data; offset is
+    // in the ring buffer, for dynamic offsets and descriptor ranges.
+    struct RingAllocation {
+        void* data = nullptr;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+
+        template <typename T> T* As() const { return static_cast<T*>( data ); }
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    //--------------------------------------------------------------------------
+    // Transient per-frame data, uniforms, instances or indirect arguments,
+    // bump allocated from one persistently mapped buffer split in a partition
+    // per frame in flight. Nothing is freed on its own: BeginFrame takes the
+    // whole partition of a frame slot back, once the fence of that slot was
+    // waited on. Memory that isn't host coherent gets what was written
+    // flushed with a single call per Flush.
+    class FrameRingBuffer {
+      public:
+        FrameRingBuffer();
+
+        // usage decides the alignment of every allocation: uniform and
+        // storage buffer offsets as the device wants them
+        void Init( std::shared_ptr<VulkanContext> context, vk::DeviceSize bytesPerFrame, vk::BufferUsageFlags usage );
+        void DeInit();
+
+        void BeginFrame( uint32_t frameIndex );
+        // empty when the partition is full
+        RingAllocation Allocate( vk::DeviceSize size, vk::DeviceSize alignment = 1 );
+        // what was allocated since the last flush, before the submit reading it
+        void Flush();
+
+        const vk::Buffer& Buffer() const { return buffer.Get(); }
+        // the first allocation of a frame lands there
+        vk::DeviceSize FrameOffset( uint32_t frameIndex ) const { return frameIndex * frameSize; }
+        vk::DeviceSize FrameSize() const { return frameSize; }
+        bool Coherent() const { return coherent; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        std::shared_ptr<VulkanContext> context;
+        UniqueBuffer buffer;
+        Allocation memory;
+        uint8_t* mapped;
+        bool coherent;
+        vk::DeviceSize minAlignment;
+        vk::DeviceSize atomSize;
+        vk::DeviceSize frameSize;
+        uint32_t frameCount;
+
+        // within the partition of the current frame
+        uint32_t frameIndex;
+        vk::DeviceSize head;
+        vk::DeviceSize flushedHead;
+
+        vk::DeviceSize peakFrameBytes;
+        uint64_t allocationCount;
+        uint64_t failedCount;
+        uint64_t flushCount;
+    };
+}
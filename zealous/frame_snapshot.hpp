@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // everything the renderer needs from one simulation step, written whole by
+    // the simulation thread and never touched again once published
+    struct FrameSnapshot {
+        uint64_t tick = 0;
+        double time = 0.0;      // simulated seconds
+        std::array<float, 4> clearColor = {};
+        std::array<float, 4> view = { 0.f, 0.f, 1.f, 0.f };    // xy: center, z: zoom
+        uint32_t material = 0;  // pipeline variant of the instances
+    };
+
+    //--------------------------------------------------------------------------
+    // Lock-free handoff of the latest value from one writer thread to one
+    // reader thread. Besides the slot each side holds, a third one sits in
+    // between: publishing and acquiring are a single exchange, neither side
+    // ever waits, and the reader always gets the newest complete value.
+    template <typename T>
+    class SnapshotExchange {
+      public:
+        SnapshotExchange()
+            : shared( 1 )
+            , writeIndex( 0 )
+            , readIndex( 2 ) {
+        }
+
+        // only valid on the writer thread, holds stale data until rewritten
+        T& WriteSlot() { return slots[writeIndex]; }
+
+        // hands the written slot over, the writer continues in the one the
+        // reader is not using
+        void Publish() {
+            const uint32_t previous = shared.exchange( writeIndex | kFresh, std::memory_order_acq_rel );
+            writeIndex = previous & kIndexMask;
+        }
+
+        // switches to the latest published slot, false when nothing newer
+        // was published since the last call
+        bool Acquire() {
+            if ( not ( shared.load( std::memory_order_relaxed ) & kFresh ) )
+                return false;
+            const uint32_t previous = shared.exchange( readIndex, std::memory_order_acq_rel );
+            readIndex = previous & kIndexMask;
+            return true;
+        }
+
+        // only valid on the reader thread
+        const T& Read() const { return slots[readIndex]; }
+
+      private:
+        static constexpr uint32_t kIndexMask = 3;
+        static constexpr uint32_t kFresh = 4;
+
+        std::array<T, 3> slots;
+        alignas( 64 ) std::atomic<uint32_t> shared;
+        alignas( 64 ) uint32_t writeIndex;
+        alignas( 64 ) uint32_t readIndex;
+    };
+}
@@ -0,0 +1,55 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    FrameStats::FrameStats( size_t window )
+        : window( window )
+        , next( 0 )
+        , total( 0.0 )
+        , min  ( std::numeric_limits<double>::max() )
+        , max  ( 0.0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameStats::AddSample( double milliseconds ) {
+        if ( window != 0 and samples.size() == window ) {
+            // overwrite the oldest one
+            total -= samples[next];
+            samples[next] = milliseconds;
+            next = ( next + 1 ) % window;
+        } else
+            samples.push_back( milliseconds );
+        total += milliseconds;
+        min = std::min( min, milliseconds );
+        max = std::max( max, milliseconds );
+    }
+
+    //--------------------------------------------------------------------------
+    void FrameStats::Clear() {
+        samples.clear();
+        next = 0;
+        total = 0.0;
+        min = std::numeric_limits<double>::max();
+        max = 0.0;
+    }
+
+    //--------------------------------------------------------------------------
+    double FrameStats::Average() const {
+        return samples.empty() ? 0.0 : total / samples.size();
+    }
+
+    //--------------------------------------------------------------------------
+    double FrameStats::Percentile( double percentile ) const {
+        if ( samples.empty() )
+            return 0.0;
+
+        // nth_element on a copy, we don't want to reorder the history
+        std::vector<double> sorted = samples;
+        const size_t rank = std::min( sorted.size() - 1, ( size_t )( percentile / 100.0 * sorted.size() ) );
+        std::nth_element( sorted.begin(), sorted.begin() + rank, sorted.end() );
+        return sorted[rank];
+    }
+}
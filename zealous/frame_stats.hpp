@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // With a window, only the latest samples are kept and Average / Percentile
+    // roll with them; Min / Max always cover every sample since Clear.
+    class FrameStats {
+      public:
+        explicit FrameStats( size_t window = 0 );
+
+        void AddSample( double milliseconds );
+        void Clear();
+
+        size_t Count() const { return samples.size(); }
+        double Min() const { return min; }
+        double Max() const { return max; }
+        double Average() const;
+        double Percentile( double percentile ) const;
+
+      private:
+        std::vector<double> samples;
+        size_t window;
+        size_t next;
+        double total;
+        double min;
+        double max;
+    };
+}
@@ -0,0 +1,171 @@
+#include "gpu_culling.hpp"
+#include "vulkan_helpers.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // push constants of shaders/cull.comp
+    struct CullConstants {
+        std::array<float, 4> view;
+        uint32_t source;
+        uint32_t visible;
+        uint32_t draw;
+        uint32_t count;
+    };
+
+    //--------------------------------------------------------------------------
+    GpuCulling::GpuCulling()
+        : heap( nullptr )
+        , instanceCount( 0 )
+        , indexCount( 0 )
+        , visibleStats( kStatsWindow ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuCulling::Init( std::shared_ptr<VulkanContext> context, DescriptorHeap& heap, uint32_t instanceCount,
+                           uint32_t indexCount, const std::vector<uint32_t>& shaderCode ) {
+        this->context = context;
+        this->heap = &heap;
+        this->instanceCount = instanceCount;
+        this->indexCount = indexCount;
+        const vk::Device& device = context->Device();
+        MemoryAllocator& allocator = context->Allocator();
+        const uint32_t frameCount = context->FramesInFlight();
+
+        // per frame slot, written by the pass and read by the draw
+        const MemoryUsage deviceLocal = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+        frames.resize( frameCount );
+        for ( Frame& frame : frames ) {
+            vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                              .setSharingMode( vk::SharingMode::eExclusive )
+                                              .setSize( vk::DeviceSize( std::max( instanceCount, 1u ) ) * 4 * sizeof( float ) )
+                                              .setUsage( vk::BufferUsageFlagBits::eStorageBuffer );
+            frame.visibleBuffer = UniqueBuffer( device, device.createBuffer( createInfo ) );
+            frame.visibleMemory = allocator.AllocateBuffer( frame.visibleBuffer, deviceLocal );
+            frame.visibleIndex = heap.RegisterBuffer( frame.visibleBuffer );
+
+            createInfo.setSize( sizeof( vk::DrawIndexedIndirectCommand ) )
+            .setUsage( vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+                       vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc );
+            frame.indirectBuffer = UniqueBuffer( device, device.createBuffer( createInfo ) );
+            frame.indirectMemory = allocator.AllocateBuffer( frame.indirectBuffer, deviceLocal );
+            frame.indirectIndex = heap.RegisterBuffer( frame.indirectBuffer );
+        }
+
+        vk::BufferCreateInfo readbackInfo = vk::BufferCreateInfo()
+                                            .setSharingMode( vk::SharingMode::eExclusive )
+                                            .setSize( frameCount * sizeof( uint32_t ) )
+                                            .setUsage( vk::BufferUsageFlagBits::eTransferDst );
+        readbackBuffer = UniqueBuffer( device, device.createBuffer( readbackInfo ) );
+        const MemoryUsage readback = { vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                       vk::MemoryPropertyFlagBits::eHostCached
+                                     };
+        readbackMemory = allocator.AllocateBuffer( readbackBuffer, readback );
+
+        // everything goes through the heap
+        const vk::PushConstantRange pushConstants( vk::ShaderStageFlagBits::eCompute, 0, sizeof( CullConstants ) );
+        vk::PipelineLayoutCreateInfo layoutInfo = vk::PipelineLayoutCreateInfo()
+                .setSetLayoutCount( 1 )
+                .setPSetLayouts( &heap.SetLayout() )
+                .setPushConstantRangeCount( 1 )
+                .setPPushConstantRanges( &pushConstants );
+        pipelineLayout = UniquePipelineLayout( device, device.createPipelineLayout( layoutInfo ) );
+
+        const uint32_t heapBufferCount = heap.Capacity( HeapKind::eBuffer );
+        const vk::SpecializationMapEntry specializationEntry( 0, 0, sizeof( heapBufferCount ) );
+        const vk::SpecializationInfo specialization( 1, &specializationEntry, sizeof( heapBufferCount ), &heapBufferCount );
+        const UniqueShaderModule shader( device, CreateShaderModule( device, shaderCode ) );
+        vk::ComputePipelineCreateInfo pipelineInfo = vk::ComputePipelineCreateInfo()
+                .setStage( vk::PipelineShaderStageCreateInfo()
+                           .setStage( vk::ShaderStageFlagBits::eCompute )
+                           .setModule( shader )
+                           .setPName( "main" )
+                           .setPSpecializationInfo( &specialization ) )
+                .setLayout( pipelineLayout );
+        pipeline = UniquePipeline( device, context->PipelineCache().CreateComputePipeline( pipelineInfo ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuCulling::DeInit() {
+        MemoryAllocator& allocator = context->Allocator();
+        pipeline.Reset();
+        pipelineLayout.Reset();
+
+        readbackBuffer.Reset();
+        allocator.Free( readbackMemory );
+        for ( Frame& frame : frames ) {
+            heap->Release( HeapKind::eBuffer, frame.indirectIndex );
+            frame.indirectBuffer.Reset();
+            allocator.Free( frame.indirectMemory );
+            heap->Release( HeapKind::eBuffer, frame.visibleIndex );
+            frame.visibleBuffer.Reset();
+            allocator.Free( frame.visibleMemory );
+        }
+        frames.clear();
+
+        heap = nullptr;
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuCulling::Record( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, uint32_t sourceHeapIndex,
+                             const std::array<float, 4>& view ) {
+        Frame& frame = frames[frameIndex];
+
+        // the last count of this slot landed before its fence
+        if ( frame.pending ) {
+            const uint32_t visible = static_cast<const uint32_t*>( readbackMemory.mapped )[frameIndex];
+            visibleStats.AddSample( visible );
+        }
+        frame.pending = true;
+
+        // the draw starts empty, the pass counts instances into it
+        const vk::DrawIndexedIndirectCommand draw = vk::DrawIndexedIndirectCommand()
+                .setIndexCount( indexCount )
+                .setInstanceCount( 0 )
+                .setFirstIndex( 0 )
+                .setVertexOffset( 0 )
+                .setFirstInstance( 0 );
+        commandBuffer.updateBuffer( frame.indirectBuffer.Get(), 0, sizeof( draw ), &draw );
+        const vk::MemoryBarrier resetBarrier = vk::MemoryBarrier()
+                                               .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+                                               .setDstAccessMask( vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite );
+        commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                       vk::DependencyFlags(), resetBarrier, nullptr, nullptr );
+
+        const CullConstants constants = { view, sourceHeapIndex, frame.visibleIndex, frame.indirectIndex, instanceCount };
+        commandBuffer.bindPipeline( vk::PipelineBindPoint::eCompute, pipeline );
+        commandBuffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, pipelineLayout, 0, heap->Set( frameIndex ), nullptr );
+        commandBuffer.pushConstants( pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof( constants ), &constants );
+        commandBuffer.dispatch( ( instanceCount + kGroupSize - 1 ) / kGroupSize, 1, 1 );
+
+        // the count is copied out for the stats
+        const vk::MemoryBarrier cullBarrier = vk::MemoryBarrier()
+                                              .setSrcAccessMask( vk::AccessFlagBits::eShaderWrite )
+                                              .setDstAccessMask( vk::AccessFlagBits::eTransferRead );
+        commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer,
+                                       vk::DependencyFlags(), cullBarrier, nullptr, nullptr );
+
+        const vk::BufferCopy copy( offsetof( VkDrawIndexedIndirectCommand, instanceCount ), frameIndex * sizeof( uint32_t ), sizeof( uint32_t ) );
+        commandBuffer.copyBuffer( frame.indirectBuffer.Get(), readbackBuffer.Get(), copy );
+        const vk::MemoryBarrier readbackBarrier = vk::MemoryBarrier()
+                .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+                .setDstAccessMask( vk::AccessFlagBits::eHostRead );
+        commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+                                       vk::DependencyFlags(), readbackBarrier, nullptr, nullptr );
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuCulling::PrintStats( std::ostream& stream ) const {
+        if ( visibleStats.Count() == 0 ) {
+            stream << "GPU culling      : no frame completed" << std::endl;
+            return;
+        }
+        stream << "GPU culling      : " << instanceCount << " instances, visible avg " << visibleStats.Average()
+               << " / min " << visibleStats.Min() << " / max " << visibleStats.Max()
+               << ", culled avg " << instanceCount - visibleStats.Average() << std::endl;
+    }
+}
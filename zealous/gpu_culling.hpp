@@ -0,0 +1,78 @@
+#pragma once
+
+#include "descriptor_heap.hpp"
+#include "frame_stats.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_handles.hpp"
+
+#include <array>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Culls the instances against the view on the GPU: a compute pass copies
+    // the visible ones to a compacted buffer of the frame slot and counts them
+    // straight into the instance count of the single indirect draw that
+    // renders them. The CPU records the same few commands whatever the
+    // instance count; the count is read back once the frame's fence signaled.
+    class GpuCulling {
+      public:
+        static constexpr size_t kStatsWindow = 256;
+
+        GpuCulling();
+
+        void Init( std::shared_ptr<VulkanContext> context, DescriptorHeap& heap, uint32_t instanceCount,
+                   uint32_t indexCount, const std::vector<uint32_t>& shaderCode );
+        void DeInit();
+
+        uint32_t InstanceCount() const { return instanceCount; }
+
+        // what the frame slot draws: the compacted instances, as a heap index,
+        // and one vk::DrawIndexedIndirectCommand
+        uint32_t VisibleHeapIndex( uint32_t frameIndex ) const { return frames[frameIndex].visibleIndex; }
+        const vk::Buffer& VisibleBuffer( uint32_t frameIndex ) const { return frames[frameIndex].visibleBuffer.Get(); }
+        const vk::Buffer& IndirectBuffer( uint32_t frameIndex ) const { return frames[frameIndex].indirectBuffer.Get(); }
+
+        // outside of a render pass, once the frame fence signaled; barriers
+        // against the source instances' writer and the draw come from the
+        // render graph. view as in the frame uniforms: center in xy, zoom in z
+        void Record( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, uint32_t sourceHeapIndex,
+                     const std::array<float, 4>& view );
+
+        // visible instances per frame, over the latest frames
+        const FrameStats& VisibleStats() const { return visibleStats; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        static constexpr uint32_t kGroupSize = 256;
+
+        struct Frame {
+            Allocation visibleMemory;
+            UniqueBuffer visibleBuffer;
+            uint32_t visibleIndex = DescriptorHeap::kInvalidIndex;
+            Allocation indirectMemory;
+            UniqueBuffer indirectBuffer;
+            uint32_t indirectIndex = DescriptorHeap::kInvalidIndex;
+            // Record ran for this slot, its count is in the readback buffer
+            bool pending = false;
+        };
+
+        std::shared_ptr<VulkanContext> context;
+        DescriptorHeap* heap;
+        uint32_t instanceCount;
+        uint32_t indexCount;
+        std::vector<Frame> frames;
+
+        // one instance count per frame slot, host visible
+        Allocation readbackMemory;
+        UniqueBuffer readbackBuffer;
+
+        UniquePipelineLayout pipelineLayout;
+        UniquePipeline pipeline;
+
+        FrameStats visibleStats;
+    };
+}
@@ -0,0 +1,133 @@
+#include "gpu_profiler.hpp"
+
+#include <cassert>
+#include <iostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static constexpr uint32_t kInvalidScope = uint32_t( -1 );
+
+    //--------------------------------------------------------------------------
+    GpuProfiler::GpuProfiler()
+        : timestampValidBits( 0 )
+        , timestampPeriod( 1.0 )
+        , currentFrame( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::Init( const vk::Device& device, const vk::PhysicalDeviceProperties& properties,
+                            uint32_t timestampValidBits, uint32_t frameCount ) {
+        this->device = device;
+        this->timestampValidBits = timestampValidBits;
+        timestampPeriod = properties.limits.timestampPeriod;
+        currentFrame = 0;
+        if ( not Enabled() )
+            return;
+
+        vk::QueryPoolCreateInfo createInfo = vk::QueryPoolCreateInfo()
+                                             .setQueryType( vk::QueryType::eTimestamp )
+                                             .setQueryCount( 2 * kMaxScopesPerFrame );
+        frames.resize( frameCount );
+        for ( FrameQueries& frame : frames )
+            frame.queryPool = device.createQueryPool( createInfo );
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::DeInit() {
+        for ( FrameQueries& frame : frames )
+            device.destroyQueryPool( frame.queryPool );
+        frames.clear();
+        device = vk::Device();
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::BeginFrame( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex ) {
+        if ( not Enabled() )
+            return;
+
+        currentFrame = frameIndex;
+        FrameQueries& frame = frames[frameIndex];
+        Collect( frame );
+        commandBuffer.resetQueryPool( frame.queryPool, 0, 2 * kMaxScopesPerFrame );
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::Collect( FrameQueries& frame ) {
+        if ( frame.scopeIndices.empty() )
+            return;
+
+        // no eWait, the frame's fence signaled so the results are there
+        const uint32_t queryCount = 2 * ( uint32_t )frame.scopeIndices.size();
+        std::vector<uint64_t> results( queryCount );
+        const vk::Result result = device.getQueryPoolResults<uint64_t>( frame.queryPool, 0, queryCount, results,
+                                  sizeof( uint64_t ), vk::QueryResultFlagBits::e64 );
+        if ( result == vk::Result::eSuccess ) {
+            // only the valid bits count, the difference wraps with them
+            const uint64_t mask = timestampValidBits >= 64 ? ~uint64_t( 0 ) : ( uint64_t( 1 ) << timestampValidBits ) - 1;
+            for ( size_t i = 0; i < frame.scopeIndices.size(); ++i ) {
+                const uint64_t ticks = ( results[2 * i + 1] - results[2 * i] ) & mask;
+                scopes[frame.scopeIndices[i]].stats.AddSample( ticks * timestampPeriod * 1e-6 );
+            }
+        }
+        frame.scopeIndices.clear();
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t GpuProfiler::FindScope( const char* name ) {
+        for ( uint32_t i = 0; i < scopes.size(); ++i ) {
+            if ( scopes[i].name == name )
+                return i;
+        }
+        scopes.push_back( Scope{ name, FrameStats( kStatsWindow ) } );
+        return ( uint32_t )scopes.size() - 1;
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t GpuProfiler::BeginScope( const vk::CommandBuffer& commandBuffer, const char* name ) {
+        if ( not Enabled() )
+            return kInvalidScope;
+
+        FrameQueries& frame = frames[currentFrame];
+        if ( frame.scopeIndices.size() == kMaxScopesPerFrame )
+            return kInvalidScope;
+
+        const uint32_t scope = ( uint32_t )frame.scopeIndices.size();
+        frame.scopeIndices.push_back( FindScope( name ) );
+        commandBuffer.writeTimestamp( vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool, 2 * scope );
+        return scope;
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::EndScope( const vk::CommandBuffer& commandBuffer, uint32_t scope ) {
+        if ( scope == kInvalidScope )
+            return;
+
+        const FrameQueries& frame = frames[currentFrame];
+        assert( scope < frame.scopeIndices.size() );
+        commandBuffer.writeTimestamp( vk::PipelineStageFlagBits::eBottomOfPipe, frame.queryPool, 2 * scope + 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    const FrameStats* GpuProfiler::ScopeStats( const std::string& name ) const {
+        for ( const Scope& scope : scopes ) {
+            if ( scope.name == name and scope.stats.Count() != 0 )
+                return &scope.stats;
+        }
+        return nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    void GpuProfiler::PrintStats( std::ostream& stream ) const {
+        if ( not Enabled() ) {
+            stream << "GPU timestamps   : not supported by the graphics queue" << std::endl;
+            return;
+        }
+
+        for ( const Scope& scope : scopes ) {
+            stream << "GPU " << scope.name << " (ms) : avg " << scope.stats.Average()
+                   << " / p50 " << scope.stats.Percentile( 50.0 )
+                   << " / p99 " << scope.stats.Percentile( 99.0 )
+                   << " over the last " << scope.stats.Count() << " frame(s)" << std::endl;
+        }
+    }
+}
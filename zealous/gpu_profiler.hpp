@@ -0,0 +1,84 @@
+#pragma once
+
+#include "frame_stats.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Timestamp queries around named scopes of the command buffers. Each frame
+    // in flight owns a query pool, read back once the frame's fence signaled,
+    // so collecting results never waits on the GPU. Queues without timestamp
+    // support ( timestampValidBits == 0 ) turn every call into a no-op.
+    class GpuProfiler {
+      public:
+        static constexpr uint32_t kMaxScopesPerFrame = 32;
+        static constexpr size_t kStatsWindow = 256;
+
+        GpuProfiler();
+
+        void Init( const vk::Device& device, const vk::PhysicalDeviceProperties& properties,
+                   uint32_t timestampValidBits, uint32_t frameCount );
+        void DeInit();
+
+        bool Enabled() const { return timestampValidBits != 0; }
+
+        // collects what the frame slot measured last time, its fence must have
+        // signaled; records the query reset, so it goes before any scope and
+        // outside of a render pass
+        void BeginFrame( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex );
+
+        // scopes of the same name add to the same stats, uint32_t( -1 ) when
+        // the frame is out of queries or timestamps are not supported
+        uint32_t BeginScope( const vk::CommandBuffer& commandBuffer, const char* name );
+        void EndScope( const vk::CommandBuffer& commandBuffer, uint32_t scope );
+
+        // null when the scope never completed
+        const FrameStats* ScopeStats( const std::string& name ) const;
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        struct FrameQueries {
+            vk::QueryPool queryPool;
+            // per scope, the index in scopes; its queries are 2 * i and 2 * i + 1
+            std::vector<uint32_t> scopeIndices;
+        };
+
+        struct Scope {
+            std::string name;
+            FrameStats stats;
+        };
+
+        void Collect( FrameQueries& frame );
+        uint32_t FindScope( const char* name );
+
+        vk::Device device;
+        uint32_t timestampValidBits;
+        double timestampPeriod;     // nanoseconds per tick
+        uint32_t currentFrame;
+        std::vector<FrameQueries> frames;
+        std::vector<Scope> scopes;
+    };
+
+    //--------------------------------------------------------------------------
+    class GpuProfileScope {
+      public:
+        GpuProfileScope( GpuProfiler& profiler, const vk::CommandBuffer& commandBuffer, const char* name )
+            : profiler( profiler )
+            , commandBuffer( commandBuffer )
+            , scope( profiler.BeginScope( commandBuffer, name ) ) {
+        }
+        ~GpuProfileScope() { profiler.EndScope( commandBuffer, scope ); }
+
+        GpuProfileScope( const GpuProfileScope& ) = delete;
+        GpuProfileScope& operator=( const GpuProfileScope& ) = delete;
+
+      private:
+        GpuProfiler& profiler;
+        const vk::CommandBuffer& commandBuffer;
+        uint32_t scope;
+    };
+}
@@ -1,9 +1,8 @@
-#include <windows.h>
-
 #include "app.hpp"
 
 int main( int argc, char *argv[] ) {
     zealous::App app;
+    app.ParseCommandLine( argc, argv );
     app.Run();
 
     return 0;
@@ -0,0 +1,265 @@
+#include "memory_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static constexpr vk::DeviceSize kDefaultBlockSize = 64ull * 1024 * 1024;
+
+    //--------------------------------------------------------------------------
+    double HeapStats::Fragmentation() const {
+        const vk::DeviceSize freeBytes = blockBytes - usedBytes;
+        if ( freeBytes == 0 )
+            return 0.0;
+        return 1.0 - double( largestFreeBlock ) / double( freeBytes );
+    }
+
+    //--------------------------------------------------------------------------
+    MemoryAllocator::MemoryAllocator()
+        : blockBytes( 0 )
+        , peakBlockBytes( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    MemoryAllocator::~MemoryAllocator() {
+        assert( pools.empty() );
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryAllocator::Init( const vk::Device& device, const vk::PhysicalDeviceMemoryProperties& memoryProperties ) {
+        this->device = device;
+        this->memoryProperties = memoryProperties;
+        blockBytes = 0;
+        peakBlockBytes = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryAllocator::DeInit() {
+        for ( Pool& pool : pools ) {
+            for ( const auto& block : pool.blocks ) {
+                if ( not block->allocator.Empty() )
+                    std::cerr << "MemoryAllocator : " << block->allocator.AllocationCount()
+                              << " allocation(s) leaked in memory type " << pool.memoryTypeIndex << std::endl;
+                if ( block->mapped )
+                    device.unmapMemory( block->memory );
+                device.freeMemory( block->memory );
+            }
+        }
+        pools.clear();
+        device = vk::Device();
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t MemoryAllocator::FindMemoryType( uint32_t typeBits, const MemoryUsage& usage ) const {
+        uint32_t bestIndex = uint32_t( -1 );
+        int bestScore = -1;
+        for ( uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i ) {
+            if ( ( typeBits & ( 1u << i ) ) == 0 )
+                continue;
+
+            const vk::MemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+            if ( ( flags & usage.required ) != usage.required )
+                continue;
+
+            // count the preferred flags present, the first best one wins
+            const uint32_t matching = VkMemoryPropertyFlags( flags & usage.preferred );
+            int score = 0;
+            for ( uint32_t bits = matching; bits != 0; bits &= bits - 1 )
+                ++score;
+            if ( score > bestScore ) {
+                bestScore = score;
+                bestIndex = i;
+            }
+        }
+        return bestIndex;
+    }
+
+    //--------------------------------------------------------------------------
+    vk::DeviceSize MemoryAllocator::PreferredBlockSize( uint32_t memoryTypeIndex ) const {
+        // small heaps ( BAR memory, integrated GPUs with tiny carve-outs ) get
+        // smaller blocks so a few of them don't eat the heap
+        const uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        const vk::DeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+        return std::min( kDefaultBlockSize, heapSize / 8 );
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t MemoryAllocator::FindPool( uint32_t memoryTypeIndex, ResourceKind kind ) {
+        for ( uint32_t i = 0; i < pools.size(); ++i ) {
+            if ( pools[i].memoryTypeIndex == memoryTypeIndex and pools[i].kind == kind )
+                return i;
+        }
+        pools.push_back( Pool{ memoryTypeIndex, kind, {} } );
+        return ( uint32_t )( pools.size() - 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t MemoryAllocator::CreateBlock( Pool& pool, vk::DeviceSize size ) {
+        vk::MemoryAllocateInfo allocInfo = vk::MemoryAllocateInfo()
+                                           .setAllocationSize( size )
+                                           .setMemoryTypeIndex( pool.memoryTypeIndex );
+
+        std::unique_ptr<Block> block = std::make_unique<Block>();
+        block->memory = device.allocateMemory( allocInfo );
+        block->mapped = nullptr;
+        block->allocator.Init( size );
+        blockBytes += size;
+        peakBlockBytes = std::max( peakBlockBytes, blockBytes );
+
+        // host visible blocks are mapped once for their whole lifetime
+        const vk::MemoryPropertyFlags flags = memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags;
+        if ( flags & vk::MemoryPropertyFlagBits::eHostVisible )
+            block->mapped = device.mapMemory( block->memory, 0, VK_WHOLE_SIZE );
+
+        pool.blocks.push_back( std::move( block ) );
+        return ( uint32_t )( pool.blocks.size() - 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    Allocation MemoryAllocator::Allocate( const vk::MemoryRequirements& requirements, const MemoryUsage& usage, ResourceKind kind ) {
+        Allocation allocation;
+        const uint32_t memoryTypeIndex = FindMemoryType( requirements.memoryTypeBits, usage );
+        if ( memoryTypeIndex == uint32_t( -1 ) )
+            return allocation;
+
+        const uint32_t poolIndex = FindPool( memoryTypeIndex, kind );
+        Pool& pool = pools[poolIndex];
+
+        uint64_t offset = 0;
+        uint32_t handle = TlsfAllocator::kInvalidHandle;
+        uint32_t blockIndex = 0;
+        for ( ; blockIndex < pool.blocks.size(); ++blockIndex ) {
+            handle = pool.blocks[blockIndex]->allocator.Allocate( requirements.size, requirements.alignment, offset );
+            if ( handle != TlsfAllocator::kInvalidHandle )
+                break;
+        }
+
+        if ( handle == TlsfAllocator::kInvalidHandle ) {
+            // large resources get a block of their own
+            const vk::DeviceSize granularity = TlsfAllocator::kGranularity;
+            const vk::DeviceSize requiredSize = ( requirements.size + requirements.alignment + granularity - 1 ) / granularity * granularity;
+            const vk::DeviceSize blockSize = std::max( PreferredBlockSize( memoryTypeIndex ), requiredSize );
+            blockIndex = CreateBlock( pool, blockSize );
+            handle = pool.blocks[blockIndex]->allocator.Allocate( requirements.size, requirements.alignment, offset );
+            assert( handle != TlsfAllocator::kInvalidHandle );
+        }
+
+        const Block& block = *pool.blocks[blockIndex];
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.mapped = block.mapped ? static_cast<char*>( block.mapped ) + offset : nullptr;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.poolIndex = poolIndex;
+        allocation.blockIndex = blockIndex;
+        allocation.handle = handle;
+        return allocation;
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryAllocator::Free( Allocation& allocation ) {
+        if ( not allocation )
+            return;
+
+        Pool& pool = pools[allocation.poolIndex];
+        Block& block = *pool.blocks[allocation.blockIndex];
+        block.allocator.Free( allocation.handle );
+
+        // give empty blocks back to the driver, except the last one of the pool
+        // so that alloc / free patterns don't thrash vkAllocateMemory
+        const bool lastBlock = allocation.blockIndex + 1 == pool.blocks.size();
+        if ( block.allocator.Empty() and lastBlock and pool.blocks.size() > 1 ) {
+            if ( block.mapped )
+                device.unmapMemory( block.memory );
+            device.freeMemory( block.memory );
+            blockBytes -= block.allocator.Size();
+            pool.blocks.pop_back();
+        }
+
+        allocation = Allocation();
+    }
+
+    //--------------------------------------------------------------------------
+    Allocation MemoryAllocator::AllocateBuffer( const vk::Buffer& buffer, const MemoryUsage& usage ) {
+        const vk::MemoryRequirements requirements = device.getBufferMemoryRequirements( buffer );
+        Allocation allocation = Allocate( requirements, usage, ResourceKind::eLinear );
+        assert( allocation );
+        device.bindBufferMemory( buffer, allocation.memory, allocation.offset );
+        return allocation;
+    }
+
+    //--------------------------------------------------------------------------
+    Allocation MemoryAllocator::AllocateImage( const vk::Image& image, const MemoryUsage& usage, ResourceKind kind ) {
+        const vk::MemoryRequirements requirements = device.getImageMemoryRequirements( image );
+        Allocation allocation = Allocate( requirements, usage, kind );
+        assert( allocation );
+        device.bindImageMemory( image, allocation.memory, allocation.offset );
+        return allocation;
+    }
+
+    //--------------------------------------------------------------------------
+    std::vector<HeapStats> MemoryAllocator::Stats() const {
+        std::vector<HeapStats> stats( memoryProperties.memoryHeapCount );
+        for ( const Pool& pool : pools ) {
+            HeapStats& heap = stats[memoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex];
+            for ( const auto& block : pool.blocks ) {
+                heap.blockBytes += block->allocator.Size();
+                heap.usedBytes += block->allocator.UsedBytes();
+                heap.largestFreeBlock = std::max( heap.largestFreeBlock, block->allocator.LargestFreeBlock() );
+                heap.allocationCount += block->allocator.AllocationCount();
+                ++heap.blockCount;
+            }
+        }
+        return stats;
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryAllocator::PrintStats( std::ostream& stream ) const {
+        const std::vector<HeapStats> stats = Stats();
+        for ( size_t i = 0; i < stats.size(); ++i ) {
+            const HeapStats& heap = stats[i];
+            stream << "Heap " << i << " : " << heap.usedBytes << " / " << heap.blockBytes << " bytes used in "
+                   << heap.allocationCount << " allocation(s), " << heap.blockCount << " block(s), fragmentation "
+                   << heap.Fragmentation() << std::endl;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    MemoryArena::MemoryArena()
+        : head( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryArena::Init( MemoryAllocator& allocator, vk::DeviceSize size, const MemoryUsage& usage, uint32_t typeBits ) {
+        vk::MemoryRequirements requirements;
+        requirements.size = size;
+        requirements.alignment = TlsfAllocator::kGranularity;
+        requirements.memoryTypeBits = typeBits;
+        allocation = allocator.Allocate( requirements, usage, ResourceKind::eLinear );
+        assert( allocation );
+        head = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void MemoryArena::DeInit( MemoryAllocator& allocator ) {
+        allocator.Free( allocation );
+        head = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    bool MemoryArena::Allocate( vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset, void*& mapped ) {
+        // offsets are relative to the arena, which starts on a granularity
+        // boundary, so alignments up to the granularity hold in absolute terms
+        const vk::DeviceSize aligned = ( head + alignment - 1 ) / alignment * alignment;
+        if ( aligned + size > allocation.size )
+            return false;
+
+        offset = aligned;
+        mapped = allocation.mapped ? static_cast<char*>( allocation.mapped ) + aligned : nullptr;
+        head = aligned + size;
+        return true;
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "tlsf_allocator.hpp"
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Buffers ( and linear images ) never share a block with optimal images,
+    // which keeps bufferImageGranularity out of the sub-allocator entirely.
+    enum class ResourceKind {
+        eLinear,
+        eOptimal
+    };
+
+    //--------------------------------------------------------------------------
+    struct MemoryUsage {
+        vk::MemoryPropertyFlags required;
+        vk::MemoryPropertyFlags preferred;
+    };
+
+    //--------------------------------------------------------------------------
+    struct Allocation {
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        // non null when the memory is host visible, blocks stay mapped
+        void* mapped = nullptr;
+        uint32_t memoryTypeIndex = uint32_t( -1 );
+
+        // bookkeeping for Free
+        uint32_t poolIndex = uint32_t( -1 );
+        uint32_t blockIndex = uint32_t( -1 );
+        uint32_t handle = TlsfAllocator::kInvalidHandle;
+
+        explicit operator bool() const { return !!memory; }
+    };
+
+    //--------------------------------------------------------------------------
+    struct HeapStats {
+        vk::DeviceSize blockBytes = 0;      // allocated from the driver
+        vk::DeviceSize usedBytes = 0;       // handed out to resources
+        vk::DeviceSize largestFreeBlock = 0;
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+
+        // 0 when all the free space is contiguous, close to 1 when it's scattered
+        double Fragmentation() const;
+    };
+
+    //--------------------------------------------------------------------------
+    class MemoryAllocator {
+      public:
+        MemoryAllocator();
+        ~MemoryAllocator();
+
+        void Init( const vk::Device& device, const vk::PhysicalDeviceMemoryProperties& memoryProperties );
+        void DeInit();
+
+        // memory type matching all required flags and as many preferred ones as
+        // possible, uint32_t( -1 ) when there is none
+        uint32_t FindMemoryType( uint32_t typeBits, const MemoryUsage& usage ) const;
+
+        Allocation Allocate( const vk::MemoryRequirements& requirements, const MemoryUsage& usage, ResourceKind kind );
+        void Free( Allocation& allocation );
+
+        // allocate and bind in one go
+        Allocation AllocateBuffer( const vk::Buffer& buffer, const MemoryUsage& usage );
+        Allocation AllocateImage( const vk::Image& image, const MemoryUsage& usage, ResourceKind kind = ResourceKind::eOptimal );
+
+        std::vector<HeapStats> Stats() const;
+        // most memory allocated from the driver at once, over every heap
+        vk::DeviceSize PeakBlockBytes() const { return peakBlockBytes; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        struct Block {
+            vk::DeviceMemory memory;
+            void* mapped;
+            TlsfAllocator allocator;
+        };
+
+        struct Pool {
+            uint32_t memoryTypeIndex;
+            ResourceKind kind;
+            std::vector<std::unique_ptr<Block>> blocks;
+        };
+
+        uint32_t FindPool( uint32_t memoryTypeIndex, ResourceKind kind );
+        uint32_t CreateBlock( Pool& pool, vk::DeviceSize size );
+        vk::DeviceSize PreferredBlockSize( uint32_t memoryTypeIndex ) const;
+
+        vk::Device device;
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
+        std::vector<Pool> pools;
+        vk::DeviceSize blockBytes;
+        vk::DeviceSize peakBlockBytes;
+    };
+
+    //--------------------------------------------------------------------------
+    // Linear sub-allocator over a single allocation, for data that lives for
+    // one frame: bump allocate during the frame, reset once its fence signaled.
+    class MemoryArena {
+      public:
+        MemoryArena();
+
+        void Init( MemoryAllocator& allocator, vk::DeviceSize size, const MemoryUsage& usage, uint32_t typeBits );
+        void DeInit( MemoryAllocator& allocator );
+
+        // returns false when the arena is full
+        bool Allocate( vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset, void*& mapped );
+        void Reset() { head = 0; }
+
+        const Allocation& Memory() const { return allocation; }
+        vk::DeviceSize UsedBytes() const { return head; }
+
+      private:
+        Allocation allocation;
+        vk::DeviceSize head;
+    };
+}
@@ -0,0 +1,81 @@
+#include "overlap_counters.hpp"
+
+#include <cassert>
+#include <iostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static const char* const kStageNames[OverlapCounters::eStageCount] = {
+        "events",
+        "simulation",
+        "render"
+    };
+
+    //--------------------------------------------------------------------------
+    OverlapCounters::OverlapCounters()
+        : activeStages( 0 )
+        , last( std::chrono::steady_clock::now() )
+        , busy{}
+        , overlap{} {
+    }
+
+    //--------------------------------------------------------------------------
+    void OverlapCounters::Begin( Stage stage ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        Advance();
+        assert( not ( activeStages & ( 1u << stage ) ) );
+        activeStages |= 1u << stage;
+    }
+
+    //--------------------------------------------------------------------------
+    void OverlapCounters::End( Stage stage ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        Advance();
+        assert( activeStages & ( 1u << stage ) );
+        activeStages &= ~( 1u << stage );
+    }
+
+    //--------------------------------------------------------------------------
+    void OverlapCounters::Advance() {
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double, std::milli>( now - last ).count();
+        last = now;
+
+        for ( uint32_t a = 0; a < eStageCount; ++a ) {
+            if ( not ( activeStages & ( 1u << a ) ) )
+                continue;
+            busy[a] += elapsed;
+            for ( uint32_t b = a + 1; b < eStageCount; ++b ) {
+                if ( activeStages & ( 1u << b ) )
+                    overlap[a][b] += elapsed;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    double OverlapCounters::BusyMilliseconds( Stage stage ) const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return busy[stage];
+    }
+
+    //--------------------------------------------------------------------------
+    double OverlapCounters::OverlapMilliseconds( Stage a, Stage b ) const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return a < b ? overlap[a][b] : overlap[b][a];
+    }
+
+    //--------------------------------------------------------------------------
+    void OverlapCounters::Print( std::ostream& stream ) const {
+        for ( uint32_t a = 0; a < eStageCount; ++a ) {
+            const double stageBusy = BusyMilliseconds( Stage( a ) );
+            stream << "Busy " << kStageNames[a] << " (ms) : " << stageBusy;
+            for ( uint32_t b = 0; b < eStageCount; ++b ) {
+                if ( a == b )
+                    continue;
+                const double shared = OverlapMilliseconds( Stage( a ), Stage( b ) );
+                stream << ", " << ( stageBusy > 0.0 ? 100.0 * shared / stageBusy : 0.0 ) << "% with " << kStageNames[b];
+            }
+            stream << std::endl;
+        }
+    }
+}
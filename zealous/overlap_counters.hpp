@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <iosfwd>
+#include <mutex>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // How long each thread's stage was busy, and how much of that time another
+    // stage was busy too. Every Begin / End attributes the time since the
+    // previous one to the stages that were active during it.
+    class OverlapCounters {
+      public:
+        enum Stage {
+            eEvents,
+            eSimulation,
+            eRender,
+            eStageCount
+        };
+
+        OverlapCounters();
+
+        void Begin( Stage stage );
+        void End( Stage stage );
+
+        double BusyMilliseconds( Stage stage ) const;
+        double OverlapMilliseconds( Stage a, Stage b ) const;
+        void Print( std::ostream& stream ) const;
+
+      private:
+        void Advance();
+
+        mutable std::mutex mutex;
+        uint32_t activeStages;
+        std::chrono::steady_clock::time_point last;
+        std::array<double, eStageCount> busy;
+        std::array<std::array<double, eStageCount>, eStageCount> overlap;
+    };
+}
@@ -0,0 +1,58 @@
+#include "parallel_recorder.hpp"
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    ParallelRecorder::ParallelRecorder()
+        : slotCount( 0 )
+        , frameCount( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void ParallelRecorder::Init( const vk::Device& device, uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t frameCount ) {
+        this->device = device;
+        this->slotCount = slotCount;
+        this->frameCount = frameCount;
+
+        // transient, and reset as a whole like the frame pools
+        vk::CommandPoolCreateInfo createInfo = vk::CommandPoolCreateInfo()
+                                               .setFlags( vk::CommandPoolCreateFlagBits::eTransient )
+                                               .setQueueFamilyIndex( queueFamilyIndex );
+        pools.resize( slotCount * frameCount );
+        for ( SlotPool& pool : pools ) {
+            pool.commandPool = device.createCommandPool( createInfo );
+            pool.used = 0;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void ParallelRecorder::DeInit() {
+        for ( SlotPool& pool : pools )
+            device.destroyCommandPool( pool.commandPool );
+        pools.clear();
+        device = vk::Device();
+    }
+
+    //--------------------------------------------------------------------------
+    void ParallelRecorder::BeginFrame( uint32_t frameIndex ) {
+        for ( uint32_t slot = 0; slot < slotCount; ++slot ) {
+            SlotPool& pool = Pool( slot, frameIndex );
+            if ( pool.used == 0 )
+                continue;
+            device.resetCommandPool( pool.commandPool, vk::CommandPoolResetFlags() );
+            pool.used = 0;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    vk::CommandBuffer ParallelRecorder::Allocate( uint32_t slot, uint32_t frameIndex ) {
+        SlotPool& pool = Pool( slot, frameIndex );
+        if ( pool.used == pool.commandBuffers.size() ) {
+            vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+                    .setCommandPool( pool.commandPool )
+                    .setLevel( vk::CommandBufferLevel::eSecondary )
+                    .setCommandBufferCount( 1 );
+            pool.commandBuffers.push_back( device.allocateCommandBuffers( allocInfo )[0] );
+        }
+        return pool.commandBuffers[pool.used++];
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Command pools for recording on several threads: one per thread slot and
+    // frame in flight, so no pool is ever touched by two threads at once and a
+    // frame's pools are reset together once its fence signaled. Buffers are
+    // kept across resets and handed out again.
+    class ParallelRecorder {
+      public:
+        ParallelRecorder();
+
+        void Init( const vk::Device& device, uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t frameCount );
+        void DeInit();
+
+        // every buffer handed out for this frame last time is done executing
+        void BeginFrame( uint32_t frameIndex );
+
+        // secondary buffer from the pool of that slot, only the thread
+        // currently owning the slot may call it
+        vk::CommandBuffer Allocate( uint32_t slot, uint32_t frameIndex );
+
+      private:
+        struct SlotPool {
+            vk::CommandPool commandPool;
+            std::vector<vk::CommandBuffer> commandBuffers;
+            size_t used;
+        };
+
+        SlotPool& Pool( uint32_t slot, uint32_t frameIndex ) { return pools[slot * frameCount + frameIndex]; }
+
+        vk::Device device;
+        uint32_t slotCount;
+        uint32_t frameCount;
+        std::vector<SlotPool> pools;
+    };
+}
@@ -0,0 +1,231 @@
+#include "particle_simulation.hpp"
+#include "vulkan_helpers.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // push constants of shaders/particles.comp
+    struct StepConstants {
+        float dt;
+        float scale;
+        uint32_t count;
+        uint32_t seed;
+    };
+
+    //--------------------------------------------------------------------------
+    ParticleSimulation::ParticleSimulation()
+        : particleCount( 0 )
+        , asyncAvailable( false )
+        , graphicsCanCompute( false )
+        , async( false )
+        , seeded( false ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void ParticleSimulation::Init( std::shared_ptr<VulkanContext> context, uint32_t particleCount, const std::vector<uint32_t>& shaderCode ) {
+        this->context = context;
+        const vk::Device& device = context->Device();
+        const uint32_t frameCount = context->FramesInFlight();
+
+        // a single dispatch covers them all
+        const uint32_t maxGroups = context->PhysicalDeviceProperties().limits.maxComputeWorkGroupCount[0];
+        this->particleCount = ( uint32_t )std::min<uint64_t>( particleCount, uint64_t( maxGroups ) * kGroupSize );
+        seeded = false;
+
+        const uint32_t graphicsFamily = context->GraphicsQueueFamilyIndex();
+        const uint32_t computeFamily = context->ComputeQueueFamilyIndex();
+        const std::vector<vk::QueueFamilyProperties> families = context->PhysicalDevice().getQueueFamilyProperties();
+        asyncAvailable = computeFamily != graphicsFamily;
+        graphicsCanCompute = !!( families[graphicsFamily].queueFlags & vk::QueueFlagBits::eCompute );
+        SetAsync( true );
+
+        // both families use the buffers, concurrent sharing spares the
+        // ownership transfers every frame
+        const std::array<uint32_t, 2> familyIndices = { graphicsFamily, computeFamily };
+        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive );
+        if ( asyncAvailable ) {
+            createInfo.setSharingMode( vk::SharingMode::eConcurrent )
+            .setQueueFamilyIndexCount( ( uint32_t )familyIndices.size() )
+            .setPQueueFamilyIndices( familyIndices.data() );
+        }
+        const MemoryUsage usage = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+        const vk::DeviceSize bufferSize = vk::DeviceSize( this->particleCount ) * 4 * sizeof( float );
+
+        createInfo.setSize( bufferSize )
+        .setUsage( vk::BufferUsageFlagBits::eStorageBuffer );
+        stateBuffer = UniqueBuffer( device, device.createBuffer( createInfo ) );
+        stateMemory = context->Allocator().AllocateBuffer( stateBuffer, usage );
+
+        createInfo.setUsage( vk::BufferUsageFlagBits::eStorageBuffer );
+        instanceBuffers.resize( frameCount );
+        instanceMemory.resize( frameCount );
+        for ( uint32_t i = 0; i < frameCount; ++i ) {
+            instanceBuffers[i] = UniqueBuffer( device, device.createBuffer( createInfo ) );
+            instanceMemory[i] = context->Allocator().AllocateBuffer( instanceBuffers[i], usage );
+        }
+
+        // descriptors, one set per frame slot for its output buffer
+        const std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+            vk::DescriptorSetLayoutBinding( 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute ),
+            vk::DescriptorSetLayoutBinding( 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute )
+        };
+        vk::DescriptorSetLayoutCreateInfo layoutInfo = vk::DescriptorSetLayoutCreateInfo()
+                .setBindingCount( ( uint32_t )bindings.size() )
+                .setPBindings( bindings.data() );
+        descriptorSetLayout = UniqueDescriptorSetLayout( device, device.createDescriptorSetLayout( layoutInfo ) );
+
+        vk::DescriptorPoolSize poolSize = vk::DescriptorPoolSize()
+                                          .setType( vk::DescriptorType::eStorageBuffer )
+                                          .setDescriptorCount( 2 * frameCount );
+        vk::DescriptorPoolCreateInfo poolInfo = vk::DescriptorPoolCreateInfo()
+                                                .setMaxSets( frameCount )
+                                                .setPoolSizeCount( 1 )
+                                                .setPPoolSizes( &poolSize );
+        descriptorPool = UniqueDescriptorPool( device, device.createDescriptorPool( poolInfo ) );
+
+        const std::vector<vk::DescriptorSetLayout> setLayouts( frameCount, descriptorSetLayout.Get() );
+        vk::DescriptorSetAllocateInfo setInfo = vk::DescriptorSetAllocateInfo()
+                                                .setDescriptorPool( descriptorPool )
+                                                .setDescriptorSetCount( frameCount )
+                                                .setPSetLayouts( setLayouts.data() );
+        descriptorSets = device.allocateDescriptorSets( setInfo );
+        for ( uint32_t i = 0; i < frameCount; ++i ) {
+            const vk::DescriptorBufferInfo stateInfo( stateBuffer, 0, VK_WHOLE_SIZE );
+            const vk::DescriptorBufferInfo instanceInfo( instanceBuffers[i], 0, VK_WHOLE_SIZE );
+            const std::array<vk::WriteDescriptorSet, 2> writes = {
+                vk::WriteDescriptorSet()
+                .setDstSet( descriptorSets[i] )
+                .setDstBinding( 0 )
+                .setDescriptorCount( 1 )
+                .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+                .setPBufferInfo( &stateInfo ),
+                vk::WriteDescriptorSet()
+                .setDstSet( descriptorSets[i] )
+                .setDstBinding( 1 )
+                .setDescriptorCount( 1 )
+                .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+                .setPBufferInfo( &instanceInfo )
+            };
+            device.updateDescriptorSets( writes, nullptr );
+        }
+
+        // pipeline
+        const vk::PushConstantRange pushConstants( vk::ShaderStageFlagBits::eCompute, 0, sizeof( StepConstants ) );
+        vk::PipelineLayoutCreateInfo pipelineLayoutInfo = vk::PipelineLayoutCreateInfo()
+                .setSetLayoutCount( 1 )
+                .setPSetLayouts( &descriptorSetLayout.Get() )
+                .setPushConstantRangeCount( 1 )
+                .setPPushConstantRanges( &pushConstants );
+        pipelineLayout = UniquePipelineLayout( device, device.createPipelineLayout( pipelineLayoutInfo ) );
+
+        const UniqueShaderModule shader( device, CreateShaderModule( device, shaderCode ) );
+        vk::ComputePipelineCreateInfo pipelineInfo = vk::ComputePipelineCreateInfo()
+                .setStage( vk::PipelineShaderStageCreateInfo()
+                           .setStage( vk::ShaderStageFlagBits::eCompute )
+                           .setModule( shader )
+                           .setPName( "main" ) )
+                .setLayout( pipelineLayout );
+        pipeline = UniquePipeline( device, context->PipelineCache().CreateComputePipeline( pipelineInfo ) );
+
+        // async submission objects
+        vk::CommandPoolCreateInfo commandPoolInfo = vk::CommandPoolCreateInfo()
+                .setFlags( vk::CommandPoolCreateFlagBits::eTransient )
+                .setQueueFamilyIndex( computeFamily );
+        commandPools.resize( frameCount );
+        commandBuffers.resize( frameCount );
+        doneSemaphores.resize( frameCount );
+        for ( uint32_t i = 0; i < frameCount; ++i ) {
+            commandPools[i] = UniqueCommandPool( device, device.createCommandPool( commandPoolInfo ) );
+            vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+                    .setCommandPool( commandPools[i] )
+                    .setLevel( vk::CommandBufferLevel::ePrimary )
+                    .setCommandBufferCount( 1 );
+            commandBuffers[i] = device.allocateCommandBuffers( allocInfo )[0];
+            doneSemaphores[i] = UniqueSemaphore( device, device.createSemaphore( vk::SemaphoreCreateInfo() ) );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void ParticleSimulation::DeInit() {
+        MemoryAllocator& allocator = context->Allocator();
+
+        doneSemaphores.clear();
+        commandBuffers.clear();
+        commandPools.clear();
+
+        pipeline.Reset();
+        pipelineLayout.Reset();
+        descriptorPool.Reset();
+        descriptorSetLayout.Reset();
+        descriptorSets.clear();
+
+        instanceBuffers.clear();
+        for ( auto& memory : instanceMemory )
+            allocator.Free( memory );
+        instanceMemory.clear();
+        stateBuffer.Reset();
+        allocator.Free( stateMemory );
+
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    void ParticleSimulation::RecordStep( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, float dt ) {
+        // the previous step wrote the state, on this queue whichever it is;
+        // the output buffer was last read by a frame whose fence signaled
+        const vk::MemoryBarrier stateBarrier = vk::MemoryBarrier()
+                                               .setSrcAccessMask( vk::AccessFlagBits::eShaderWrite )
+                                               .setDstAccessMask( vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite );
+        commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+                                       vk::DependencyFlags(), stateBarrier, nullptr, nullptr );
+
+        const StepConstants constants = {
+            dt,
+            // the same size as cells of the instance grid
+            1.f / ( float )std::ceil( std::sqrt( ( double )particleCount ) ),
+            particleCount,
+            seeded ? 0u : 1u
+        };
+        seeded = true;
+
+        commandBuffer.bindPipeline( vk::PipelineBindPoint::eCompute, pipeline );
+        commandBuffer.bindDescriptorSets( vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[frameIndex], nullptr );
+        commandBuffer.pushConstants( pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof( constants ), &constants );
+        commandBuffer.dispatch( ( particleCount + kGroupSize - 1 ) / kGroupSize, 1, 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    void ParticleSimulation::Submit( uint32_t frameIndex, float dt, std::vector<vk::Semaphore>& waitSemaphores,
+                                     std::vector<vk::PipelineStageFlags>& waitStages ) {
+        // the graphics submit of this frame slot waited on the previous
+        // dispatch, and its fence signaled
+        const vk::Device& device = context->Device();
+        device.resetCommandPool( commandPools[frameIndex], vk::CommandPoolResetFlags() );
+
+        const vk::CommandBuffer& commandBuffer = commandBuffers[frameIndex];
+        commandBuffer.begin( vk::CommandBufferBeginInfo().setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit ) );
+        RecordStep( commandBuffer, frameIndex, dt );
+        commandBuffer.end();
+
+        // the semaphore carries the memory dependency to the vertex input,
+        // no barrier nor ownership transfer with concurrent buffers
+        vk::SubmitInfo submitInfo = vk::SubmitInfo()
+                                    .setCommandBufferCount( 1 )
+                                    .setPCommandBuffers( &commandBuffer )
+                                    .setSignalSemaphoreCount( 1 )
+                                    .setPSignalSemaphores( &doneSemaphores[frameIndex].Get() );
+        context->ComputeQueue().submit( submitInfo, vk::Fence() );
+
+        waitSemaphores.push_back( doneSemaphores[frameIndex] );
+        waitStages.push_back( vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexShader );
+    }
+
+    //--------------------------------------------------------------------------
+    void ParticleSimulation::Record( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, float dt ) {
+        RecordStep( commandBuffer, frameIndex, dt );
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "vulkan_context.hpp"
+
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Particles stepped by a compute shader, which writes them out as the
+    // instance stream of the frame slot. Async, the dispatch of a frame is
+    // submitted to the compute queue and overlaps the graphics work of the
+    // frame before it, the graphics submit waits on a semaphore; otherwise it
+    // is recorded in the frame's graphics command buffer.
+    class ParticleSimulation {
+      public:
+        ParticleSimulation();
+
+        void Init( std::shared_ptr<VulkanContext> context, uint32_t particleCount, const std::vector<uint32_t>& shaderCode );
+        void DeInit();
+
+        uint32_t ParticleCount() const { return particleCount; }
+        // true when the device has a compute family of its own
+        bool AsyncAvailable() const { return asyncAvailable; }
+        bool Async() const { return async; }
+        // only between frames with the device idle, the state buffer changes queue
+        void SetAsync( bool enabled ) { async = enabled and ( asyncAvailable or not graphicsCanCompute ); }
+
+        // the output of the last step of that frame slot, read by the vertex
+        // shader as a storage buffer
+        const vk::Buffer& InstanceBuffer( uint32_t frameIndex ) const { return instanceBuffers[frameIndex].Get(); }
+
+        // Async: submits the step of that frame slot, the graphics submit must
+        // wait on the semaphore appended, before compute and vertex shaders
+        void Submit( uint32_t frameIndex, float dt, std::vector<vk::Semaphore>& waitSemaphores,
+                     std::vector<vk::PipelineStageFlags>& waitStages );
+        // not Async: records the step ahead of the render pass, the readers
+        // of the instance buffer put their own barrier
+        void Record( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, float dt );
+
+      private:
+        static constexpr uint32_t kGroupSize = 256;
+
+        void RecordStep( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex, float dt );
+
+        std::shared_ptr<VulkanContext> context;
+        uint32_t particleCount;
+        bool asyncAvailable;
+        bool graphicsCanCompute;
+        bool async;
+        bool seeded;
+
+        // position and velocity, only ever touched by the compute shader
+        Allocation stateMemory;
+        UniqueBuffer stateBuffer;
+        std::vector<Allocation> instanceMemory;
+        std::vector<UniqueBuffer> instanceBuffers;
+
+        UniqueDescriptorSetLayout descriptorSetLayout;
+        UniqueDescriptorPool descriptorPool;
+        std::vector<vk::DescriptorSet> descriptorSets;
+        UniquePipelineLayout pipelineLayout;
+        UniquePipeline pipeline;
+
+        // per frame slot on the compute family, reset once the frame fence
+        // signaled: the graphics submit waited on the dispatch
+        std::vector<UniqueCommandPool> commandPools;
+        std::vector<vk::CommandBuffer> commandBuffers;
+        std::vector<UniqueSemaphore> doneSemaphores;
+    };
+}
@@ -0,0 +1,178 @@
+#include "pipeline_cache.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // VkPipelineCacheHeaderVersionOne, as laid out at the start of the blob
+    struct PipelineCacheHeader {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+    static_assert( sizeof( PipelineCacheHeader ) == 16 + VK_UUID_SIZE );
+
+    //--------------------------------------------------------------------------
+    PersistentPipelineCache::PersistentPipelineCache()
+        : loaded( false )
+        , hits( 0 )
+        , misses( 0 )
+        , creationNanoseconds( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void PersistentPipelineCache::Init( const vk::Device& device, const vk::PhysicalDeviceProperties& properties, const std::string& path ) {
+        this->device = device;
+        this->properties = properties;
+        this->path = path;
+
+        initialData.clear();
+        std::ifstream file( path, std::ios::binary | std::ios::ate );
+        if ( file ) {
+            const std::streamsize size = file.tellg();
+            file.seekg( 0 );
+            initialData.resize( ( size_t )size );
+            if ( not file.read( reinterpret_cast<char*>( initialData.data() ), size ) )
+                initialData.clear();
+        }
+
+        // a blob from another driver or GPU is at best useless, at worst a crash
+        loaded = Validate( initialData );
+        if ( not loaded )
+            initialData.clear();
+
+        vk::PipelineCacheCreateInfo createInfo = vk::PipelineCacheCreateInfo()
+                .setInitialDataSize( initialData.size() )
+                .setPInitialData( initialData.data() );
+        cache = device.createPipelineCache( createInfo );
+
+        hits = 0;
+        misses = 0;
+        creationNanoseconds = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void PersistentPipelineCache::DeInit() {
+        if ( not Save() )
+            std::cerr << "Could not write the pipeline cache to " << path << std::endl;
+
+        device.destroyPipelineCache( cache );
+        cache = vk::PipelineCache();
+        initialData.clear();
+    }
+
+    //--------------------------------------------------------------------------
+    bool PersistentPipelineCache::Validate( const std::vector<uint8_t>& data ) const {
+        PipelineCacheHeader header;
+        if ( data.size() < sizeof( header ) )
+            return false;
+        std::memcpy( &header, data.data(), sizeof( header ) );
+
+        return header.headerSize >= sizeof( header )
+               and header.headerSize <= data.size()
+               and header.headerVersion == uint32_t( vk::PipelineCacheHeaderVersion::eOne )
+               and header.vendorID == properties.vendorID
+               and header.deviceID == properties.deviceID
+               and std::memcmp( header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+    }
+
+    //--------------------------------------------------------------------------
+    vk::PipelineCache PersistentPipelineCache::CreateWorkerCache() {
+        vk::PipelineCacheCreateInfo createInfo = vk::PipelineCacheCreateInfo()
+                .setInitialDataSize( initialData.size() )
+                .setPInitialData( initialData.data() );
+        return device.createPipelineCache( createInfo );
+    }
+
+    //--------------------------------------------------------------------------
+    void PersistentPipelineCache::MergeWorkerCache( const vk::PipelineCache& workerCache ) {
+        {
+            std::lock_guard<std::mutex> lock( cacheMutex );
+            device.mergePipelineCaches( cache, workerCache );
+        }
+        device.destroyPipelineCache( workerCache );
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PersistentPipelineCache::CreateGraphicsPipeline( const vk::GraphicsPipelineCreateInfo& createInfo ) {
+        std::lock_guard<std::mutex> lock( cacheMutex );
+        return CreateAndCount( cache, [&] { return device.createGraphicsPipeline( cache, createInfo ); } );
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PersistentPipelineCache::CreateGraphicsPipeline( const vk::GraphicsPipelineCreateInfo& createInfo, const vk::PipelineCache& workerCache ) {
+        return CreateAndCount( workerCache, [&] { return device.createGraphicsPipeline( workerCache, createInfo ); } );
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PersistentPipelineCache::CreateComputePipeline( const vk::ComputePipelineCreateInfo& createInfo ) {
+        std::lock_guard<std::mutex> lock( cacheMutex );
+        return CreateAndCount( cache, [&] { return device.createComputePipeline( cache, createInfo ); } );
+    }
+
+    //--------------------------------------------------------------------------
+    size_t PersistentPipelineCache::DataSize( const vk::PipelineCache& from ) const {
+        size_t size = 0;
+        const VkResult result = vkGetPipelineCacheData( static_cast<VkDevice>( device ), static_cast<VkPipelineCache>( from ), &size, nullptr );
+        assert( result == VK_SUCCESS );
+        return size;
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PersistentPipelineCache::CreateAndCount( const vk::PipelineCache& from, const std::function<vk::Pipeline()>& create ) {
+        // Vulkan 1.0 has no creation feedback, a cache that had to store a new
+        // entry is the closest thing to a miss
+        const size_t sizeBefore = DataSize( from );
+        const auto start = std::chrono::steady_clock::now();
+        const vk::Pipeline pipeline = create();
+        const auto end = std::chrono::steady_clock::now();
+        const size_t sizeAfter = DataSize( from );
+
+        creationNanoseconds += ( uint64_t )std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+        if ( sizeAfter > sizeBefore )
+            ++misses;
+        else
+            ++hits;
+        return pipeline;
+    }
+
+    //--------------------------------------------------------------------------
+    bool PersistentPipelineCache::Save() const {
+        const std::vector<uint8_t> data = device.getPipelineCacheData( cache );
+        if ( data.empty() )
+            return false;
+
+        // write aside then rename over, a crash mid-write leaves the previous
+        // cache intact rather than a truncated one
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file( tempPath, std::ios::binary | std::ios::trunc );
+            file.write( reinterpret_cast<const char*>( data.data() ), ( std::streamsize )data.size() );
+            file.close();
+            if ( not file )
+                return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename( tempPath, path, error );
+        if ( error ) {
+            std::filesystem::remove( tempPath, error );
+            return false;
+        }
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    void PersistentPipelineCache::PrintStats( std::ostream& stream ) const {
+        stream << "Pipeline cache   : " << ( loaded ? "warm" : "cold" ) << ", "
+               << HitCount() << " hit(s), " << MissCount() << " miss(es), "
+               << CreationMilliseconds() << " ms creating pipelines" << std::endl;
+    }
+}
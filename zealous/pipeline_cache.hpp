@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // vk::PipelineCache backed by a file. The blob is only handed to the driver
+    // when its header matches the device it was written for, anything else
+    // starts a cold cache.
+    class PersistentPipelineCache {
+      public:
+        PersistentPipelineCache();
+
+        void Init( const vk::Device& device, const vk::PhysicalDeviceProperties& properties, const std::string& path );
+        // writes the blob back, replacing the previous file atomically
+        void DeInit();
+
+        const vk::PipelineCache& Cache() const { return cache; }
+
+        // seeded with the same blob as the main cache, for threads compiling
+        // pipelines without contending on it, hand it back to MergeWorkerCache
+        vk::PipelineCache CreateWorkerCache();
+        void MergeWorkerCache( const vk::PipelineCache& workerCache );
+
+        // timed, and counted as a hit when the cache did not grow
+        vk::Pipeline CreateGraphicsPipeline( const vk::GraphicsPipelineCreateInfo& createInfo );
+        vk::Pipeline CreateGraphicsPipeline( const vk::GraphicsPipelineCreateInfo& createInfo, const vk::PipelineCache& workerCache );
+        vk::Pipeline CreateComputePipeline( const vk::ComputePipelineCreateInfo& createInfo );
+
+        bool Loaded() const { return loaded; }
+        uint32_t HitCount() const { return hits; }
+        uint32_t MissCount() const { return misses; }
+        double CreationMilliseconds() const { return creationNanoseconds * 1e-6; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        bool Validate( const std::vector<uint8_t>& data ) const;
+        size_t DataSize( const vk::PipelineCache& from ) const;
+        vk::Pipeline CreateAndCount( const vk::PipelineCache& from, const std::function<vk::Pipeline()>& create );
+        bool Save() const;
+
+        vk::Device device;
+        vk::PhysicalDeviceProperties properties;
+        std::string path;
+        std::vector<uint8_t> initialData;
+        vk::PipelineCache cache;
+        bool loaded;
+
+        // merging needs the main cache externally synchronized
+        std::mutex cacheMutex;
+        std::atomic<uint32_t> hits;
+        std::atomic<uint32_t> misses;
+        std::atomic<uint64_t> creationNanoseconds;
+    };
+}
@@ -0,0 +1,366 @@
+#include "pipeline_manager.hpp"
+#include "tracer.hpp"
+#include "vulkan_helpers.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+    static constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+    //--------------------------------------------------------------------------
+    static void HashBytes( uint64_t& hash, const void* data, size_t size ) {
+        const uint8_t* bytes = static_cast<const uint8_t*>( data );
+        for ( size_t i = 0; i < size; ++i )
+            hash = ( hash ^ bytes[i] ) * kFnvPrime;
+    }
+
+    //--------------------------------------------------------------------------
+    template <typename T>
+    static void HashValue( uint64_t& hash, const T& value ) {
+        HashBytes( hash, &value, sizeof( value ) );
+    }
+
+    //--------------------------------------------------------------------------
+    static void HashCode( uint64_t& hash, const std::shared_ptr<const std::vector<uint32_t>>& code ) {
+        // the size first, so the end of one stage can't pass for the next one
+        const uint64_t size = code ? code->size() : 0;
+        HashValue( hash, size );
+        if ( size != 0 )
+            HashBytes( hash, code->data(), code->size() * sizeof( uint32_t ) );
+    }
+
+    //--------------------------------------------------------------------------
+    uint64_t HashPipelineDesc( const GraphicsPipelineDesc& desc ) {
+        // field by field, the structures have padding
+        uint64_t hash = kFnvOffset;
+        HashCode( hash, desc.vertexCode );
+        HashCode( hash, desc.fragmentCode );
+        HashValue( hash, ( uint64_t )desc.vertexConstants.size() );
+        HashBytes( hash, desc.vertexConstants.data(), desc.vertexConstants.size() * sizeof( uint32_t ) );
+        HashValue( hash, ( uint64_t )desc.bindings.size() );
+        for ( const vk::VertexInputBindingDescription& binding : desc.bindings ) {
+            HashValue( hash, binding.binding );
+            HashValue( hash, binding.stride );
+            HashValue( hash, binding.inputRate );
+        }
+        HashValue( hash, ( uint64_t )desc.attributes.size() );
+        for ( const vk::VertexInputAttributeDescription& attribute : desc.attributes ) {
+            HashValue( hash, attribute.location );
+            HashValue( hash, attribute.binding );
+            HashValue( hash, attribute.format );
+            HashValue( hash, attribute.offset );
+        }
+        HashValue( hash, desc.topology );
+        HashValue( hash, desc.blend );
+        HashValue( hash, static_cast<VkPipelineLayout>( desc.layout ) );
+        HashValue( hash, static_cast<VkRenderPass>( desc.renderPass ) );
+        HashValue( hash, desc.subpass );
+        return hash;
+    }
+
+    //--------------------------------------------------------------------------
+    static bool SameCode( const std::shared_ptr<const std::vector<uint32_t>>& a, const std::shared_ptr<const std::vector<uint32_t>>& b ) {
+        // null and empty hash the same, they compare the same
+        if ( a == b )
+            return true;
+        const size_t size = a ? a->size() : 0;
+        if ( size != ( b ? b->size() : 0 ) )
+            return false;
+        return size == 0 or std::equal( a->begin(), a->end(), b->begin() );
+    }
+
+    //--------------------------------------------------------------------------
+    bool SamePipelineDesc( const GraphicsPipelineDesc& a, const GraphicsPipelineDesc& b ) {
+        auto sameBinding = []( const vk::VertexInputBindingDescription & x, const vk::VertexInputBindingDescription & y ) {
+            return x.binding == y.binding and x.stride == y.stride and x.inputRate == y.inputRate;
+        };
+        auto sameAttribute = []( const vk::VertexInputAttributeDescription & x, const vk::VertexInputAttributeDescription & y ) {
+            return x.location == y.location and x.binding == y.binding and x.format == y.format and x.offset == y.offset;
+        };
+        return SameCode( a.vertexCode, b.vertexCode )
+               and SameCode( a.fragmentCode, b.fragmentCode )
+               and a.vertexConstants == b.vertexConstants
+               and std::equal( a.bindings.begin(), a.bindings.end(), b.bindings.begin(), b.bindings.end(), sameBinding )
+               and std::equal( a.attributes.begin(), a.attributes.end(), b.attributes.begin(), b.attributes.end(), sameAttribute )
+               and a.topology == b.topology
+               and a.blend == b.blend
+               and a.layout == b.layout
+               and a.renderPass == b.renderPass
+               and a.subpass == b.subpass;
+    }
+
+    //--------------------------------------------------------------------------
+    bool PipelineHandle::Ready() const {
+        return entry and entry->state.load( std::memory_order_acquire ) == State::eReady;
+    }
+
+    //--------------------------------------------------------------------------
+    bool PipelineHandle::Failed() const {
+        return entry and entry->state.load( std::memory_order_acquire ) == State::eFailed;
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PipelineHandle::Get() const {
+        return Ready() ? entry->pipeline.Get() : vk::Pipeline();
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PipelineHandle::Wait() const {
+        if ( not entry )
+            return vk::Pipeline();
+        std::unique_lock<std::mutex> lock( entry->mutex );
+        entry->done.wait( lock, [this] { return entry->state.load( std::memory_order_acquire ) != State::ePending; } );
+        if ( entry->failure )
+            std::rethrow_exception( entry->failure );
+        return Get();
+    }
+
+    //--------------------------------------------------------------------------
+    PipelineManager::PipelineManager()
+        : compiling( 0 )
+        , stopping( false )
+        , requests( 0 )
+        , deduplicated( 0 )
+        , failures( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    PipelineManager::~PipelineManager() {
+        assert( workers.empty() );
+    }
+
+    //--------------------------------------------------------------------------
+    void PipelineManager::Init( std::shared_ptr<VulkanContext> context, uint32_t workerCount ) {
+        assert( workers.empty() and workerCount != 0 );
+        this->context = context;
+        stopping = false;
+
+        // one cache per worker, merged back into the persistent one at DeInit
+        for ( uint32_t i = 0; i < workerCount; ++i )
+            workerCaches.push_back( context->PipelineCache().CreateWorkerCache() );
+        for ( uint32_t i = 0; i < workerCount; ++i )
+            workers.emplace_back( &PipelineManager::WorkerLoop, this, i );
+    }
+
+    //--------------------------------------------------------------------------
+    void PipelineManager::DeInit() {
+        std::deque<std::shared_ptr<Entry>> dropped;
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+            dropped.swap( queue );
+        }
+        wake.notify_all();
+        for ( std::thread& worker : workers )
+            worker.join();
+        workers.clear();
+
+        // nobody waits forever on a variant that will never be built
+        for ( const std::shared_ptr<Entry>& entry : dropped )
+            Finish( *entry, State::eFailed );
+
+        for ( const vk::PipelineCache& workerCache : workerCaches )
+            context->PipelineCache().MergeWorkerCache( workerCache );
+        workerCaches.clear();
+
+        // handles still around see a null pipeline from now on
+        for ( auto& variant : variants ) {
+            Entry& entry = *variant.second;
+            std::lock_guard<std::mutex> lock( entry.mutex );
+            entry.state.store( State::eFailed, std::memory_order_release );
+            entry.pipeline.Reset();
+        }
+        variants.clear();
+
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    PipelineHandle PipelineManager::Request( const GraphicsPipelineDesc& desc ) {
+        // hashing the code, and comparing it on a hit, is all the calling
+        // thread pays
+        const uint64_t key = HashPipelineDesc( desc );
+
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            ++requests;
+            // the descs stay as requested, workers only read them
+            const auto range = variants.equal_range( key );
+            for ( auto found = range.first; found != range.second; ++found ) {
+                if ( SamePipelineDesc( found->second->desc, desc ) ) {
+                    ++deduplicated;
+                    return PipelineHandle( found->second );
+                }
+            }
+
+            entry = std::make_shared<Entry>();
+            entry->key = key;
+            entry->desc = desc;
+            entry->requested = std::chrono::steady_clock::now();
+            variants.emplace( key, entry );
+            queue.push_back( entry );
+        }
+        wake.notify_one();
+        return PipelineHandle( entry );
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t PipelineManager::PendingCount() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return ( uint32_t )queue.size() + compiling;
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t PipelineManager::VariantCount() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return ( uint32_t )variants.size();
+    }
+
+    //--------------------------------------------------------------------------
+    void PipelineManager::WorkerLoop( uint32_t worker ) {
+        TRACE_THREAD_NAME( "pipeline worker" );
+        const vk::PipelineCache workerCache = workerCaches[worker];
+        for ( ;; ) {
+            std::shared_ptr<Entry> entry;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wake.wait( lock, [this] { return stopping or not queue.empty(); } );
+                if ( stopping )
+                    return;
+                entry = queue.front();
+                queue.pop_front();
+                ++compiling;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            State state = State::eReady;
+            try {
+                TRACE_SCOPE( "compile pipeline" );
+                entry->pipeline = UniquePipeline( context->Device(), Build( entry->desc, workerCache ) );
+            } catch ( const std::exception& exception ) {
+                std::cerr << "Pipeline variant " << std::hex << entry->key << std::dec << " failed: " << exception.what() << std::endl;
+                entry->failure = std::current_exception();
+                state = State::eFailed;
+            }
+            const auto end = std::chrono::steady_clock::now();
+            Finish( *entry, state );
+
+            std::lock_guard<std::mutex> lock( mutex );
+            --compiling;
+            if ( state == State::eFailed )
+                ++failures;
+            else {
+                compileStats.AddSample( std::chrono::duration<double, std::milli>( end - start ).count() );
+                latencyStats.AddSample( std::chrono::duration<double, std::milli>( end - entry->requested ).count() );
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    vk::Pipeline PipelineManager::Build( const GraphicsPipelineDesc& desc, const vk::PipelineCache& workerCache ) {
+        const vk::Device& device = context->Device();
+
+        // only needed until the pipeline is built
+        const UniqueShaderModule vertexShader( device, CreateShaderModule( device, *desc.vertexCode ) );
+        const UniqueShaderModule fragmentShader( device, CreateShaderModule( device, *desc.fragmentCode ) );
+
+        std::vector<vk::SpecializationMapEntry> specializationEntries;
+        for ( uint32_t i = 0; i < desc.vertexConstants.size(); ++i )
+            specializationEntries.emplace_back( i, i * ( uint32_t )sizeof( uint32_t ), sizeof( uint32_t ) );
+        const vk::SpecializationInfo specialization( ( uint32_t )specializationEntries.size(), specializationEntries.data(),
+                desc.vertexConstants.size() * sizeof( uint32_t ), desc.vertexConstants.data() );
+        const std::array<vk::PipelineShaderStageCreateInfo, 2> stages = {
+            vk::PipelineShaderStageCreateInfo()
+            .setStage( vk::ShaderStageFlagBits::eVertex )
+            .setModule( vertexShader )
+            .setPName( "main" )
+            .setPSpecializationInfo( desc.vertexConstants.empty() ? nullptr : &specialization ),
+            vk::PipelineShaderStageCreateInfo()
+            .setStage( vk::ShaderStageFlagBits::eFragment )
+            .setModule( fragmentShader )
+            .setPName( "main" )
+        };
+
+        vk::PipelineVertexInputStateCreateInfo vertexInput = vk::PipelineVertexInputStateCreateInfo()
+                .setVertexBindingDescriptionCount( ( uint32_t )desc.bindings.size() )
+                .setPVertexBindingDescriptions( desc.bindings.data() )
+                .setVertexAttributeDescriptionCount( ( uint32_t )desc.attributes.size() )
+                .setPVertexAttributeDescriptions( desc.attributes.data() );
+        vk::PipelineInputAssemblyStateCreateInfo inputAssembly = vk::PipelineInputAssemblyStateCreateInfo()
+                .setTopology( desc.topology );
+
+        // viewport and scissor are dynamic so the pipeline survives resizes
+        vk::PipelineViewportStateCreateInfo viewport = vk::PipelineViewportStateCreateInfo()
+                .setViewportCount( 1 )
+                .setScissorCount( 1 );
+        const std::array<vk::DynamicState, 2> dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo dynamicState = vk::PipelineDynamicStateCreateInfo()
+                .setDynamicStateCount( ( uint32_t )dynamicStates.size() )
+                .setPDynamicStates( dynamicStates.data() );
+
+        vk::PipelineRasterizationStateCreateInfo rasterization = vk::PipelineRasterizationStateCreateInfo()
+                .setPolygonMode( vk::PolygonMode::eFill )
+                .setCullMode( vk::CullModeFlagBits::eNone )
+                .setFrontFace( vk::FrontFace::eCounterClockwise )
+                .setLineWidth( 1.f );
+        vk::PipelineMultisampleStateCreateInfo multisample = vk::PipelineMultisampleStateCreateInfo()
+                .setRasterizationSamples( vk::SampleCountFlagBits::e1 );
+
+        vk::PipelineColorBlendAttachmentState blendAttachment = vk::PipelineColorBlendAttachmentState()
+                .setColorWriteMask( vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+                                    vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA );
+        if ( desc.blend == BlendMode::eAdditive ) {
+            blendAttachment.setBlendEnable( true )
+            .setSrcColorBlendFactor( vk::BlendFactor::eOne )
+            .setDstColorBlendFactor( vk::BlendFactor::eOne )
+            .setColorBlendOp( vk::BlendOp::eAdd )
+            .setSrcAlphaBlendFactor( vk::BlendFactor::eZero )
+            .setDstAlphaBlendFactor( vk::BlendFactor::eOne )
+            .setAlphaBlendOp( vk::BlendOp::eAdd );
+        }
+        vk::PipelineColorBlendStateCreateInfo colorBlend = vk::PipelineColorBlendStateCreateInfo()
+                .setAttachmentCount( 1 )
+                .setPAttachments( &blendAttachment );
+
+        vk::GraphicsPipelineCreateInfo createInfo = vk::GraphicsPipelineCreateInfo()
+                .setStageCount( ( uint32_t )stages.size() )
+                .setPStages( stages.data() )
+                .setPVertexInputState( &vertexInput )
+                .setPInputAssemblyState( &inputAssembly )
+                .setPViewportState( &viewport )
+                .setPRasterizationState( &rasterization )
+                .setPMultisampleState( &multisample )
+                .setPColorBlendState( &colorBlend )
+                .setPDynamicState( &dynamicState )
+                .setLayout( desc.layout )
+                .setRenderPass( desc.renderPass )
+                .setSubpass( desc.subpass );
+        return context->PipelineCache().CreateGraphicsPipeline( createInfo, workerCache );
+    }
+
+    //--------------------------------------------------------------------------
+    void PipelineManager::Finish( Entry& entry, State state ) {
+        {
+            std::lock_guard<std::mutex> lock( entry.mutex );
+            entry.state.store( state, std::memory_order_release );
+        }
+        entry.done.notify_all();
+    }
+
+    //--------------------------------------------------------------------------
+    void PipelineManager::PrintStats( std::ostream& stream ) const {
+        std::lock_guard<std::mutex> lock( mutex );
+        stream << "Pipeline variants: " << variants.size() << " from " << requests << " request(s), "
+               << deduplicated << " deduplicated, " << failures << " failed";
+        if ( compileStats.Count() != 0 )
+            stream << ", compile avg " << compileStats.Average() << " / max " << compileStats.Max()
+                   << " ms, request to ready avg " << latencyStats.Average() << " / max " << latencyStats.Max() << " ms";
+        stream << std::endl;
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "frame_stats.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_handles.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    enum class BlendMode {
+        eOpaque,
+        eAdditive
+    };
+
+    //--------------------------------------------------------------------------
+    // Everything a graphics pipeline variant is built from, by value so it can
+    // be compiled on another thread once the caller moved on. Viewport and
+    // scissor are always dynamic.
+    struct GraphicsPipelineDesc {
+        std::shared_ptr<const std::vector<uint32_t>> vertexCode;
+        std::shared_ptr<const std::vector<uint32_t>> fragmentCode;
+        // vertex stage specialization, constant i is vertexConstants[i]
+        std::vector<uint32_t> vertexConstants;
+        std::vector<vk::VertexInputBindingDescription> bindings;
+        std::vector<vk::VertexInputAttributeDescription> attributes;
+        vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+        BlendMode blend = BlendMode::eOpaque;
+        // must outlive the manager
+        vk::PipelineLayout layout;
+        vk::RenderPass renderPass;
+        uint32_t subpass = 0;
+    };
+
+    // of the shader code and of the state, what variants are keyed by
+    uint64_t HashPipelineDesc( const GraphicsPipelineDesc& desc );
+    // over the same fields as the hash, what tells variants with the same key apart
+    bool SamePipelineDesc( const GraphicsPipelineDesc& a, const GraphicsPipelineDesc& b );
+
+    //--------------------------------------------------------------------------
+    // Shared by every request of the same variant. Get never blocks: it's a
+    // null pipeline until a worker built it, and stays null when that failed.
+    class PipelineHandle {
+      public:
+        PipelineHandle() = default;
+
+        explicit operator bool() const { return !!entry; }
+        bool Ready() const;
+        bool Failed() const;
+        vk::Pipeline Get() const;
+        // blocks until the variant is built, rethrows what failed it
+        vk::Pipeline Wait() const;
+
+      private:
+        friend class PipelineManager;
+
+        enum class State {
+            ePending,
+            eReady,
+            eFailed
+        };
+
+        struct Entry {
+            uint64_t key = 0;
+            GraphicsPipelineDesc desc;
+            std::chrono::steady_clock::time_point requested;
+            std::atomic<State> state{ State::ePending };
+            // written before state turns eReady, read after
+            UniquePipeline pipeline;
+            std::exception_ptr failure;
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+
+        explicit PipelineHandle( std::shared_ptr<Entry> entry )
+            : entry( std::move( entry ) ) {
+        }
+
+        std::shared_ptr<Entry> entry;
+    };
+
+    //--------------------------------------------------------------------------
+    // Compiles graphics pipeline variants on its own worker threads, each with
+    // a worker cache of the persistent pipeline cache, so the thread asking
+    // for one never waits on the driver. Requests for a variant already built
+    // or in flight get the same handle back; callers draw with a fallback, or
+    // skip the draw, until it's ready. The manager owns every pipeline it
+    // built until DeInit.
+    class PipelineManager {
+      public:
+        PipelineManager();
+        ~PipelineManager();
+
+        void Init( std::shared_ptr<VulkanContext> context, uint32_t workerCount );
+        // once the device is idle: requests not started yet are dropped as
+        // failed, the ones being compiled are waited on
+        void DeInit();
+
+        PipelineHandle Request( const GraphicsPipelineDesc& desc );
+
+        // queued or being compiled
+        uint32_t PendingCount() const;
+        uint32_t VariantCount() const;
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        using Entry = PipelineHandle::Entry;
+        using State = PipelineHandle::State;
+
+        void WorkerLoop( uint32_t worker );
+        vk::Pipeline Build( const GraphicsPipelineDesc& desc, const vk::PipelineCache& workerCache );
+        void Finish( Entry& entry, State state );
+
+        std::shared_ptr<VulkanContext> context;
+        std::vector<std::thread> workers;
+        std::vector<vk::PipelineCache> workerCaches;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::shared_ptr<Entry>> queue;
+        // by hash, a collision is one more variant under the same key
+        std::unordered_multimap<uint64_t, std::shared_ptr<Entry>> variants;
+        uint32_t compiling;
+        bool stopping;
+
+        uint64_t requests;
+        // answered with an existing variant, built or in flight
+        uint64_t deduplicated;
+        uint32_t failures;
+        FrameStats compileStats;
+        // request to ready, queueing included
+        FrameStats latencyStats;
+    };
+}
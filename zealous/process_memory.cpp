@@ -0,0 +1,32 @@
+#include "process_memory.hpp"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    uint64_t PeakResidentBytes() {
+#if defined( _WIN32 )
+        PROCESS_MEMORY_COUNTERS counters;
+        if ( not GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+            return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage;
+        if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+            return 0;
+#if defined( __APPLE__ )
+        return ( uint64_t )usage.ru_maxrss;
+#else
+        // kilobytes on Linux
+        return ( uint64_t )usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+}
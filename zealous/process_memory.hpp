@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+namespace zealous {
+    // high water mark of the process resident memory, 0 when unknown
+    uint64_t PeakResidentBytes();
+}
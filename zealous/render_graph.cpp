@@ -0,0 +1,501 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <ostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    struct AccessInfo {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        // images only
+        vk::ImageLayout layout;
+    };
+
+    //--------------------------------------------------------------------------
+    static const std::array<AccessInfo, ( size_t )Access::eCount> kAccessInfo = { {
+            { vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, vk::ImageLayout::eUndefined },
+            { vk::PipelineStageFlagBits::eVertexShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal },
+            { vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal },
+            { vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eGeneral },
+            { vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral },
+            { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal },
+            { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal },
+            {
+                vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                vk::ImageLayout::eColorAttachmentOptimal
+            },
+            // the present semaphore takes care of the memory dependency
+            { vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlags(), vk::ImageLayout::ePresentSrcKHR }
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    static const vk::AccessFlags kWriteAccess = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite |
+            vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+            vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eMemoryWrite;
+
+    //--------------------------------------------------------------------------
+    static vk::DeviceSize AlignUp( vk::DeviceSize value, vk::DeviceSize alignment ) {
+        return ( value + alignment - 1 ) / alignment * alignment;
+    }
+
+    //--------------------------------------------------------------------------
+    bool TransientImageDesc::operator==( const TransientImageDesc& other ) const {
+        return format == other.format and extent == other.extent and usage == other.usage and aspect == other.aspect;
+    }
+
+    //--------------------------------------------------------------------------
+    bool RenderGraph::Placement::operator==( const Placement& other ) const {
+        return desc == other.desc and memoryTypeBits == other.memoryTypeBits and offset == other.offset;
+    }
+
+    //--------------------------------------------------------------------------
+    RenderGraph::RenderGraph()
+        : frameIndex( 0 )
+        , culledPasses( 0 )
+        , barrierBatches( 0 )
+        , imageBarriers( 0 )
+        , transientBytes( 0 )
+        , aliasedBytes( 0 )
+        , peakTransientBytes( 0 )
+        , peakAliasedBytes( 0 )
+        , compileCount( 0 )
+        , totalCulledPasses( 0 )
+        , totalBarrierBatches( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Init( std::shared_ptr<VulkanContext> context ) {
+        this->context = context;
+        frames.resize( context->FramesInFlight() );
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::DeInit() {
+        MemoryAllocator& allocator = context->Allocator();
+        for ( FrameMemory& frameMemory : frames ) {
+            frameMemory.views.clear();
+            frameMemory.images.clear();
+            for ( Allocation& allocation : frameMemory.allocations )
+                allocator.Free( allocation );
+        }
+        frames.clear();
+        resources.clear();
+        passes.clear();
+        knownRequirements.clear();
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Begin( uint32_t frameIndex ) {
+        this->frameIndex = frameIndex;
+        resources.clear();
+        passes.clear();
+        finalBatch = Pass();
+    }
+
+    //--------------------------------------------------------------------------
+    RenderGraph::ResourceId RenderGraph::ImportBuffer( const char* name, const vk::Buffer& buffer ) {
+        Resource resource;
+        resource.name = name;
+        resource.buffer = buffer;
+        resources.push_back( resource );
+        return ( ResourceId )resources.size() - 1;
+    }
+
+    //--------------------------------------------------------------------------
+    RenderGraph::ResourceId RenderGraph::ImportImage( const char* name, const vk::Image& image, const vk::ImageSubresourceRange& range,
+            const ResourceState& initial ) {
+        // whatever came before is a write still to wait for
+        Resource resource;
+        resource.name = name;
+        resource.image = image;
+        resource.range = range;
+        resource.tracked.writeStages = initial.stages;
+        resource.tracked.writeAccess = initial.access;
+        resource.tracked.layout = initial.layout;
+        resources.push_back( resource );
+        return ( ResourceId )resources.size() - 1;
+    }
+
+    //--------------------------------------------------------------------------
+    RenderGraph::ResourceId RenderGraph::CreateImage( const char* name, const TransientImageDesc& desc ) {
+        Resource resource;
+        resource.name = name;
+        resource.range = vk::ImageSubresourceRange( desc.aspect, 0, 1, 0, 1 );
+        resource.isTransient = true;
+        resource.desc = desc;
+        resources.push_back( resource );
+        return ( ResourceId )resources.size() - 1;
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Export( ResourceId resource, Access finalAccess ) {
+        resources[resource].finalAccess = finalAccess;
+    }
+
+    //--------------------------------------------------------------------------
+    RenderGraph::PassId RenderGraph::AddPass( const char* name, PassFunction execute, bool sideEffects ) {
+        Pass pass;
+        pass.name = name;
+        pass.execute = std::move( execute );
+        pass.sideEffects = sideEffects;
+        passes.push_back( std::move( pass ) );
+        return ( PassId )passes.size() - 1;
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Use( PassId pass, ResourceId resource, Access access ) {
+        // once per pass, with the access covering everything it does with it
+        std::vector<ResourceUse>& uses = passes[pass].uses;
+        assert( std::none_of( uses.begin(), uses.end(), [resource]( const ResourceUse & use ) { return use.resource == resource; } ) );
+        uses.push_back( { resource, access } );
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Compile() {
+        Cull();
+        PlaceTransients();
+        DeriveBarriers();
+
+        ++compileCount;
+        totalCulledPasses += culledPasses;
+        totalBarrierBatches += barrierBatches;
+        peakTransientBytes = std::max( peakTransientBytes, transientBytes );
+        peakAliasedBytes = std::max( peakAliasedBytes, aliasedBytes );
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Cull() {
+        // backwards from the exported resources: a pass is needed when it has
+        // side effects or writes something a later needed pass uses; then all
+        // it uses is needed, writes included as they may be partial
+        std::vector<bool> needed( resources.size(), false );
+        for ( size_t i = 0; i < resources.size(); ++i )
+            needed[i] = resources[i].finalAccess != Access::eCount;
+
+        culledPasses = 0;
+        for ( size_t i = passes.size(); i-- > 0; ) {
+            Pass& pass = passes[i];
+            pass.alive = pass.sideEffects;
+            for ( const ResourceUse& use : pass.uses ) {
+                if ( needed[use.resource] and ( kAccessInfo[( size_t )use.access].access & kWriteAccess ) )
+                    pass.alive = true;
+            }
+            if ( not pass.alive ) {
+                ++culledPasses;
+                continue;
+            }
+            for ( const ResourceUse& use : pass.uses )
+                needed[use.resource] = true;
+        }
+
+        for ( uint32_t i = 0; i < passes.size(); ++i ) {
+            if ( not passes[i].alive )
+                continue;
+            for ( const ResourceUse& use : passes[i].uses ) {
+                Resource& resource = resources[use.resource];
+                if ( resource.firstPass == kNone )
+                    resource.firstPass = i;
+                resource.lastPass = i;
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    vk::MemoryRequirements RenderGraph::Requirements( const TransientImageDesc& desc ) {
+        for ( const auto& known : knownRequirements ) {
+            if ( known.first == desc )
+                return known.second;
+        }
+
+        const vk::Device& device = context->Device();
+        vk::ImageCreateInfo createInfo = vk::ImageCreateInfo()
+                                         .setImageType( vk::ImageType::e2D )
+                                         .setFormat( desc.format )
+                                         .setExtent( vk::Extent3D( desc.extent.width, desc.extent.height, 1 ) )
+                                         .setMipLevels( 1 )
+                                         .setArrayLayers( 1 )
+                                         .setSamples( vk::SampleCountFlagBits::e1 )
+                                         .setTiling( vk::ImageTiling::eOptimal )
+                                         .setUsage( desc.usage )
+                                         .setSharingMode( vk::SharingMode::eExclusive )
+                                         .setInitialLayout( vk::ImageLayout::eUndefined );
+        const UniqueImage image( device, device.createImage( createInfo ) );
+        knownRequirements.emplace_back( desc, device.getImageMemoryRequirements( image ) );
+        return knownRequirements.back().second;
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::PlaceTransients() {
+        // by first use, each image takes over the smallest region whose last
+        // occupant is done by then, or gets a new one at the end of its group
+        std::vector<ResourceId> order;
+        for ( ResourceId id = 0; id < resources.size(); ++id ) {
+            if ( resources[id].isTransient and resources[id].firstPass != kNone )
+                order.push_back( id );
+        }
+        std::stable_sort( order.begin(), order.end(), [this]( ResourceId a, ResourceId b ) {
+            return resources[a].firstPass < resources[b].firstPass;
+        } );
+
+        struct Region {
+            uint32_t group;
+            vk::DeviceSize offset;
+            vk::DeviceSize size;
+            ResourceId occupant;
+        };
+        std::vector<Region> regions;
+        std::vector<uint32_t> groupTypeBits;
+        std::vector<vk::DeviceSize> groupSizes;
+        std::vector<vk::DeviceSize> groupAlignments;
+        std::vector<Placement> placements;
+        transientBytes = 0;
+
+        for ( ResourceId id : order ) {
+            Resource& resource = resources[id];
+            const vk::MemoryRequirements requirements = Requirements( resource.desc );
+            transientBytes += requirements.size;
+
+            auto group = std::find( groupTypeBits.begin(), groupTypeBits.end(), requirements.memoryTypeBits );
+            if ( group == groupTypeBits.end() ) {
+                groupTypeBits.push_back( requirements.memoryTypeBits );
+                groupSizes.push_back( 0 );
+                groupAlignments.push_back( 1 );
+                group = groupTypeBits.end() - 1;
+            }
+            const uint32_t groupIndex = uint32_t( group - groupTypeBits.begin() );
+            groupAlignments[groupIndex] = std::max( groupAlignments[groupIndex], requirements.alignment );
+
+            Region* best = nullptr;
+            for ( Region& region : regions ) {
+                const bool fits = region.group == groupIndex and region.size >= requirements.size and
+                                  region.offset % requirements.alignment == 0;
+                if ( fits and resources[region.occupant].lastPass < resource.firstPass and
+                        ( best == nullptr or region.size < best->size ) )
+                    best = &region;
+            }
+
+            vk::DeviceSize offset;
+            if ( best != nullptr ) {
+                resource.aliasOf = best->occupant;
+                best->occupant = id;
+                offset = best->offset;
+            } else {
+                offset = AlignUp( groupSizes[groupIndex], requirements.alignment );
+                regions.push_back( { groupIndex, offset, requirements.size, id } );
+                groupSizes[groupIndex] = offset + requirements.size;
+            }
+
+            resource.placement = ( uint32_t )placements.size();
+            placements.push_back( { resource.desc, requirements.memoryTypeBits, offset } );
+        }
+
+        aliasedBytes = 0;
+        for ( vk::DeviceSize size : groupSizes )
+            aliasedBytes += size;
+
+        // same placement as last time in this frame slot, the images are reused
+        FrameMemory& frameMemory = frames[frameIndex];
+        if ( placements != frameMemory.placements ) {
+            ReleaseFrameMemory( frameMemory );
+            BuildFrameMemory( frameMemory, std::move( placements ), groupTypeBits, groupSizes, groupAlignments );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::BuildFrameMemory( FrameMemory& frameMemory, std::vector<Placement>&& placements,
+                                        const std::vector<uint32_t>& groupTypeBits, const std::vector<vk::DeviceSize>& groupSizes,
+                                        const std::vector<vk::DeviceSize>& groupAlignments ) {
+        const vk::Device& device = context->Device();
+        MemoryAllocator& allocator = context->Allocator();
+
+        const MemoryUsage deviceLocal = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+        for ( size_t i = 0; i < groupTypeBits.size(); ++i ) {
+            vk::MemoryRequirements requirements;
+            requirements.size = groupSizes[i];
+            requirements.alignment = groupAlignments[i];
+            requirements.memoryTypeBits = groupTypeBits[i];
+            frameMemory.allocations.push_back( allocator.Allocate( requirements, deviceLocal, ResourceKind::eOptimal ) );
+        }
+
+        for ( const Placement& placement : placements ) {
+            const TransientImageDesc& desc = placement.desc;
+            vk::ImageCreateInfo createInfo = vk::ImageCreateInfo()
+                                             .setImageType( vk::ImageType::e2D )
+                                             .setFormat( desc.format )
+                                             .setExtent( vk::Extent3D( desc.extent.width, desc.extent.height, 1 ) )
+                                             .setMipLevels( 1 )
+                                             .setArrayLayers( 1 )
+                                             .setSamples( vk::SampleCountFlagBits::e1 )
+                                             .setTiling( vk::ImageTiling::eOptimal )
+                                             .setUsage( desc.usage )
+                                             .setSharingMode( vk::SharingMode::eExclusive )
+                                             .setInitialLayout( vk::ImageLayout::eUndefined );
+            UniqueImage image( device, device.createImage( createInfo ) );
+
+            const size_t group = std::find( groupTypeBits.begin(), groupTypeBits.end(), placement.memoryTypeBits ) - groupTypeBits.begin();
+            const Allocation& allocation = frameMemory.allocations[group];
+            device.bindImageMemory( image, allocation.memory, allocation.offset + placement.offset );
+
+            vk::ImageViewCreateInfo viewInfo = vk::ImageViewCreateInfo()
+                                               .setImage( image )
+                                               .setViewType( vk::ImageViewType::e2D )
+                                               .setFormat( desc.format )
+                                               .setSubresourceRange( vk::ImageSubresourceRange( desc.aspect, 0, 1, 0, 1 ) );
+            frameMemory.views.emplace_back( device, device.createImageView( viewInfo ) );
+            frameMemory.images.push_back( std::move( image ) );
+        }
+        frameMemory.placements = std::move( placements );
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::ReleaseFrameMemory( FrameMemory& frameMemory ) {
+        // retired like anything a recording may still point at
+        DeletionQueue& deletions = context->Deletions();
+        const uint64_t serial = context->SubmittedFrameSerial();
+        for ( UniqueImageView& view : frameMemory.views )
+            deletions.Retire( std::move( view ), serial );
+        for ( UniqueImage& image : frameMemory.images )
+            deletions.Retire( std::move( image ), serial );
+        for ( Allocation& allocation : frameMemory.allocations )
+            deletions.Retire( context->Allocator(), std::move( allocation ), serial );
+        frameMemory = FrameMemory();
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::DeriveBarriers() {
+        // transient images point at this frame slot's memory from now on
+        FrameMemory& frameMemory = frames[frameIndex];
+        for ( Resource& resource : resources ) {
+            if ( resource.placement != kNone )
+                resource.image = frameMemory.images[resource.placement];
+        }
+
+        barrierBatches = 0;
+        imageBarriers = 0;
+        for ( uint32_t i = 0; i < passes.size(); ++i ) {
+            Pass& pass = passes[i];
+            if ( not pass.alive )
+                continue;
+            for ( const ResourceUse& use : pass.uses ) {
+                Resource& resource = resources[use.resource];
+                // the memory comes with whatever its previous occupant left
+                // in flight, never with its content
+                if ( resource.firstPass == i and resource.aliasOf != kNone ) {
+                    const Tracked& previous = resources[resource.aliasOf].tracked;
+                    resource.tracked.writeStages = previous.writeStages | previous.readStages;
+                    resource.tracked.writeAccess = previous.writeAccess;
+                }
+                Transition( pass, resource, use.access );
+            }
+            if ( pass.srcStages ) {
+                ++barrierBatches;
+                imageBarriers += ( uint32_t )pass.imageBarriers.size();
+            }
+        }
+
+        for ( Resource& resource : resources ) {
+            if ( resource.finalAccess != Access::eCount )
+                Transition( finalBatch, resource, resource.finalAccess );
+        }
+        if ( finalBatch.srcStages ) {
+            ++barrierBatches;
+            imageBarriers += ( uint32_t )finalBatch.imageBarriers.size();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Transition( Pass& batch, Resource& resource, Access access ) {
+        const AccessInfo& info = kAccessInfo[( size_t )access];
+        Tracked& tracked = resource.tracked;
+        const vk::AccessFlags writeAccess = info.access & kWriteAccess;
+        const bool layoutChange = resource.image and info.layout != tracked.layout;
+
+        // read after write only waits when the write is not visible to this
+        // stage and access yet, read after read never does; anything else
+        // waits for the last write and the reads since
+        vk::PipelineStageFlags srcStages;
+        if ( layoutChange or writeAccess )
+            srcStages = tracked.writeStages | tracked.readStages;
+        else if ( ( info.stages & ~tracked.visibleStages ) or ( info.access & ~tracked.visibleAccess ) )
+            srcStages = tracked.writeStages;
+
+        if ( srcStages or layoutChange ) {
+            batch.srcStages |= srcStages ? srcStages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eTopOfPipe );
+            batch.dstStages |= info.stages;
+            if ( layoutChange ) {
+                batch.imageBarriers.push_back( vk::ImageMemoryBarrier()
+                                               .setSrcAccessMask( tracked.writeAccess )
+                                               .setDstAccessMask( info.access )
+                                               .setOldLayout( tracked.layout )
+                                               .setNewLayout( info.layout )
+                                               .setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                               .setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                               .setImage( resource.image )
+                                               .setSubresourceRange( resource.range ) );
+            } else if ( tracked.writeAccess ) {
+                batch.memoryBarrier.srcAccessMask |= tracked.writeAccess;
+                batch.memoryBarrier.dstAccessMask |= info.access;
+            }
+        }
+
+        // a layout transition is a write the barrier made visible to this use
+        if ( writeAccess or layoutChange ) {
+            tracked.writeStages = info.stages;
+            tracked.writeAccess = writeAccess;
+            tracked.visibleStages = writeAccess ? vk::PipelineStageFlags() : info.stages;
+            tracked.visibleAccess = writeAccess ? vk::AccessFlags() : info.access;
+            tracked.readStages = writeAccess ? vk::PipelineStageFlags() : info.stages;
+        } else {
+            tracked.visibleStages |= info.stages;
+            tracked.visibleAccess |= info.access;
+            tracked.readStages |= info.stages;
+        }
+        if ( resource.image )
+            tracked.layout = info.layout;
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::RecordBatch( const vk::CommandBuffer& commandBuffer, const Pass& batch ) {
+        if ( not batch.srcStages )
+            return;
+        commandBuffer.pipelineBarrier( batch.srcStages, batch.dstStages, vk::DependencyFlags(),
+                                       batch.memoryBarrier, nullptr, batch.imageBarriers );
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::Execute( const vk::CommandBuffer& commandBuffer ) {
+        for ( const Pass& pass : passes ) {
+            if ( not pass.alive )
+                continue;
+            RecordBatch( commandBuffer, pass );
+            pass.execute( commandBuffer );
+        }
+        RecordBatch( commandBuffer, finalBatch );
+    }
+
+    //--------------------------------------------------------------------------
+    const vk::Image& RenderGraph::Image( ResourceId resource ) const {
+        return frames[frameIndex].images[resources[resource].placement].Get();
+    }
+
+    //--------------------------------------------------------------------------
+    const vk::ImageView& RenderGraph::ImageView( ResourceId resource ) const {
+        return frames[frameIndex].views[resources[resource].placement].Get();
+    }
+
+    //--------------------------------------------------------------------------
+    void RenderGraph::PrintStats( std::ostream& stream ) const {
+        if ( compileCount == 0 ) {
+            stream << "Render graph     : never compiled" << std::endl;
+            return;
+        }
+        stream << "Render graph     : " << passes.size() << " passes, culled avg " << double( totalCulledPasses ) / compileCount
+               << ", barrier batches avg " << double( totalBarrierBatches ) / compileCount
+               << ", transient peak " << peakTransientBytes / 1024 << " KiB in " << peakAliasedBytes / 1024 << " KiB" << std::endl;
+    }
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include "vulkan_context.hpp"
+#include "vulkan_handles.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // How a pass uses a resource, each one a fixed stage, access and layout
+    enum class Access {
+        eIndirectRead,
+        eVertexShaderRead,      // storage buffer
+        eFragmentShaderRead,    // sampled image
+        eComputeRead,
+        eComputeWrite,          // reads too
+        eTransferRead,
+        eTransferWrite,
+        eColorAttachmentWrite,
+        ePresent,
+        eCount
+    };
+
+    //--------------------------------------------------------------------------
+    // what a resource went through before the graph, for imported images
+    struct ResourceState {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    };
+
+    //--------------------------------------------------------------------------
+    struct TransientImageDesc {
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        vk::ImageUsageFlags usage;
+        vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+
+        bool operator==( const TransientImageDesc& other ) const;
+        bool operator!=( const TransientImageDesc& other ) const { return not ( *this == other ); }
+    };
+
+    //--------------------------------------------------------------------------
+    // The GPU work of a frame as passes declaring the resources they use, in
+    // submission order. Compile drops the passes nothing needs, derives the
+    // barriers and layout transitions between the others, batched into one
+    // pipelineBarrier ahead of each pass, and places the transient images of
+    // the frame slot so the ones never alive at the same time share memory.
+    // Rebuilt every frame; the transient images are kept as long as their
+    // placement doesn't change. Passes only record what happens inside them.
+    class RenderGraph {
+      public:
+        using ResourceId = uint32_t;
+        using PassId = uint32_t;
+        using PassFunction = std::function<void( const vk::CommandBuffer& commandBuffer )>;
+
+        RenderGraph();
+
+        void Init( std::shared_ptr<VulkanContext> context );
+        // once the device is idle
+        void DeInit();
+
+        // after the wait on the frame fence, clears the previous graph
+        void Begin( uint32_t frameIndex );
+
+        // nothing is pending on imported buffers: what earlier frames did
+        // with them is behind their fence, or a semaphore
+        ResourceId ImportBuffer( const char* name, const vk::Buffer& buffer );
+        ResourceId ImportImage( const char* name, const vk::Image& image, const vk::ImageSubresourceRange& range,
+                                const ResourceState& initial );
+        // content undefined at its first use, valid until its last one
+        ResourceId CreateImage( const char* name, const TransientImageDesc& desc );
+        // the resource outlives the graph: passes writing it are kept, and it's
+        // left as finalAccess expects it
+        void Export( ResourceId resource, Access finalAccess );
+
+        // side effects keep the pass even when nothing reads what it writes
+        PassId AddPass( const char* name, PassFunction execute, bool sideEffects = false );
+        void Use( PassId pass, ResourceId resource, Access access );
+
+        void Compile();
+        void Execute( const vk::CommandBuffer& commandBuffer );
+
+        // transient images, once compiled
+        const vk::Image& Image( ResourceId resource ) const;
+        const vk::ImageView& ImageView( ResourceId resource ) const;
+
+        uint32_t PassCount() const { return ( uint32_t )passes.size(); }
+        uint32_t CulledPassCount() const { return culledPasses; }
+        void PrintStats( std::ostream& stream ) const;
+
+      private:
+        static constexpr uint32_t kNone = uint32_t( -1 );
+
+        struct ResourceUse {
+            ResourceId resource;
+            Access access;
+        };
+
+        struct Pass {
+            const char* name = nullptr;
+            PassFunction execute;
+            bool sideEffects = false;
+            std::vector<ResourceUse> uses;
+            bool alive = false;
+            // the batch recorded ahead of it
+            vk::PipelineStageFlags srcStages;
+            vk::PipelineStageFlags dstStages;
+            vk::MemoryBarrier memoryBarrier;
+            std::vector<vk::ImageMemoryBarrier> imageBarriers;
+        };
+
+        // where a resource is at, while walking the passes
+        struct Tracked {
+            vk::PipelineStageFlags writeStages;
+            vk::AccessFlags writeAccess;
+            // made visible since the last write
+            vk::PipelineStageFlags visibleStages;
+            vk::AccessFlags visibleAccess;
+            vk::PipelineStageFlags readStages;
+            vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        };
+
+        struct Resource {
+            const char* name = nullptr;
+            vk::Buffer buffer;
+            vk::Image image;
+            vk::ImageSubresourceRange range;
+            // transient only: its placement, and the resource it takes the
+            // memory over from
+            bool isTransient = false;
+            TransientImageDesc desc;
+            uint32_t placement = kNone;
+            ResourceId aliasOf = kNone;
+            Access finalAccess = Access::eCount;
+            uint32_t firstPass = kNone;
+            uint32_t lastPass = kNone;
+            Tracked tracked;
+        };
+
+        // a transient image, and where it sits in the memory of its group
+        struct Placement {
+            TransientImageDesc desc;
+            uint32_t memoryTypeBits;
+            vk::DeviceSize offset;
+
+            bool operator==( const Placement& other ) const;
+        };
+
+        // what the transient images of one frame slot are made of
+        struct FrameMemory {
+            std::vector<Placement> placements;
+            std::vector<UniqueImage> images;
+            std::vector<UniqueImageView> views;
+            // one allocation per group of images sharing memory types
+            std::vector<Allocation> allocations;
+        };
+
+        void Cull();
+        void PlaceTransients();
+        void BuildFrameMemory( FrameMemory& frameMemory, std::vector<Placement>&& placements,
+                               const std::vector<uint32_t>& groupTypeBits, const std::vector<vk::DeviceSize>& groupSizes,
+                               const std::vector<vk::DeviceSize>& groupAlignments );
+        void ReleaseFrameMemory( FrameMemory& frameMemory );
+        vk::MemoryRequirements Requirements( const TransientImageDesc& desc );
+        void DeriveBarriers();
+        void Transition( Pass& batch, Resource& resource, Access access );
+        void RecordBatch( const vk::CommandBuffer& commandBuffer, const Pass& batch );
+
+        std::shared_ptr<VulkanContext> context;
+        uint32_t frameIndex;
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        // the final transitions of exported resources, after the last pass
+        Pass finalBatch;
+        std::vector<FrameMemory> frames;
+        // of a throwaway image per distinct description
+        std::vector<std::pair<TransientImageDesc, vk::MemoryRequirements>> knownRequirements;
+
+        // stats of the last compile, and peaks
+        uint32_t culledPasses;
+        uint32_t barrierBatches;
+        uint32_t imageBarriers;
+        vk::DeviceSize transientBytes;
+        vk::DeviceSize aliasedBytes;
+        vk::DeviceSize peakTransientBytes;
+        vk::DeviceSize peakAliasedBytes;
+        uint64_t compileCount;
+        uint64_t totalCulledPasses;
+        uint64_t totalBarrierBatches;
+    };
+}
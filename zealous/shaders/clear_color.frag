@@ -0,0 +1,13 @@
+#version 450
+
+layout( set = 0, binding = 0 ) uniform FrameUniforms {
+    vec4 clearColor;
+    vec4 params;    // x: time in seconds
+    vec4 view;      // xy: center, z: zoom
+} frame;
+
+layout( location = 0 ) out vec4 outColor;
+
+void main() {
+    outColor = frame.clearColor;
+}
@@ -0,0 +1,44 @@
+#version 450
+
+// DescriptorHeap capacity, set when the pipeline is built
+layout( constant_id = 0 ) const uint kHeapBufferCount = 1;
+
+layout( set = 0, binding = 0 ) uniform FrameUniforms {
+    vec4 clearColor;
+    vec4 params;    // x: time in seconds
+    vec4 view;      // xy: center, z: zoom
+} frame;
+
+// matches InstanceData
+struct Instance {
+    vec2 offset;
+    float scale;
+    float phase;
+};
+
+// the storage buffers of the descriptor heap, seen as instance streams
+layout( std430, set = 1, binding = 0 ) readonly buffer HeapBuffer {
+    Instance instances[];
+} heapBuffers[kHeapBufferCount];
+
+layout( push_constant ) uniform DrawConstants {
+    uint instanceBuffer;    // heap index of the instance stream
+    uint firstInstance;     // when indirect draws can't set it themselves
+} draw;
+
+// per vertex, InstancedVertexLayout: quantized, each in its own stream, read
+// back as floats
+layout( location = 0 ) in vec2 inPosition;
+layout( location = 1 ) in vec4 inColor;
+
+layout( location = 0 ) out vec4 outColor;
+
+void main() {
+    const Instance instance = heapBuffers[draw.instanceBuffer].instances[draw.firstInstance + gl_InstanceIndex];
+    const float angle = instance.phase + frame.params.x;
+    const float s = sin( angle );
+    const float c = cos( angle );
+    const vec2 rotated = vec2( c * inPosition.x - s * inPosition.y, s * inPosition.x + c * inPosition.y );
+    gl_Position = vec4( ( instance.offset + rotated * instance.scale - frame.view.xy ) * frame.view.z, 0.0, 1.0 );
+    outColor = inColor;
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+// Internal to simd_math.cpp and simd_math_avx2.cpp: the batch kernels as
+// templates over the instruction set, each translation unit instantiating
+// them for its own. Everything has internal linkage so code built for AVX2
+// can never be picked for a caller that didn't check for it.
+
+#include "simd_math.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // what SetSimdLevel switches between
+    struct SimdKernels {
+        void ( *sinCos )( const float* angles, float* sines, float* cosines, size_t count );
+        void ( *add )( const float* a, const float* b, float* out, size_t count );
+        void ( *mulAdd )( const float* a, const float* b, const float* c, float* out, size_t count );
+        void ( *scaleOffset )( const float* a, float scale, float offset, float* out, size_t count );
+        void ( *rotate2 )( ConstVec2Soa points, const float* angles, Vec2Soa out, size_t count );
+        void ( *dot4 )( ConstVec4Soa a, ConstVec4Soa b, float* out, size_t count );
+        void ( *transform4 )( const Mat4& matrix, ConstVec4Soa points, Vec4Soa out, size_t count );
+        void ( *storeInterleaved4 )( ConstVec4Soa source, float* destination, size_t count );
+        void ( *orbitInstances )( const OrbitBatch& batch, float time, float* destination, size_t count );
+    };
+
+    // null when the build has no AVX2 code
+    const SimdKernels* Avx2Kernels();
+
+    namespace {
+        //----------------------------------------------------------------------
+        // one lane, also the tail of the wider ones
+        struct ScalarOps {
+            using F = float;
+            using I = int32_t;
+            static constexpr size_t kWidth = 1;
+
+            static F Load( const float* p ) { return *p; }
+            static void Store( float* p, F v ) { *p = v; }
+            static F Set( float v ) { return v; }
+            static F Add( F a, F b ) { return a + b; }
+            static F Sub( F a, F b ) { return a - b; }
+            static F Mul( F a, F b ) { return a * b; }
+            static F MulAdd( F a, F b, F c ) { return a * b + c; }
+            static I RoundToInt( F v ) { return ( I )std::nearbyint( v ); }
+            static F ToFloat( I v ) { return ( F )v; }
+            static I AndInt( I v, int32_t bits ) { return v & bits; }
+            static I AddInt( I v, int32_t value ) { return v + value; }
+            // all ones where equal
+            static I EqualInt( I v, int32_t value ) { return v == value ? -1 : 0; }
+            static I ShiftLeft30( I v ) { return ( I )( ( uint32_t )v << 30 ); }
+            static F Select( I mask, F a, F b ) { return mask != 0 ? a : b; }
+            static F XorBits( F v, I bits ) {
+                uint32_t word;
+                std::memcpy( &word, &v, sizeof( word ) );
+                word ^= ( uint32_t )bits;
+                std::memcpy( &v, &word, sizeof( v ) );
+                return v;
+            }
+            static void StoreInterleaved4( float* p, F x, F y, F z, F w ) {
+                p[0] = x;
+                p[1] = y;
+                p[2] = z;
+                p[3] = w;
+            }
+        };
+
+        //----------------------------------------------------------------------
+        // Cody-Waite reduction by pi/2 in three parts, then minimax
+        // polynomials on [-pi/4, pi/4]; the quadrant swaps and negates them
+        template <typename Ops>
+        inline void SinCos( typename Ops::F x, typename Ops::F& sine, typename Ops::F& cosine ) {
+            using F = typename Ops::F;
+            using I = typename Ops::I;
+            const I quadrant = Ops::RoundToInt( Ops::Mul( x, Ops::Set( 0.63661977236758134f ) ) );
+            const F q = Ops::ToFloat( quadrant );
+            F r = Ops::MulAdd( q, Ops::Set( -1.5703125f ), x );
+            r = Ops::MulAdd( q, Ops::Set( -4.837512969970703125e-4f ), r );
+            r = Ops::MulAdd( q, Ops::Set( -7.54978995489188216e-8f ), r );
+            const F r2 = Ops::Mul( r, r );
+
+            F s = Ops::MulAdd( Ops::MulAdd( Ops::Set( -1.9515295891e-4f ), r2, Ops::Set( 8.3321608736e-3f ) ), r2, Ops::Set( -1.6666654611e-1f ) );
+            s = Ops::MulAdd( Ops::Mul( s, r2 ), r, r );
+            F c = Ops::MulAdd( Ops::MulAdd( Ops::Set( 2.443315711809948e-5f ), r2, Ops::Set( -1.388731625493765e-3f ) ), r2, Ops::Set( 4.166664568298827e-2f ) );
+            c = Ops::MulAdd( Ops::Mul( r2, r2 ), c, Ops::MulAdd( r2, Ops::Set( -0.5f ), Ops::Set( 1.f ) ) );
+
+            const I odd = Ops::EqualInt( Ops::AndInt( quadrant, 1 ), 1 );
+            sine = Ops::XorBits( Ops::Select( odd, c, s ), Ops::ShiftLeft30( Ops::AndInt( quadrant, 2 ) ) );
+            cosine = Ops::XorBits( Ops::Select( odd, s, c ), Ops::ShiftLeft30( Ops::AndInt( Ops::AddInt( quadrant, 1 ), 2 ) ) );
+        }
+
+        //----------------------------------------------------------------------
+        // either output may be null
+        template <typename Ops>
+        void SinCosKernel( const float* angles, float* sines, float* cosines, size_t count ) {
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth ) {
+                typename Ops::F s, c;
+                SinCos<Ops>( Ops::Load( angles + i ), s, c );
+                if ( sines != nullptr )
+                    Ops::Store( sines + i, s );
+                if ( cosines != nullptr )
+                    Ops::Store( cosines + i, c );
+            }
+            if constexpr ( Ops::kWidth > 1 )
+                SinCosKernel<ScalarOps>( angles + i, sines ? sines + i : nullptr, cosines ? cosines + i : nullptr, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void AddKernel( const float* a, const float* b, float* out, size_t count ) {
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth )
+                Ops::Store( out + i, Ops::Add( Ops::Load( a + i ), Ops::Load( b + i ) ) );
+            if constexpr ( Ops::kWidth > 1 )
+                AddKernel<ScalarOps>( a + i, b + i, out + i, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void MulAddKernel( const float* a, const float* b, const float* c, float* out, size_t count ) {
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth )
+                Ops::Store( out + i, Ops::MulAdd( Ops::Load( a + i ), Ops::Load( b + i ), Ops::Load( c + i ) ) );
+            if constexpr ( Ops::kWidth > 1 )
+                MulAddKernel<ScalarOps>( a + i, b + i, c + i, out + i, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void ScaleOffsetKernel( const float* a, float scale, float offset, float* out, size_t count ) {
+            const typename Ops::F scaleLanes = Ops::Set( scale );
+            const typename Ops::F offsetLanes = Ops::Set( offset );
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth )
+                Ops::Store( out + i, Ops::MulAdd( Ops::Load( a + i ), scaleLanes, offsetLanes ) );
+            if constexpr ( Ops::kWidth > 1 )
+                ScaleOffsetKernel<ScalarOps>( a + i, scale, offset, out + i, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void Rotate2Kernel( ConstVec2Soa points, const float* angles, Vec2Soa out, size_t count ) {
+            using F = typename Ops::F;
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth ) {
+                F s, c;
+                SinCos<Ops>( Ops::Load( angles + i ), s, c );
+                const F x = Ops::Load( points.x + i );
+                const F y = Ops::Load( points.y + i );
+                // x' = c x - s y, y' = s x + c y
+                Ops::Store( out.x + i, Ops::Sub( Ops::Mul( c, x ), Ops::Mul( s, y ) ) );
+                Ops::Store( out.y + i, Ops::MulAdd( s, x, Ops::Mul( c, y ) ) );
+            }
+            if constexpr ( Ops::kWidth > 1 )
+                Rotate2Kernel<ScalarOps>( { points.x + i, points.y + i }, angles + i, { out.x + i, out.y + i }, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void Dot4Kernel( ConstVec4Soa a, ConstVec4Soa b, float* out, size_t count ) {
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth ) {
+                typename Ops::F dot = Ops::Mul( Ops::Load( a.x + i ), Ops::Load( b.x + i ) );
+                dot = Ops::MulAdd( Ops::Load( a.y + i ), Ops::Load( b.y + i ), dot );
+                dot = Ops::MulAdd( Ops::Load( a.z + i ), Ops::Load( b.z + i ), dot );
+                dot = Ops::MulAdd( Ops::Load( a.w + i ), Ops::Load( b.w + i ), dot );
+                Ops::Store( out + i, dot );
+            }
+            if constexpr ( Ops::kWidth > 1 )
+                Dot4Kernel<ScalarOps>( { a.x + i, a.y + i, a.z + i, a.w + i }, { b.x + i, b.y + i, b.z + i, b.w + i }, out + i, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void Transform4Kernel( const Mat4& matrix, ConstVec4Soa points, Vec4Soa out, size_t count ) {
+            using F = typename Ops::F;
+            F m[16];
+            for ( size_t e = 0; e < 16; ++e )
+                m[e] = Ops::Set( matrix.m[e] );
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth ) {
+                // every input is read before anything is written, out may be points
+                const F x = Ops::Load( points.x + i );
+                const F y = Ops::Load( points.y + i );
+                const F z = Ops::Load( points.z + i );
+                const F w = Ops::Load( points.w + i );
+                float* const outputs[4] = { out.x + i, out.y + i, out.z + i, out.w + i };
+                for ( size_t row = 0; row < 4; ++row ) {
+                    F value = Ops::Mul( m[row], x );
+                    value = Ops::MulAdd( m[4 + row], y, value );
+                    value = Ops::MulAdd( m[8 + row], z, value );
+                    value = Ops::MulAdd( m[12 + row], w, value );
+                    Ops::Store( outputs[row], value );
+                }
+            }
+            if constexpr ( Ops::kWidth > 1 )
+                Transform4Kernel<ScalarOps>( matrix, { points.x + i, points.y + i, points.z + i, points.w + i },
+                                             { out.x + i, out.y + i, out.z + i, out.w + i }, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void StoreInterleaved4Kernel( ConstVec4Soa source, float* destination, size_t count ) {
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth )
+                Ops::StoreInterleaved4( destination + 4 * i, Ops::Load( source.x + i ), Ops::Load( source.y + i ),
+                                        Ops::Load( source.z + i ), Ops::Load( source.w + i ) );
+            if constexpr ( Ops::kWidth > 1 )
+                StoreInterleaved4Kernel<ScalarOps>( { source.x + i, source.y + i, source.z + i, source.w + i }, destination + 4 * i, count - i );
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        void OrbitInstancesKernel( const OrbitBatch& batch, float time, float* destination, size_t count ) {
+            using F = typename Ops::F;
+            const F timeLanes = Ops::Set( time );
+            size_t i = 0;
+            for ( ; i + Ops::kWidth <= count; i += Ops::kWidth ) {
+                const F phase = Ops::Load( batch.phase + i );
+                const F radius = Ops::Load( batch.radius + i );
+                F s, c;
+                SinCos<Ops>( Ops::Add( phase, timeLanes ), s, c );
+                Ops::StoreInterleaved4( destination + 4 * i, Ops::MulAdd( c, radius, Ops::Load( batch.centerX + i ) ),
+                                        Ops::MulAdd( s, radius, Ops::Load( batch.centerY + i ) ), Ops::Load( batch.scale + i ), phase );
+            }
+            if constexpr ( Ops::kWidth > 1 ) {
+                const OrbitBatch tail = { batch.centerX + i, batch.centerY + i, batch.radius + i, batch.scale + i, batch.phase + i };
+                OrbitInstancesKernel<ScalarOps>( tail, time, destination + 4 * i, count - i );
+            }
+        }
+
+        //----------------------------------------------------------------------
+        template <typename Ops>
+        SimdKernels MakeKernels() {
+            SimdKernels kernels;
+            kernels.sinCos = SinCosKernel<Ops>;
+            kernels.add = AddKernel<Ops>;
+            kernels.mulAdd = MulAddKernel<Ops>;
+            kernels.scaleOffset = ScaleOffsetKernel<Ops>;
+            kernels.rotate2 = Rotate2Kernel<Ops>;
+            kernels.dot4 = Dot4Kernel<Ops>;
+            kernels.transform4 = Transform4Kernel<Ops>;
+            kernels.storeInterleaved4 = StoreInterleaved4Kernel<Ops>;
+            kernels.orbitInstances = OrbitInstancesKernel<Ops>;
+            return kernels;
+        }
+    }
+}
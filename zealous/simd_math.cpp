@@ -0,0 +1,409 @@
+#include "simd_math.hpp"
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#if defined( __x86_64__ ) or defined( _M_X64 ) or defined( __i386__ ) or defined( _M_IX86 )
+#define ZEALOUS_X86 1
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#endif
+#if defined( __SSE2__ ) or defined( _M_X64 ) or ( defined( _M_IX86_FP ) and _M_IX86_FP >= 2 )
+#define ZEALOUS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "simd_kernels.hpp"
+
+namespace zealous {
+#if defined( ZEALOUS_SSE2 )
+    namespace {
+        //----------------------------------------------------------------------
+        struct Sse2Ops {
+            using F = __m128;
+            using I = __m128i;
+            static constexpr size_t kWidth = 4;
+
+            static F Load( const float* p ) { return _mm_loadu_ps( p ); }
+            static void Store( float* p, F v ) { _mm_storeu_ps( p, v ); }
+            static F Set( float v ) { return _mm_set1_ps( v ); }
+            static F Add( F a, F b ) { return _mm_add_ps( a, b ); }
+            static F Sub( F a, F b ) { return _mm_sub_ps( a, b ); }
+            static F Mul( F a, F b ) { return _mm_mul_ps( a, b ); }
+            static F MulAdd( F a, F b, F c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+            static I RoundToInt( F v ) { return _mm_cvtps_epi32( v ); }
+            static F ToFloat( I v ) { return _mm_cvtepi32_ps( v ); }
+            static I AndInt( I v, int32_t bits ) { return _mm_and_si128( v, _mm_set1_epi32( bits ) ); }
+            static I AddInt( I v, int32_t value ) { return _mm_add_epi32( v, _mm_set1_epi32( value ) ); }
+            static I EqualInt( I v, int32_t value ) { return _mm_cmpeq_epi32( v, _mm_set1_epi32( value ) ); }
+            static I ShiftLeft30( I v ) { return _mm_slli_epi32( v, 30 ); }
+            static F Select( I mask, F a, F b ) {
+                const F m = _mm_castsi128_ps( mask );
+                return _mm_or_ps( _mm_and_ps( m, a ), _mm_andnot_ps( m, b ) );
+            }
+            static F XorBits( F v, I bits ) { return _mm_xor_ps( v, _mm_castsi128_ps( bits ) ); }
+            static void StoreInterleaved4( float* p, F x, F y, F z, F w ) {
+                _MM_TRANSPOSE4_PS( x, y, z, w );
+                _mm_storeu_ps( p + 0, x );
+                _mm_storeu_ps( p + 4, y );
+                _mm_storeu_ps( p + 8, z );
+                _mm_storeu_ps( p + 12, w );
+            }
+        };
+    }
+#endif
+
+    //--------------------------------------------------------------------------
+    static const SimdKernels* KernelsFor( SimdLevel level ) {
+        static const SimdKernels scalarKernels = MakeKernels<ScalarOps>();
+        switch ( level ) {
+#if defined( ZEALOUS_SSE2 )
+            case SimdLevel::eSse2: {
+                static const SimdKernels sse2Kernels = MakeKernels<Sse2Ops>();
+                return &sse2Kernels;
+            }
+#endif
+            case SimdLevel::eAvx2:
+                return Avx2Kernels();
+            default:
+                return &scalarKernels;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // the detected level until SetSimdLevel
+    static std::atomic<SimdLevel> sActiveLevel{ SimdLevel::eCount };
+    static std::atomic<const SimdKernels*> sKernels{ nullptr };
+
+    //--------------------------------------------------------------------------
+    static const SimdKernels& Kernels() {
+        const SimdKernels* kernels = sKernels.load( std::memory_order_acquire );
+        if ( kernels == nullptr ) {
+            SetSimdLevel( SimdLevel::eCount );
+            kernels = sKernels.load( std::memory_order_acquire );
+        }
+        return *kernels;
+    }
+
+    //--------------------------------------------------------------------------
+    const char* SimdLevelName( SimdLevel level ) {
+        switch ( level ) {
+            case SimdLevel::eScalar: return "scalar";
+            case SimdLevel::eSse2:   return "sse2";
+            case SimdLevel::eAvx2:   return "avx2";
+            default:                 return "?";
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    SimdLevel DetectSimdLevel() {
+        static const SimdLevel detected = [] {
+            SimdLevel level = SimdLevel::eScalar;
+#if defined( ZEALOUS_SSE2 )
+            level = SimdLevel::eSse2;
+#endif
+#if defined( ZEALOUS_X86 )
+#if defined( _MSC_VER )
+            // AVX2 and FMA, with the OS saving the ymm registers
+            int info[4];
+            __cpuid( info, 0 );
+            const int maxLeaf = info[0];
+            __cpuid( info, 1 );
+            const bool fma = ( info[2] & ( 1 << 12 ) ) != 0;
+            const bool osSaves = ( info[2] & ( 1 << 27 ) ) != 0 and ( _xgetbv( 0 ) & 6 ) == 6;
+            bool avx2 = false;
+            if ( maxLeaf >= 7 ) {
+                __cpuidex( info, 7, 0 );
+                avx2 = ( info[1] & ( 1 << 5 ) ) != 0;
+            }
+            if ( level == SimdLevel::eSse2 and fma and osSaves and avx2 )
+                level = SimdLevel::eAvx2;
+#else
+            // checks the OS support too
+            __builtin_cpu_init();
+            if ( level == SimdLevel::eSse2 and __builtin_cpu_supports( "avx2" ) and __builtin_cpu_supports( "fma" ) )
+                level = SimdLevel::eAvx2;
+#endif
+#endif
+            return level;
+        }();
+        return detected;
+    }
+
+    //--------------------------------------------------------------------------
+    SimdLevel SetSimdLevel( SimdLevel level ) {
+        const SimdLevel used = std::min( level, DetectSimdLevel() );
+        sKernels.store( KernelsFor( used ), std::memory_order_release );
+        sActiveLevel.store( used );
+        return used;
+    }
+
+    //--------------------------------------------------------------------------
+    SimdLevel ActiveSimdLevel() {
+        Kernels();
+        return sActiveLevel.load();
+    }
+
+    //--------------------------------------------------------------------------
+    Mat4 Mat4::Identity() {
+        return Scale( 1.f, 1.f, 1.f );
+    }
+
+    //--------------------------------------------------------------------------
+    Mat4 Mat4::Translation( float x, float y, float z ) {
+        Mat4 matrix = Identity();
+        matrix.m[12] = x;
+        matrix.m[13] = y;
+        matrix.m[14] = z;
+        return matrix;
+    }
+
+    //--------------------------------------------------------------------------
+    Mat4 Mat4::Scale( float x, float y, float z ) {
+        Mat4 matrix = {};
+        matrix.m[0] = x;
+        matrix.m[5] = y;
+        matrix.m[10] = z;
+        matrix.m[15] = 1.f;
+        return matrix;
+    }
+
+    //--------------------------------------------------------------------------
+    Mat4 Mat4::RotationZ( float angle ) {
+        const float s = std::sin( angle );
+        const float c = std::cos( angle );
+        Mat4 matrix = Identity();
+        matrix.m[0] = c;
+        matrix.m[1] = s;
+        matrix.m[4] = -s;
+        matrix.m[5] = c;
+        return matrix;
+    }
+
+    //--------------------------------------------------------------------------
+    Mat4 operator*( const Mat4& a, const Mat4& b ) {
+        Mat4 product;
+        for ( size_t column = 0; column < 4; ++column ) {
+            for ( size_t row = 0; row < 4; ++row ) {
+                float sum = 0.f;
+                for ( size_t k = 0; k < 4; ++k )
+                    sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+                product.m[column * 4 + row] = sum;
+            }
+        }
+        return product;
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchSinCos( const float* angles, float* sines, float* cosines, size_t count ) {
+        Kernels().sinCos( angles, sines, cosines, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchSin( const float* angles, float* sines, size_t count ) {
+        Kernels().sinCos( angles, sines, nullptr, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchCos( const float* angles, float* cosines, size_t count ) {
+        Kernels().sinCos( angles, nullptr, cosines, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchAdd( const float* a, const float* b, float* out, size_t count ) {
+        Kernels().add( a, b, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchMulAdd( const float* a, const float* b, const float* c, float* out, size_t count ) {
+        Kernels().mulAdd( a, b, c, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchScaleOffset( const float* a, float scale, float offset, float* out, size_t count ) {
+        Kernels().scaleOffset( a, scale, offset, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchAdd2( ConstVec2Soa a, ConstVec2Soa b, Vec2Soa out, size_t count ) {
+        const SimdKernels& kernels = Kernels();
+        kernels.add( a.x, b.x, out.x, count );
+        kernels.add( a.y, b.y, out.y, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchMulAdd2( ConstVec2Soa a, const float* scale, ConstVec2Soa b, Vec2Soa out, size_t count ) {
+        const SimdKernels& kernels = Kernels();
+        kernels.mulAdd( a.x, scale, b.x, out.x, count );
+        kernels.mulAdd( a.y, scale, b.y, out.y, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchRotate2( ConstVec2Soa points, const float* angles, Vec2Soa out, size_t count ) {
+        Kernels().rotate2( points, angles, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchAdd4( ConstVec4Soa a, ConstVec4Soa b, Vec4Soa out, size_t count ) {
+        const SimdKernels& kernels = Kernels();
+        kernels.add( a.x, b.x, out.x, count );
+        kernels.add( a.y, b.y, out.y, count );
+        kernels.add( a.z, b.z, out.z, count );
+        kernels.add( a.w, b.w, out.w, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchMulAdd4( ConstVec4Soa a, const float* scale, ConstVec4Soa b, Vec4Soa out, size_t count ) {
+        const SimdKernels& kernels = Kernels();
+        kernels.mulAdd( a.x, scale, b.x, out.x, count );
+        kernels.mulAdd( a.y, scale, b.y, out.y, count );
+        kernels.mulAdd( a.z, scale, b.z, out.z, count );
+        kernels.mulAdd( a.w, scale, b.w, out.w, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchDot4( ConstVec4Soa a, ConstVec4Soa b, float* out, size_t count ) {
+        Kernels().dot4( a, b, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchTransform4( const Mat4& matrix, ConstVec4Soa points, Vec4Soa out, size_t count ) {
+        Kernels().transform4( matrix, points, out, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchStoreInterleaved4( ConstVec4Soa source, float* destination, size_t count ) {
+        Kernels().storeInterleaved4( source, destination, count );
+    }
+
+    //--------------------------------------------------------------------------
+    void BatchOrbitInstances( const OrbitBatch& batch, float time, float* destination, size_t count ) {
+        Kernels().orbitInstances( batch, time, destination, count );
+    }
+
+    //--------------------------------------------------------------------------
+    template <typename Function>
+    static double TimeMilliseconds( uint32_t iterations, Function function ) {
+        using Clock = std::chrono::steady_clock;
+        FrameStats stats;
+        for ( uint32_t i = 0; i < iterations; ++i ) {
+            const Clock::time_point start = Clock::now();
+            function();
+            stats.AddSample( std::chrono::duration<double, std::milli>( Clock::now() - start ).count() );
+        }
+        return stats.Percentile( 50.0 );
+    }
+
+    //--------------------------------------------------------------------------
+    void BenchmarkSimdMath( uint32_t count, uint32_t iterations, std::ostream& stream ) {
+        // angles over a few turns either way, like phases plus time
+        std::vector<float> angles( count );
+        std::vector<float> x( count ), y( count ), z( count ), w( count );
+        std::vector<float> radius( count ), scale( count );
+        for ( uint32_t i = 0; i < count; ++i ) {
+            angles[i] = -20.f + 40.f * ( ( i * 2654435761u ) / 4294967296.f );
+            x[i] = -1.f + 2.f * i / count;
+            y[i] = 1.f - 2.f * i / count;
+            z[i] = 0.5f;
+            w[i] = 1.f;
+            radius[i] = 0.01f + 0.001f * ( i % 7 );
+            scale[i] = 0.005f;
+        }
+        std::vector<float> sines( count ), cosines( count );
+        std::vector<float> outX( count ), outY( count ), outZ( count ), outW( count );
+        // stands in for the mapped instance buffer
+        std::vector<float> instances( 4 * size_t( count ) );
+        const Mat4 matrix = Mat4::Translation( 0.1f, -0.2f, 0.f ) * Mat4::RotationZ( 0.3f ) * Mat4::Scale( 2.f, 2.f, 1.f );
+        const OrbitBatch orbit = { x.data(), y.data(), radius.data(), scale.data(), angles.data() };
+        const float time = 1.5f;
+
+        struct Kernel {
+            const char* name;
+            std::function<void()> reference;
+            std::function<void()> batch;
+        };
+        const std::vector<Kernel> kernels = {
+            {
+                "sincos", [&] {
+                    for ( uint32_t i = 0; i < count; ++i ) {
+                        sines[i] = std::sin( angles[i] );
+                        cosines[i] = std::cos( angles[i] );
+                    }
+                }, [&] { BatchSinCos( angles.data(), sines.data(), cosines.data(), count ); }
+            },
+            {
+                "rotate2", [&] {
+                    for ( uint32_t i = 0; i < count; ++i ) {
+                        const float s = std::sin( angles[i] );
+                        const float c = std::cos( angles[i] );
+                        outX[i] = c * x[i] - s * y[i];
+                        outY[i] = s * x[i] + c * y[i];
+                    }
+                }, [&] { BatchRotate2( { x.data(), y.data() }, angles.data(), { outX.data(), outY.data() }, count ); }
+            },
+            {
+                "transform4", [&] {
+                    for ( uint32_t i = 0; i < count; ++i ) {
+                        const float v[4] = { x[i], y[i], z[i], w[i] };
+                        float* const outputs[4] = { &outX[i], &outY[i], &outZ[i], &outW[i] };
+                        for ( size_t row = 0; row < 4; ++row )
+                            *outputs[row] = matrix.m[row] * v[0] + matrix.m[4 + row] * v[1] + matrix.m[8 + row] * v[2] + matrix.m[12 + row] * v[3];
+                    }
+                }, [&] {
+                    BatchTransform4( matrix, { x.data(), y.data(), z.data(), w.data() },
+                    { outX.data(), outY.data(), outZ.data(), outW.data() }, count );
+                }
+            },
+            {
+                "orbit instances", [&] {
+                    for ( uint32_t i = 0; i < count; ++i ) {
+                        float* instance = &instances[4 * size_t( i )];
+                        instance[0] = x[i] + radius[i] * std::cos( angles[i] + time );
+                        instance[1] = y[i] + radius[i] * std::sin( angles[i] + time );
+                        instance[2] = scale[i];
+                        instance[3] = angles[i];
+                    }
+                }, [&] { BatchOrbitInstances( orbit, time, instances.data(), count ); }
+            }
+        };
+
+        const SimdLevel wasLevel = ActiveSimdLevel();
+        stream << "Math kernels, " << count << " elements, median of " << iterations << " iterations, "
+               << SimdLevelName( DetectSimdLevel() ) << " detected" << std::endl;
+        for ( const Kernel& kernel : kernels ) {
+            const double reference = TimeMilliseconds( iterations, kernel.reference );
+            stream << "  " << kernel.name << " : std " << reference << " ms";
+            for ( uint32_t level = 0; level <= ( uint32_t )DetectSimdLevel(); ++level ) {
+                SetSimdLevel( SimdLevel( level ) );
+                const double milliseconds = TimeMilliseconds( iterations, kernel.batch );
+                stream << ", " << SimdLevelName( SimdLevel( level ) ) << " " << milliseconds << " ms (" << reference / milliseconds << "x)";
+            }
+            stream << std::endl;
+        }
+
+        // against the std:: results, at every level
+        std::vector<float> referenceSines( count ), referenceCosines( count );
+        for ( uint32_t i = 0; i < count; ++i ) {
+            referenceSines[i] = std::sin( angles[i] );
+            referenceCosines[i] = std::cos( angles[i] );
+        }
+        stream << "  sincos max error :";
+        for ( uint32_t level = 0; level <= ( uint32_t )DetectSimdLevel(); ++level ) {
+            SetSimdLevel( SimdLevel( level ) );
+            BatchSinCos( angles.data(), sines.data(), cosines.data(), count );
+            float error = 0.f;
+            for ( uint32_t i = 0; i < count; ++i )
+                error = std::max( { error, std::abs( sines[i] - referenceSines[i] ), std::abs( cosines[i] - referenceCosines[i] ) } );
+            stream << " " << SimdLevelName( SimdLevel( level ) ) << " " << error;
+        }
+        stream << std::endl;
+        SetSimdLevel( wasLevel );
+    }
+}
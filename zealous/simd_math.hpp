@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    enum class SimdLevel {
+        eScalar,
+        eSse2,
+        eAvx2,      // with FMA
+        eCount
+    };
+    const char* SimdLevelName( SimdLevel level );
+
+    // the widest level both the CPU and the OS support
+    SimdLevel DetectSimdLevel();
+    // the batch kernels run at that level from now on, or at the detected one
+    // if it's wider than what's there; returns the level used
+    SimdLevel SetSimdLevel( SimdLevel level );
+    SimdLevel ActiveSimdLevel();
+
+    //--------------------------------------------------------------------------
+    // column major, m[column * 4 + row]
+    struct Mat4 {
+        std::array<float, 16> m;
+
+        static Mat4 Identity();
+        static Mat4 Translation( float x, float y, float z );
+        static Mat4 Scale( float x, float y, float z );
+        static Mat4 RotationZ( float angle );
+    };
+    Mat4 operator*( const Mat4& a, const Mat4& b );
+
+    //--------------------------------------------------------------------------
+    // Structure of arrays views, one array per component, all of the length
+    // passed to the kernel
+    struct Vec2Soa {
+        float* x;
+        float* y;
+    };
+    struct ConstVec2Soa {
+        const float* x;
+        const float* y;
+    };
+    struct Vec4Soa {
+        float* x;
+        float* y;
+        float* z;
+        float* w;
+    };
+    struct ConstVec4Soa {
+        const float* x;
+        const float* y;
+        const float* z;
+        const float* w;
+    };
+
+    //--------------------------------------------------------------------------
+    // Batch kernels, at the active level; the tail that doesn't fill a SIMD
+    // register goes through the scalar path. Outputs may be their inputs,
+    // they may not overlap them otherwise. No alignment is required.
+    //
+    // sin and cos are polynomial approximations after a reduction to
+    // [-pi/4, pi/4], within a few ulp of std::sin and std::cos for |x| up to
+    // a few thousand radians.
+    void BatchSinCos( const float* angles, float* sines, float* cosines, size_t count );
+    void BatchSin( const float* angles, float* sines, size_t count );
+    void BatchCos( const float* angles, float* cosines, size_t count );
+
+    // out = a + b
+    void BatchAdd( const float* a, const float* b, float* out, size_t count );
+    // out = a * b + c
+    void BatchMulAdd( const float* a, const float* b, const float* c, float* out, size_t count );
+    // out = a * scale + offset
+    void BatchScaleOffset( const float* a, float scale, float offset, float* out, size_t count );
+
+    void BatchAdd2( ConstVec2Soa a, ConstVec2Soa b, Vec2Soa out, size_t count );
+    // out = a * scale + b, one scale per element
+    void BatchMulAdd2( ConstVec2Soa a, const float* scale, ConstVec2Soa b, Vec2Soa out, size_t count );
+    // each point by its own angle, counterclockwise
+    void BatchRotate2( ConstVec2Soa points, const float* angles, Vec2Soa out, size_t count );
+
+    void BatchAdd4( ConstVec4Soa a, ConstVec4Soa b, Vec4Soa out, size_t count );
+    void BatchMulAdd4( ConstVec4Soa a, const float* scale, ConstVec4Soa b, Vec4Soa out, size_t count );
+    void BatchDot4( ConstVec4Soa a, ConstVec4Soa b, float* out, size_t count );
+    void BatchTransform4( const Mat4& matrix, ConstVec4Soa points, Vec4Soa out, size_t count );
+
+    // as consecutive (x, y, z, w), written once front to back: fine for
+    // write-combined mapped memory
+    void BatchStoreInterleaved4( ConstVec4Soa source, float* destination, size_t count );
+
+    //--------------------------------------------------------------------------
+    // Instances circling their center, radius and phase of their own, written
+    // out as (x, y, scale, phase) at time: the layout the instanced pipeline
+    // reads, straight into a mapped instance buffer. One pass, nothing
+    // written but the destination.
+    struct OrbitBatch {
+        const float* centerX;
+        const float* centerY;
+        const float* radius;
+        const float* scale;
+        const float* phase;
+    };
+    void BatchOrbitInstances( const OrbitBatch& batch, float time, float* destination, size_t count );
+
+    //--------------------------------------------------------------------------
+    // Every kernel against the obvious std:: loop over count elements, at each
+    // level the CPU has, with the largest error of sin and cos
+    void BenchmarkSimdMath( uint32_t count, uint32_t iterations, std::ostream& stream );
+}
@@ -0,0 +1,80 @@
+// AVX2 and FMA kernels, only ever called once DetectSimdLevel found them.
+// The standard headers come first so none of their inline code is built for
+// AVX2 here; MSVC needs no switch for the intrinsics.
+#include "simd_math.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined( __x86_64__ ) or defined( _M_X64 ) or defined( __i386__ ) or defined( _M_IX86 )
+#define ZEALOUS_AVX2 1
+#include <immintrin.h>
+#if defined( __clang__ )
+#pragma clang attribute push( __attribute__( ( target( "avx2,fma" ) ) ), apply_to = function )
+#elif defined( __GNUC__ )
+#pragma GCC target( "avx2,fma" )
+#endif
+#endif
+
+#include "simd_kernels.hpp"
+
+namespace zealous {
+#if defined( ZEALOUS_AVX2 )
+    namespace {
+        //----------------------------------------------------------------------
+        struct Avx2Ops {
+            using F = __m256;
+            using I = __m256i;
+            static constexpr size_t kWidth = 8;
+
+            static F Load( const float* p ) { return _mm256_loadu_ps( p ); }
+            static void Store( float* p, F v ) { _mm256_storeu_ps( p, v ); }
+            static F Set( float v ) { return _mm256_set1_ps( v ); }
+            static F Add( F a, F b ) { return _mm256_add_ps( a, b ); }
+            static F Sub( F a, F b ) { return _mm256_sub_ps( a, b ); }
+            static F Mul( F a, F b ) { return _mm256_mul_ps( a, b ); }
+            static F MulAdd( F a, F b, F c ) { return _mm256_fmadd_ps( a, b, c ); }
+            static I RoundToInt( F v ) { return _mm256_cvtps_epi32( v ); }
+            static F ToFloat( I v ) { return _mm256_cvtepi32_ps( v ); }
+            static I AndInt( I v, int32_t bits ) { return _mm256_and_si256( v, _mm256_set1_epi32( bits ) ); }
+            static I AddInt( I v, int32_t value ) { return _mm256_add_epi32( v, _mm256_set1_epi32( value ) ); }
+            static I EqualInt( I v, int32_t value ) { return _mm256_cmpeq_epi32( v, _mm256_set1_epi32( value ) ); }
+            static I ShiftLeft30( I v ) { return _mm256_slli_epi32( v, 30 ); }
+            static F Select( I mask, F a, F b ) { return _mm256_blendv_ps( b, a, _mm256_castsi256_ps( mask ) ); }
+            static F XorBits( F v, I bits ) { return _mm256_xor_ps( v, _mm256_castsi256_ps( bits ) ); }
+            static void StoreInterleaved4( float* p, F x, F y, F z, F w ) {
+                // 4x4 transposes in each 128 bit half, then the halves regrouped
+                const F xy0 = _mm256_unpacklo_ps( x, y );
+                const F xy1 = _mm256_unpackhi_ps( x, y );
+                const F zw0 = _mm256_unpacklo_ps( z, w );
+                const F zw1 = _mm256_unpackhi_ps( z, w );
+                const F v04 = _mm256_shuffle_ps( xy0, zw0, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+                const F v15 = _mm256_shuffle_ps( xy0, zw0, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+                const F v26 = _mm256_shuffle_ps( xy1, zw1, _MM_SHUFFLE( 1, 0, 1, 0 ) );
+                const F v37 = _mm256_shuffle_ps( xy1, zw1, _MM_SHUFFLE( 3, 2, 3, 2 ) );
+                _mm256_storeu_ps( p + 0, _mm256_permute2f128_ps( v04, v15, 0x20 ) );
+                _mm256_storeu_ps( p + 8, _mm256_permute2f128_ps( v26, v37, 0x20 ) );
+                _mm256_storeu_ps( p + 16, _mm256_permute2f128_ps( v04, v15, 0x31 ) );
+                _mm256_storeu_ps( p + 24, _mm256_permute2f128_ps( v26, v37, 0x31 ) );
+            }
+        };
+    }
+
+    //--------------------------------------------------------------------------
+    const SimdKernels* Avx2Kernels() {
+        static const SimdKernels kernels = MakeKernels<Avx2Ops>();
+        return &kernels;
+    }
+#else
+    //--------------------------------------------------------------------------
+    const SimdKernels* Avx2Kernels() {
+        return nullptr;
+    }
+#endif
+}
+
+#if defined( ZEALOUS_AVX2 ) and defined( __clang__ )
+#pragma clang attribute pop
+#endif
@@ -0,0 +1,166 @@
+#include "startup_graph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    StartupGraph::StartupGraph()
+        : remaining( 0 )
+        , running( 0 )
+        , threadCount( 0 )
+        , totalMilliseconds( 0.0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    StartupGraph::StageId StartupGraph::AddStage( const std::string& name, std::function<void()> work,
+            const std::vector<StageId>& dependencies, Affinity affinity ) {
+        const StageId id = ( StageId )stages.size();
+
+        Stage stage;
+        stage.name = name;
+        stage.work = std::move( work );
+        stage.affinity = affinity;
+        stage.dependencyCount = ( uint32_t )dependencies.size();
+        stage.pendingDependencies = 0;
+        stage.thread = 0;
+        stage.startMilliseconds = 0.0;
+        stage.endMilliseconds = 0.0;
+        stages.push_back( std::move( stage ) );
+
+        for ( StageId dependency : dependencies ) {
+            assert( dependency < id );
+            stages[dependency].dependents.push_back( id );
+        }
+        return id;
+    }
+
+    //--------------------------------------------------------------------------
+    void StartupGraph::Run( uint32_t workerCount ) {
+        start = std::chrono::steady_clock::now();
+
+        remaining = ( uint32_t )stages.size();
+        running = 0;
+        threadCount = workerCount + 1;
+        failure = nullptr;
+        ready.clear();
+        for ( StageId id = 0; id < stages.size(); ++id ) {
+            stages[id].pendingDependencies = stages[id].dependencyCount;
+            if ( stages[id].dependencyCount == 0 )
+                ready.push_back( id );
+        }
+
+        std::vector<std::thread> workers;
+        for ( uint32_t i = 1; i <= workerCount; ++i )
+            workers.emplace_back( &StartupGraph::Work, this, i );
+        Work( 0 );
+        for ( std::thread& worker : workers )
+            worker.join();
+
+        totalMilliseconds = Elapsed();
+        if ( failure )
+            std::rethrow_exception( failure );
+    }
+
+    //--------------------------------------------------------------------------
+    void StartupGraph::Work( uint32_t thread ) {
+        const bool mainThread = thread == 0;
+
+        std::unique_lock<std::mutex> lock( mutex );
+        for ( ;; ) {
+            if ( remaining == 0 or ( failure and running == 0 ) )
+                break;
+
+            StageId id;
+            if ( failure or not TakeReady( mainThread, id ) ) {
+                wake.wait( lock );
+                continue;
+            }
+            ++running;
+            lock.unlock();
+
+            Stage& stage = stages[id];
+            stage.thread = thread;
+            stage.startMilliseconds = Elapsed();
+            std::exception_ptr error;
+            try {
+                stage.work();
+            } catch ( ... ) {
+                error = std::current_exception();
+            }
+            stage.endMilliseconds = Elapsed();
+
+            lock.lock();
+            --running;
+            if ( error ) {
+                if ( not failure )
+                    failure = error;
+            } else {
+                --remaining;
+                for ( StageId dependent : stage.dependents ) {
+                    if ( --stages[dependent].pendingDependencies == 0 )
+                        ready.push_back( dependent );
+                }
+            }
+            wake.notify_all();
+        }
+        wake.notify_all();
+    }
+
+    //--------------------------------------------------------------------------
+    bool StartupGraph::TakeReady( bool mainThread, StageId& id ) {
+        // the main thread serves its own stages first, nobody else can
+        auto it = ready.end();
+        if ( mainThread ) {
+            it = std::find_if( ready.begin(), ready.end(), [this]( StageId candidate ) {
+                return stages[candidate].affinity == Affinity::eMainThread;
+            } );
+            if ( it == ready.end() )
+                it = ready.begin();
+        } else {
+            it = std::find_if( ready.begin(), ready.end(), [this]( StageId candidate ) {
+                return stages[candidate].affinity == Affinity::eAnyThread;
+            } );
+        }
+
+        if ( it == ready.end() )
+            return false;
+        id = *it;
+        ready.erase( it );
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    double StartupGraph::Elapsed() const {
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    //--------------------------------------------------------------------------
+    void StartupGraph::PrintReport( std::ostream& stream ) const {
+        std::vector<StageId> order( stages.size() );
+        for ( StageId id = 0; id < stages.size(); ++id )
+            order[id] = id;
+        std::sort( order.begin(), order.end(), [this]( StageId a, StageId b ) {
+            return stages[a].startMilliseconds < stages[b].startMilliseconds;
+        } );
+
+        double busyMilliseconds = 0.0;
+        for ( const Stage& stage : stages )
+            busyMilliseconds += stage.endMilliseconds - stage.startMilliseconds;
+
+        stream << "Startup (ms)     : " << totalMilliseconds << " on " << threadCount << " thread(s), "
+               << busyMilliseconds << " of stage work" << std::endl;
+        for ( StageId id : order ) {
+            const Stage& stage = stages[id];
+            stream << "  " << std::left << std::setw( 28 ) << stage.name << std::right
+                   << " thread " << stage.thread
+                   << std::fixed << std::setprecision( 2 )
+                   << "  start " << std::setw( 8 ) << stage.startMilliseconds
+                   << "  took " << std::setw( 8 ) << stage.endMilliseconds - stage.startMilliseconds
+                   << std::defaultfloat << std::endl;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Startup work as a dependency graph. Stages only name stages added before
+    // them, so the graph can't have cycles, and each one runs as soon as its
+    // dependencies are done, on whichever thread is free.
+    class StartupGraph {
+      public:
+        using StageId = uint32_t;
+
+        enum class Affinity {
+            eAnyThread,
+            eMainThread     // window system calls, only run by the thread calling Run
+        };
+
+        StartupGraph();
+
+        StageId AddStage( const std::string& name, std::function<void()> work,
+                          const std::vector<StageId>& dependencies = {}, Affinity affinity = Affinity::eAnyThread );
+
+        // the calling thread takes part, with workerCount more threads next to
+        // it; rethrows the first exception a stage threw once every running
+        // stage returned, stages depending on the failed one never run
+        void Run( uint32_t workerCount );
+
+        double TotalMilliseconds() const { return totalMilliseconds; }
+        void PrintReport( std::ostream& stream ) const;
+
+      private:
+        struct Stage {
+            std::string name;
+            std::function<void()> work;
+            Affinity affinity;
+            std::vector<StageId> dependents;
+            uint32_t dependencyCount;
+            uint32_t pendingDependencies;
+
+            // filled by Run
+            uint32_t thread;
+            double startMilliseconds;
+            double endMilliseconds;
+        };
+
+        void Work( uint32_t thread );
+        bool TakeReady( bool mainThread, StageId& id );
+        double Elapsed() const;
+
+        std::vector<Stage> stages;
+        std::deque<StageId> ready;
+        uint32_t remaining;
+        uint32_t running;
+        uint32_t threadCount;
+        std::exception_ptr failure;
+        std::mutex mutex;
+        std::condition_variable wake;
+
+        std::chrono::steady_clock::time_point start;
+        double totalMilliseconds;
+    };
+}
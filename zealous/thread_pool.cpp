@@ -0,0 +1,135 @@
+#include "thread_pool.hpp"
+#include "tracer.hpp"
+
+#include <cassert>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    ThreadPool::ThreadPool()
+        : generation( 0 )
+        , stopping( false )
+        , task( nullptr )
+        , pending( 0 )
+        , steals( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    ThreadPool::~ThreadPool() {
+        assert( workers.empty() );
+    }
+
+    //--------------------------------------------------------------------------
+    void ThreadPool::Init( uint32_t workerCount ) {
+        assert( workers.empty() );
+        stopping = false;
+        steals = 0;
+
+        // the last slot belongs to the thread calling ParallelFor
+        for ( uint32_t i = 0; i <= workerCount; ++i )
+            queues.push_back( std::make_unique<WorkQueue>() );
+        for ( uint32_t i = 0; i < workerCount; ++i )
+            workers.emplace_back( &ThreadPool::WorkerLoop, this, i );
+    }
+
+    //--------------------------------------------------------------------------
+    void ThreadPool::DeInit() {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+        wake.notify_all();
+        for ( std::thread& worker : workers )
+            worker.join();
+        workers.clear();
+        queues.clear();
+    }
+
+    //--------------------------------------------------------------------------
+    void ThreadPool::ParallelFor( uint32_t count, const std::function<void( uint32_t index, uint32_t slot )>& task ) {
+        if ( count == 0 )
+            return;
+        assert( this->task == nullptr );
+
+        this->task = &task;
+        pending = count;
+
+        const uint32_t slotCount = SlotCount();
+        for ( uint32_t slot = 0; slot < slotCount; ++slot ) {
+            WorkQueue& queue = *queues[slot];
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            for ( uint32_t index = slot; index < count; index += slotCount )
+                queue.indices.push_back( index );
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            ++generation;
+        }
+        wake.notify_all();
+
+        RunTasks( slotCount - 1 );
+
+        // the last tasks may still be running on other threads
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            done.wait( lock, [this] { return pending == 0; } );
+        }
+        this->task = nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    void ThreadPool::WorkerLoop( uint32_t slot ) {
+        TRACE_THREAD_NAME( "pool worker" );
+        uint64_t seen = 0;
+        for ( ;; ) {
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wake.wait( lock, [this, seen] { return stopping or generation != seen; } );
+                if ( stopping )
+                    return;
+                seen = generation;
+            }
+            RunTasks( slot );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void ThreadPool::RunTasks( uint32_t slot ) {
+        uint32_t index;
+        while ( TakeIndex( slot, index ) ) {
+            ( *task )( index, slot );
+            if ( --pending == 0 ) {
+                std::lock_guard<std::mutex> lock( mutex );
+                done.notify_all();
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    bool ThreadPool::TakeIndex( uint32_t slot, uint32_t& index ) {
+        // own work first, newest end
+        {
+            WorkQueue& queue = *queues[slot];
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            if ( not queue.indices.empty() ) {
+                index = queue.indices.back();
+                queue.indices.pop_back();
+                return true;
+            }
+        }
+
+        // then the oldest work of the others
+        const uint32_t slotCount = SlotCount();
+        for ( uint32_t offset = 1; offset < slotCount; ++offset ) {
+            WorkQueue& queue = *queues[( slot + offset ) % slotCount];
+            std::lock_guard<std::mutex> lock( queue.mutex );
+            if ( not queue.indices.empty() ) {
+                index = queue.indices.front();
+                queue.indices.pop_front();
+                ++steals;
+                return true;
+            }
+        }
+        return false;
+    }
+}
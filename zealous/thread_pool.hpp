@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Work-stealing pool for fork-join work. Every thread owns a deque, a
+    // ParallelFor deals its indices round-robin over them; a thread pops from
+    // the back of its own and steals from the front of the others once empty.
+    // The calling thread takes part, so tasks see WorkerCount() + 1 slots.
+    class ThreadPool {
+      public:
+        ThreadPool();
+        ~ThreadPool();
+
+        void Init( uint32_t workerCount );
+        void DeInit();
+
+        uint32_t WorkerCount() const { return ( uint32_t )workers.size(); }
+        // distinct values a task can get for its slot, to index per-thread data
+        uint32_t SlotCount() const { return ( uint32_t )queues.size(); }
+
+        // runs task( index, slot ) for every index in [0, count) and returns
+        // once all of them did; one ParallelFor at a time
+        void ParallelFor( uint32_t count, const std::function<void( uint32_t index, uint32_t slot )>& task );
+
+        uint64_t StealCount() const { return steals; }
+
+      private:
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<uint32_t> indices;
+        };
+
+        void WorkerLoop( uint32_t slot );
+        void RunTasks( uint32_t slot );
+        bool TakeIndex( uint32_t slot, uint32_t& index );
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        uint64_t generation;
+        bool stopping;
+
+        const std::function<void( uint32_t, uint32_t )>* task;
+        std::atomic<uint32_t> pending;
+        std::atomic<uint64_t> steals;
+    };
+}
@@ -0,0 +1,248 @@
+#include "tlsf_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    static uint32_t LowestBit( uint64_t value ) {
+        assert( value != 0 );
+#if defined( _MSC_VER )
+        unsigned long index;
+        _BitScanForward64( &index, value );
+        return ( uint32_t )index;
+#else
+        return ( uint32_t )__builtin_ctzll( value );
+#endif
+    }
+
+    //--------------------------------------------------------------------------
+    static uint32_t HighestBit( uint64_t value ) {
+        assert( value != 0 );
+#if defined( _MSC_VER )
+        unsigned long index;
+        _BitScanReverse64( &index, value );
+        return ( uint32_t )index;
+#else
+        return 63 - ( uint32_t )__builtin_clzll( value );
+#endif
+    }
+
+    //--------------------------------------------------------------------------
+    TlsfAllocator::TlsfAllocator()
+        : firstLevelBitmap( 0 )
+        , size           ( 0 )
+        , usedBytes      ( 0 )
+        , allocationCount( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::Init( uint64_t size ) {
+        this->size = size - size % kGranularity;
+        usedBytes = 0;
+        allocationCount = 0;
+        blocks.clear();
+        unusedBlocks.clear();
+        firstLevelBitmap = 0;
+        std::fill( &secondLevelBitmaps[0], &secondLevelBitmaps[0] + kFirstLevelCount, 0u );
+        std::fill( &freeLists[0][0], &freeLists[0][0] + kFirstLevelCount * kSecondLevelCount, kInvalidHandle );
+
+        const uint32_t index = NewBlock();
+        blocks[index].offset = 0;
+        blocks[index].size = this->size;
+        InsertFree( index );
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::Mapping( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel ) {
+        // small sizes get one exact class each, larger ones are split linearly
+        // in kSecondLevelCount classes per power of two
+        firstLevel = HighestBit( units );
+        if ( firstLevel < kSecondLevelLog2 )
+            secondLevel = ( uint32_t )( units - ( uint64_t( 1 ) << firstLevel ) );
+        else
+            secondLevel = ( uint32_t )( ( units >> ( firstLevel - kSecondLevelLog2 ) ) - kSecondLevelCount );
+    }
+
+    //--------------------------------------------------------------------------
+    bool TlsfAllocator::FindSuitable( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel ) const {
+        // round up to the next class so that any block found is large enough
+        const uint32_t log2 = HighestBit( units );
+        if ( log2 >= kSecondLevelLog2 )
+            units += ( uint64_t( 1 ) << ( log2 - kSecondLevelLog2 ) ) - 1;
+        Mapping( units, firstLevel, secondLevel );
+        if ( firstLevel >= kFirstLevelCount )
+            return false;
+
+        uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & ( ~0u << secondLevel );
+        if ( secondLevelMap == 0 ) {
+            const uint64_t firstLevelMap = firstLevel + 1 < 64 ? firstLevelBitmap & ( ~uint64_t( 0 ) << ( firstLevel + 1 ) ) : 0;
+            if ( firstLevelMap == 0 )
+                return false;
+            firstLevel = LowestBit( firstLevelMap );
+            secondLevelMap = secondLevelBitmaps[firstLevel];
+        }
+        secondLevel = LowestBit( secondLevelMap );
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t TlsfAllocator::NewBlock() {
+        Block block = { 0, 0, kInvalidHandle, kInvalidHandle, kInvalidHandle, kInvalidHandle, false };
+        if ( not unusedBlocks.empty() ) {
+            const uint32_t index = unusedBlocks.back();
+            unusedBlocks.pop_back();
+            blocks[index] = block;
+            return index;
+        }
+        blocks.push_back( block );
+        return ( uint32_t )( blocks.size() - 1 );
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::ReleaseBlock( uint32_t index ) {
+        unusedBlocks.push_back( index );
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::InsertFree( uint32_t index ) {
+        uint32_t firstLevel, secondLevel;
+        Mapping( blocks[index].size / kGranularity, firstLevel, secondLevel );
+
+        const uint32_t head = freeLists[firstLevel][secondLevel];
+        blocks[index].free = true;
+        blocks[index].prevFree = kInvalidHandle;
+        blocks[index].nextFree = head;
+        if ( head != kInvalidHandle )
+            blocks[head].prevFree = index;
+        freeLists[firstLevel][secondLevel] = index;
+
+        firstLevelBitmap |= uint64_t( 1 ) << firstLevel;
+        secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::RemoveFree( uint32_t index ) {
+        uint32_t firstLevel, secondLevel;
+        Mapping( blocks[index].size / kGranularity, firstLevel, secondLevel );
+
+        Block& block = blocks[index];
+        if ( block.prevFree != kInvalidHandle )
+            blocks[block.prevFree].nextFree = block.nextFree;
+        else
+            freeLists[firstLevel][secondLevel] = block.nextFree;
+        if ( block.nextFree != kInvalidHandle )
+            blocks[block.nextFree].prevFree = block.prevFree;
+        block.free = false;
+
+        if ( freeLists[firstLevel][secondLevel] == kInvalidHandle ) {
+            secondLevelBitmaps[firstLevel] &= ~( 1u << secondLevel );
+            if ( secondLevelBitmaps[firstLevel] == 0 )
+                firstLevelBitmap &= ~( uint64_t( 1 ) << firstLevel );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t TlsfAllocator::Split( uint32_t index, uint64_t size ) {
+        // NewBlock may grow the vector, don't hold references across it
+        const uint32_t remainder = NewBlock();
+        Block& block = blocks[index];
+        Block& rest = blocks[remainder];
+        rest.offset = block.offset + size;
+        rest.size = block.size - size;
+        rest.prevPhysical = index;
+        rest.nextPhysical = block.nextPhysical;
+        if ( block.nextPhysical != kInvalidHandle )
+            blocks[block.nextPhysical].prevPhysical = remainder;
+        block.nextPhysical = remainder;
+        block.size = size;
+        return remainder;
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::Merge( uint32_t index, uint32_t next ) {
+        Block& block = blocks[index];
+        const Block& absorbed = blocks[next];
+        assert( block.nextPhysical == next );
+        block.size += absorbed.size;
+        block.nextPhysical = absorbed.nextPhysical;
+        if ( absorbed.nextPhysical != kInvalidHandle )
+            blocks[absorbed.nextPhysical].prevPhysical = index;
+        ReleaseBlock( next );
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t TlsfAllocator::Allocate( uint64_t size, uint64_t alignment, uint64_t& offset ) {
+        const uint64_t units = std::max<uint64_t>( 1, ( size + kGranularity - 1 ) / kGranularity );
+        alignment = std::max( alignment, kGranularity );
+
+        // over-allocate for alignments above the granularity, the padding is
+        // given back as a free block right away
+        const uint64_t paddingUnits = alignment / kGranularity - 1;
+        uint32_t firstLevel, secondLevel;
+        if ( not FindSuitable( units + paddingUnits, firstLevel, secondLevel ) )
+            return kInvalidHandle;
+
+        uint32_t index = freeLists[firstLevel][secondLevel];
+        RemoveFree( index );
+
+        const uint64_t blockOffset = blocks[index].offset;
+        const uint64_t alignedOffset = ( blockOffset + alignment - 1 ) & ~( alignment - 1 );
+        if ( alignedOffset != blockOffset ) {
+            const uint32_t aligned = Split( index, alignedOffset - blockOffset );
+            InsertFree( index );
+            index = aligned;
+        }
+
+        const uint64_t allocationSize = units * kGranularity;
+        if ( blocks[index].size > allocationSize ) {
+            const uint32_t remainder = Split( index, allocationSize );
+            InsertFree( remainder );
+        }
+
+        usedBytes += blocks[index].size;
+        ++allocationCount;
+        offset = blocks[index].offset;
+        return index;
+    }
+
+    //--------------------------------------------------------------------------
+    void TlsfAllocator::Free( uint32_t handle ) {
+        assert( handle < blocks.size() and not blocks[handle].free );
+        usedBytes -= blocks[handle].size;
+        --allocationCount;
+
+        // coalesce with the free physical neighbours
+        uint32_t index = handle;
+        const uint32_t prev = blocks[index].prevPhysical;
+        if ( prev != kInvalidHandle and blocks[prev].free ) {
+            RemoveFree( prev );
+            Merge( prev, index );
+            index = prev;
+        }
+        const uint32_t next = blocks[index].nextPhysical;
+        if ( next != kInvalidHandle and blocks[next].free ) {
+            RemoveFree( next );
+            Merge( index, next );
+        }
+        InsertFree( index );
+    }
+
+    //--------------------------------------------------------------------------
+    uint64_t TlsfAllocator::LargestFreeBlock() const {
+        if ( firstLevelBitmap == 0 )
+            return 0;
+
+        // the largest block sits in the highest non-empty class
+        const uint32_t firstLevel = HighestBit( firstLevelBitmap );
+        const uint32_t secondLevel = HighestBit( secondLevelBitmaps[firstLevel] );
+        uint64_t largest = 0;
+        for ( uint32_t index = freeLists[firstLevel][secondLevel]; index != kInvalidHandle; index = blocks[index].nextFree )
+            largest = std::max( largest, blocks[index].size );
+        return largest;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Two-level segregated fit sub-allocator. Manages offsets inside a range
+    // it never touches, so the bookkeeping lives on the CPU while the range
+    // itself can be device memory. Allocation and free are O(1).
+    class TlsfAllocator {
+      public:
+        static constexpr uint32_t kInvalidHandle = UINT32_MAX;
+        // every size and offset is a multiple of this
+        static constexpr uint64_t kGranularity = 256;
+
+        TlsfAllocator();
+
+        void Init( uint64_t size );
+
+        // returns kInvalidHandle when no free block is large enough
+        uint32_t Allocate( uint64_t size, uint64_t alignment, uint64_t& offset );
+        void Free( uint32_t handle );
+
+        uint64_t Size() const { return size; }
+        uint64_t UsedBytes() const { return usedBytes; }
+        uint64_t FreeBytes() const { return size - usedBytes; }
+        uint64_t LargestFreeBlock() const;
+        uint32_t AllocationCount() const { return allocationCount; }
+        bool Empty() const { return allocationCount == 0; }
+
+      private:
+        static constexpr uint32_t kSecondLevelLog2 = 5;
+        static constexpr uint32_t kSecondLevelCount = 1 << kSecondLevelLog2;
+        static constexpr uint32_t kFirstLevelCount = 48;
+
+        struct Block {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t prevPhysical;
+            uint32_t nextPhysical;
+            uint32_t prevFree;
+            uint32_t nextFree;
+            bool free;
+        };
+
+        static void Mapping( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel );
+        bool FindSuitable( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel ) const;
+
+        uint32_t NewBlock();
+        void ReleaseBlock( uint32_t index );
+        void InsertFree( uint32_t index );
+        void RemoveFree( uint32_t index );
+        uint32_t Split( uint32_t index, uint64_t size );
+        void Merge( uint32_t index, uint32_t next );
+
+        std::vector<Block> blocks;
+        std::vector<uint32_t> unusedBlocks;
+        uint32_t freeLists[kFirstLevelCount][kSecondLevelCount];
+        uint32_t secondLevelBitmaps[kFirstLevelCount];
+        uint64_t firstLevelBitmap;
+        uint64_t size;
+        uint64_t usedBytes;
+        uint32_t allocationCount;
+    };
+}
@@ -0,0 +1,144 @@
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace zealous {
+#if ZEALOUS_TRACING
+    //--------------------------------------------------------------------------
+    struct TraceEvent {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    //--------------------------------------------------------------------------
+    // single producer ring, the owning thread writes the slot then publishes
+    // it by moving head
+    struct ThreadTrace {
+        std::vector<TraceEvent> events;
+        std::atomic<uint64_t> head;
+        std::atomic<const char*> name;
+        uint32_t id;
+    };
+
+    //--------------------------------------------------------------------------
+    // buffers outlive their threads, the last events of a thread that exited
+    // still make it to the trace
+    static std::mutex sThreadsMutex;
+    static std::vector<std::unique_ptr<ThreadTrace>> sThreads;
+    static const std::chrono::steady_clock::time_point sEpoch = std::chrono::steady_clock::now();
+
+    //--------------------------------------------------------------------------
+    static ThreadTrace& CurrentThread() {
+        thread_local ThreadTrace* thread = nullptr;
+        if ( thread == nullptr ) {
+            std::unique_ptr<ThreadTrace> created = std::make_unique<ThreadTrace>();
+            created->events.resize( Tracer::kEventsPerThread );
+            created->head = 0;
+            created->name = nullptr;
+
+            std::lock_guard<std::mutex> lock( sThreadsMutex );
+            created->id = ( uint32_t )sThreads.size() + 1;
+            thread = created.get();
+            sThreads.push_back( std::move( created ) );
+        }
+        return *thread;
+    }
+
+    //--------------------------------------------------------------------------
+    uint64_t Tracer::Now() {
+        return ( uint64_t )std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - sEpoch ).count();
+    }
+
+    //--------------------------------------------------------------------------
+    void Tracer::Record( const char* name, uint64_t start, uint64_t end ) {
+        ThreadTrace& thread = CurrentThread();
+        const uint64_t head = thread.head.load( std::memory_order_relaxed );
+        thread.events[head % kEventsPerThread] = TraceEvent{ name, start, end };
+        thread.head.store( head + 1, std::memory_order_release );
+    }
+
+    //--------------------------------------------------------------------------
+    void Tracer::SetThreadName( const char* name ) {
+        CurrentThread().name = name;
+    }
+
+    //--------------------------------------------------------------------------
+    static void WriteEscaped( std::ostream& stream, const char* text ) {
+        for ( ; *text; ++text ) {
+            if ( *text == '"' or *text == '\\' )
+                stream << '\\';
+            stream << *text;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    bool Tracer::Flush( const std::string& path ) {
+        std::ofstream file( path, std::ios::trunc );
+        if ( not file )
+            return false;
+
+        std::lock_guard<std::mutex> lock( sThreadsMutex );
+        file << std::fixed << std::setprecision( 3 ) << "{\"traceEvents\":[";
+        bool first = true;
+        std::vector<TraceEvent> copy;
+        for ( const std::unique_ptr<ThreadTrace>& thread : sThreads ) {
+            const char* threadName = thread->name;
+            if ( threadName != nullptr ) {
+                file << ( first ? "" : "," ) << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+                     << ",\"args\":{\"name\":\"";
+                WriteEscaped( file, threadName );
+                file << "\"}}";
+                first = false;
+            }
+
+            // the owner keeps writing meanwhile: copy, then keep only the
+            // events it could not have started overwriting during the copy
+            const uint64_t headBefore = thread->head.load( std::memory_order_acquire );
+            const uint64_t begin = headBefore > kEventsPerThread ? headBefore - kEventsPerThread : 0;
+            copy.clear();
+            for ( uint64_t i = begin; i < headBefore; ++i )
+                copy.push_back( thread->events[i % kEventsPerThread] );
+            const uint64_t headAfter = thread->head.load( std::memory_order_acquire );
+            const uint64_t firstValid = headAfter >= kEventsPerThread ? headAfter - kEventsPerThread + 1 : 0;
+
+            for ( uint64_t i = std::max( begin, firstValid ); i < headBefore; ++i ) {
+                const TraceEvent& event = copy[i - begin];
+                file << ( first ? "" : "," ) << "\n{\"name\":\"";
+                WriteEscaped( file, event.name );
+                file << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id
+                     << ",\"ts\":" << event.start / 1000.0
+                     << ",\"dur\":" << ( event.end - event.start ) / 1000.0 << "}";
+                first = false;
+            }
+        }
+        file << "\n]}\n";
+        return !!file;
+    }
+#else
+    //--------------------------------------------------------------------------
+    uint64_t Tracer::Now() {
+        return 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void Tracer::Record( const char* name, uint64_t start, uint64_t end ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void Tracer::SetThreadName( const char* name ) {
+    }
+
+    //--------------------------------------------------------------------------
+    bool Tracer::Flush( const std::string& path ) {
+        return false;
+    }
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//--------------------------------------------------------------------------
+// Build with ZEALOUS_TRACING=0 and the TRACE_ macros compile to nothing.
+#ifndef ZEALOUS_TRACING
+#define ZEALOUS_TRACING 1
+#endif
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Scoped CPU events in per-thread ring buffers. Recording an event is two
+    // clock reads and a few stores in a buffer only its thread writes, Flush
+    // may run concurrently from any thread and writes the latest events of
+    // every thread as Chrome trace JSON ( chrome://tracing, ui.perfetto.dev ).
+    class Tracer {
+      public:
+        static constexpr uint32_t kEventsPerThread = 1 << 16;
+
+        static uint64_t Now();
+        // name must outlive the tracer, string literals are what's expected
+        static void Record( const char* name, uint64_t start, uint64_t end );
+        static void SetThreadName( const char* name );
+
+        static bool Flush( const std::string& path );
+    };
+
+    //--------------------------------------------------------------------------
+    class TraceScope {
+      public:
+        explicit TraceScope( const char* name )
+            : name( name )
+            , start( Tracer::Now() ) {
+        }
+        ~TraceScope() { Tracer::Record( name, start, Tracer::Now() ); }
+
+        TraceScope( const TraceScope& ) = delete;
+        TraceScope& operator=( const TraceScope& ) = delete;
+
+      private:
+        const char* name;
+        uint64_t start;
+    };
+}
+
+#if ZEALOUS_TRACING
+#define ZEALOUS_TRACE_CONCAT_( a, b ) a##b
+#define ZEALOUS_TRACE_CONCAT( a, b ) ZEALOUS_TRACE_CONCAT_( a, b )
+#define TRACE_SCOPE( name ) ::zealous::TraceScope ZEALOUS_TRACE_CONCAT( traceScope, __LINE__ )( name )
+#define TRACE_THREAD_NAME( name ) ::zealous::Tracer::SetThreadName( name )
+#else
+#define TRACE_SCOPE( name ) do {} while ( false )
+#define TRACE_THREAD_NAME( name ) do {} while ( false )
+#endif
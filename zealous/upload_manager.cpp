@@ -0,0 +1,398 @@
+#include "upload_manager.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    UploadManager::UploadManager()
+        : transferFamily( uint32_t( -1 ) )
+        , graphicsFamily( uint32_t( -1 ) )
+        , ringSize      ( 0 )
+        , ringHead      ( 0 )
+        , ringTail      ( 0 )
+        , copyAlignment ( 16 )
+        , nextToken     ( 1 )
+        , completedToken( 0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::Init( std::shared_ptr<VulkanContext> context, vk::DeviceSize stagingSize ) {
+        this->context = context;
+        const vk::Device& device = context->Device();
+        transferFamily = context->TransferQueueFamilyIndex();
+        graphicsFamily = context->GraphicsQueueFamilyIndex();
+
+        // buffer to image copies want offsets aligned on the texel size, and
+        // the device may want more for speed
+        const vk::DeviceSize optimalAlignment = context->PhysicalDeviceProperties().limits.optimalBufferCopyOffsetAlignment;
+        copyAlignment = std::max<vk::DeviceSize>( 16, optimalAlignment );
+
+        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive )
+                                          .setSize( stagingSize )
+                                          .setUsage( vk::BufferUsageFlagBits::eTransferSrc );
+        ringBuffer = device.createBuffer( createInfo );
+
+        const MemoryUsage usage = { vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlags() };
+        ringMemory = context->Allocator().AllocateBuffer( ringBuffer, usage );
+        ringSize = stagingSize;
+        ringHead = 0;
+        ringTail = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::DeInit() {
+        const vk::Device& device = context->Device();
+
+        Flush();
+        while ( not inFlight.empty() )
+            WaitOldest();
+
+        auto destroyBatch = [&device]( const std::unique_ptr<Batch>& batch ) {
+            device.destroyCommandPool( batch->commandPool );
+            device.destroyFence( batch->fence );
+            device.destroySemaphore( batch->semaphore );
+        };
+        for ( const auto& batch : spareBatches )
+            destroyBatch( batch );
+        spareBatches.clear();
+        for ( const auto& batch : awaitingGraphicsBatches )
+            destroyBatch( batch );
+        awaitingGraphicsBatches.clear();
+        if ( recording ) {
+            destroyBatch( recording );
+            recording.reset();
+        }
+
+        device.destroyBuffer( ringBuffer );
+        context->Allocator().Free( ringMemory );
+        context.reset();
+    }
+
+    //--------------------------------------------------------------------------
+    std::unique_ptr<UploadManager::Batch> UploadManager::NewBatch() {
+        if ( not spareBatches.empty() ) {
+            std::unique_ptr<Batch> batch = std::move( spareBatches.back() );
+            spareBatches.pop_back();
+            return batch;
+        }
+
+        const vk::Device& device = context->Device();
+        std::unique_ptr<Batch> batch = std::make_unique<Batch>();
+
+        vk::CommandPoolCreateInfo poolInfo = vk::CommandPoolCreateInfo()
+                                             .setQueueFamilyIndex( transferFamily )
+                                             .setFlags( vk::CommandPoolCreateFlagBits::eTransient );
+        batch->commandPool = device.createCommandPool( poolInfo );
+
+        vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+                .setCommandPool( batch->commandPool )
+                .setLevel( vk::CommandBufferLevel::ePrimary )
+                .setCommandBufferCount( 1 );
+        batch->commandBuffer = device.allocateCommandBuffers( allocInfo )[0];
+        batch->fence = device.createFence( vk::FenceCreateInfo() );
+        batch->semaphore = device.createSemaphore( vk::SemaphoreCreateInfo() );
+        return batch;
+    }
+
+    //--------------------------------------------------------------------------
+    UploadManager::Batch& UploadManager::CurrentBatch() {
+        if ( not recording ) {
+            recording = NewBatch();
+            recording->token = nextToken++;
+            recording->ringEnd = ringHead;
+            recording->awaitingGraphics = false;
+
+            vk::CommandBufferBeginInfo info = vk::CommandBufferBeginInfo()
+                                              .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
+            recording->commandBuffer.begin( info );
+        }
+        return *recording;
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::Collect() {
+        const vk::Device& device = context->Device();
+        while ( not inFlight.empty() ) {
+            std::unique_ptr<Batch>& batch = inFlight.front();
+            if ( device.getFenceStatus( batch->fence ) != vk::Result::eSuccess )
+                break;
+
+            for ( auto& staging : batch->dedicatedStaging ) {
+                device.destroyBuffer( staging.first );
+                context->Allocator().Free( staging.second );
+            }
+            batch->dedicatedStaging.clear();
+            ringTail = batch->ringEnd;
+            completedToken = batch->token;
+
+            device.resetFences( batch->fence );
+            device.resetCommandPool( batch->commandPool, vk::CommandPoolResetFlags() );
+
+            // its semaphore can't be signaled again before the graphics side
+            // has submitted the wait on it
+            if ( batch->awaitingGraphics )
+                awaitingGraphicsBatches.push_back( std::move( batch ) );
+            else
+                spareBatches.push_back( std::move( batch ) );
+            inFlight.pop_front();
+        }
+
+        // nothing left in the ring, start over from the beginning
+        if ( inFlight.empty() and not recording )
+            ringHead = ringTail = 0;
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::WaitOldest() {
+        assert( not inFlight.empty() );
+        const vk::Device& device = context->Device();
+        device.waitForFences( inFlight.front()->fence, true, std::numeric_limits<uint64_t>::max() );
+        Collect();
+    }
+
+    //--------------------------------------------------------------------------
+    bool UploadManager::ReserveRing( vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset ) {
+        // used space is [tail, head) possibly wrapping around the end, head
+        // never catches up with tail so that head == tail means empty
+        const vk::DeviceSize aligned = ( ringHead + alignment - 1 ) / alignment * alignment;
+        if ( ringHead >= ringTail ) {
+            if ( aligned + size <= ringSize ) {
+                offset = aligned;
+                ringHead = aligned + size;
+                return true;
+            }
+            if ( size < ringTail ) {
+                offset = 0;
+                ringHead = size;
+                return true;
+            }
+            return false;
+        }
+
+        if ( aligned + size < ringTail ) {
+            offset = aligned;
+            ringHead = aligned + size;
+            return true;
+        }
+        return false;
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::Stage( const void* data, vk::DeviceSize size, vk::Buffer& stagingBuffer, vk::DeviceSize& stagingOffset ) {
+        Collect();
+        if ( size <= ringSize / 2 ) {
+            bool reserved = ReserveRing( size, copyAlignment, stagingOffset );
+            while ( not reserved ) {
+                // ring full, make room by retiring the oldest uploads
+                if ( inFlight.empty() )
+                    Flush();
+                if ( inFlight.empty() )
+                    break;
+                WaitOldest();
+                reserved = ReserveRing( size, copyAlignment, stagingOffset );
+            }
+
+            if ( reserved ) {
+                std::memcpy( static_cast<char*>( ringMemory.mapped ) + stagingOffset, data, ( size_t )size );
+                stagingBuffer = ringBuffer;
+                CurrentBatch().ringEnd = ringHead;
+                return;
+            }
+        }
+
+        // too large for the ring, use a staging buffer of its own freed with the batch
+        const vk::Device& device = context->Device();
+        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive )
+                                          .setSize( size )
+                                          .setUsage( vk::BufferUsageFlagBits::eTransferSrc );
+        stagingBuffer = device.createBuffer( createInfo );
+        const MemoryUsage usage = { vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, vk::MemoryPropertyFlags() };
+        Allocation allocation = context->Allocator().AllocateBuffer( stagingBuffer, usage );
+        std::memcpy( allocation.mapped, data, ( size_t )size );
+        stagingOffset = 0;
+
+        Batch& batch = CurrentBatch();
+        batch.ringEnd = ringHead;
+        batch.dedicatedStaging.push_back( std::make_pair( stagingBuffer, allocation ) );
+    }
+
+    //--------------------------------------------------------------------------
+    UploadToken UploadManager::UploadBuffer( const vk::Buffer& buffer, vk::DeviceSize offset, const void* data, vk::DeviceSize size,
+            vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess ) {
+        vk::Buffer stagingBuffer;
+        vk::DeviceSize stagingOffset;
+        Stage( data, size, stagingBuffer, stagingOffset );
+
+        Batch& batch = CurrentBatch();
+        const vk::CommandBuffer& commandBuffer = batch.commandBuffer;
+        commandBuffer.copyBuffer( stagingBuffer, buffer, vk::BufferCopy( stagingOffset, offset, size ) );
+
+        if ( OwnershipTransfer() ) {
+            // release on the transfer family, the graphics side acquires it
+            // with the very same barrier
+            vk::BufferMemoryBarrier barrier = vk::BufferMemoryBarrier()
+                                              .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+                                              .setDstAccessMask( dstAccess )
+                                              .setSrcQueueFamilyIndex( transferFamily )
+                                              .setDstQueueFamilyIndex( graphicsFamily )
+                                              .setBuffer( buffer )
+                                              .setOffset( offset )
+                                              .setSize( size );
+            commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                           vk::DependencyFlags(), nullptr, barrier, nullptr );
+            batchBufferAcquires.push_back( barrier );
+            batchAcquireStages |= dstStage;
+        } else {
+            vk::BufferMemoryBarrier barrier = vk::BufferMemoryBarrier()
+                                              .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+                                              .setDstAccessMask( dstAccess )
+                                              .setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                              .setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                              .setBuffer( buffer )
+                                              .setOffset( offset )
+                                              .setSize( size );
+            commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, dstStage,
+                                           vk::DependencyFlags(), nullptr, barrier, nullptr );
+        }
+        return batch.token;
+    }
+
+    //--------------------------------------------------------------------------
+    UploadToken UploadManager::UploadImage( const vk::Image& image, const vk::Extent3D& extent, const void* data, vk::DeviceSize size,
+                                            vk::ImageLayout finalLayout, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess ) {
+        vk::Buffer stagingBuffer;
+        vk::DeviceSize stagingOffset;
+        Stage( data, size, stagingBuffer, stagingOffset );
+
+        Batch& batch = CurrentBatch();
+        const vk::CommandBuffer& commandBuffer = batch.commandBuffer;
+
+        vk::ImageSubresourceRange subresourceRange = vk::ImageSubresourceRange()
+                .setAspectMask( vk::ImageAspectFlagBits::eColor )
+                .setBaseMipLevel( 0 )
+                .setLevelCount( 1 )
+                .setBaseArrayLayer( 0 )
+                .setLayerCount( 1 );
+
+        vk::ImageMemoryBarrier toTransfer = vk::ImageMemoryBarrier()
+                                            .setSrcAccessMask( vk::AccessFlags() )
+                                            .setDstAccessMask( vk::AccessFlagBits::eTransferWrite )
+                                            .setOldLayout( vk::ImageLayout::eUndefined )
+                                            .setNewLayout( vk::ImageLayout::eTransferDstOptimal )
+                                            .setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                            .setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+                                            .setImage( image )
+                                            .setSubresourceRange( subresourceRange );
+        commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                                       vk::DependencyFlags(), nullptr, nullptr, toTransfer );
+
+        vk::BufferImageCopy region = vk::BufferImageCopy()
+                                     .setBufferOffset( stagingOffset )
+                                     .setImageSubresource( vk::ImageSubresourceLayers( vk::ImageAspectFlagBits::eColor, 0, 0, 1 ) )
+                                     .setImageExtent( extent );
+        commandBuffer.copyBufferToImage( stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, region );
+
+        vk::ImageMemoryBarrier toFinal = vk::ImageMemoryBarrier()
+                                         .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+                                         .setDstAccessMask( dstAccess )
+                                         .setOldLayout( vk::ImageLayout::eTransferDstOptimal )
+                                         .setNewLayout( finalLayout )
+                                         .setImage( image )
+                                         .setSubresourceRange( subresourceRange );
+        if ( OwnershipTransfer() ) {
+            toFinal.setSrcQueueFamilyIndex( transferFamily );
+            toFinal.setDstQueueFamilyIndex( graphicsFamily );
+            commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+                                           vk::DependencyFlags(), nullptr, nullptr, toFinal );
+            batchImageAcquires.push_back( toFinal );
+            batchAcquireStages |= dstStage;
+        } else {
+            toFinal.setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+            toFinal.setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED );
+            commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer, dstStage,
+                                           vk::DependencyFlags(), nullptr, nullptr, toFinal );
+        }
+        return batch.token;
+    }
+
+    //--------------------------------------------------------------------------
+    UploadToken UploadManager::Flush() {
+        if ( not recording )
+            return nextToken - 1;
+
+        std::unique_ptr<Batch> batch = std::move( recording );
+        batch->commandBuffer.end();
+
+        // the semaphore is only needed when another queue picks the data up,
+        // on a shared queue submission order is enough
+        vk::SubmitInfo submitInfo = vk::SubmitInfo()
+                                    .setCommandBufferCount( 1 )
+                                    .setPCommandBuffers( &batch->commandBuffer );
+        if ( OwnershipTransfer() ) {
+            submitInfo.setSignalSemaphoreCount( 1 );
+            submitInfo.setPSignalSemaphores( &batch->semaphore );
+            pendingSemaphores.push_back( batch->semaphore );
+            batch->awaitingGraphics = true;
+        }
+        context->TransferQueue().submit( submitInfo, batch->fence );
+
+        pendingBufferAcquires.insert( pendingBufferAcquires.end(), batchBufferAcquires.begin(), batchBufferAcquires.end() );
+        pendingImageAcquires.insert( pendingImageAcquires.end(), batchImageAcquires.begin(), batchImageAcquires.end() );
+        pendingAcquireStages |= batchAcquireStages;
+        batchBufferAcquires.clear();
+        batchImageAcquires.clear();
+        batchAcquireStages = vk::PipelineStageFlags();
+
+        const UploadToken token = batch->token;
+        inFlight.push_back( std::move( batch ) );
+        return token;
+    }
+
+    //--------------------------------------------------------------------------
+    bool UploadManager::IsComplete( UploadToken token ) {
+        Collect();
+        return completedToken >= token;
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::Wait( UploadToken token ) {
+        if ( recording and recording->token <= token )
+            Flush();
+        while ( completedToken < token and not inFlight.empty() )
+            WaitOldest();
+    }
+
+    //--------------------------------------------------------------------------
+    void UploadManager::AcquireOnGraphics( const vk::CommandBuffer& commandBuffer, std::vector<vk::Semaphore>& waitSemaphores,
+                                           std::vector<vk::PipelineStageFlags>& waitStages ) {
+        if ( pendingSemaphores.empty() )
+            return;
+
+        // the semaphore wait gates the destination stages, the acquire barriers
+        // chain on those same stages
+        const vk::PipelineStageFlags stages = pendingAcquireStages ? pendingAcquireStages : vk::PipelineStageFlags( vk::PipelineStageFlagBits::eTopOfPipe );
+        if ( not pendingBufferAcquires.empty() or not pendingImageAcquires.empty() ) {
+            commandBuffer.pipelineBarrier( stages, stages, vk::DependencyFlags(), nullptr,
+                                           pendingBufferAcquires, pendingImageAcquires );
+        }
+
+        for ( const vk::Semaphore& semaphore : pendingSemaphores ) {
+            waitSemaphores.push_back( semaphore );
+            waitStages.push_back( stages );
+        }
+
+        pendingSemaphores.clear();
+        for ( auto& batch : inFlight )
+            batch->awaitingGraphics = false;
+        for ( auto& batch : awaitingGraphicsBatches )
+            spareBatches.push_back( std::move( batch ) );
+        awaitingGraphicsBatches.clear();
+        pendingBufferAcquires.clear();
+        pendingImageAcquires.clear();
+        pendingAcquireStages = vk::PipelineStageFlags();
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "memory_allocator.hpp"
+#include "vulkan_context.hpp"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // Identifies the batch an upload was recorded in, poll it with IsComplete.
+    using UploadToken = uint64_t;
+
+    //--------------------------------------------------------------------------
+    // Streams data to device local buffers and images through a persistently
+    // mapped staging ring. Copies run on the transfer-only queue when the
+    // device has one, ownership is handed back to the graphics family with
+    // release / acquire barriers and a semaphore the next graphics submit
+    // waits on.
+    class UploadManager {
+      public:
+        UploadManager();
+
+        void Init( std::shared_ptr<VulkanContext> context, vk::DeviceSize stagingSize = 16 * 1024 * 1024 );
+        void DeInit();
+
+        // dstStage / dstAccess describe the first use on the graphics queue
+        UploadToken UploadBuffer( const vk::Buffer& buffer, vk::DeviceSize offset, const void* data, vk::DeviceSize size,
+                                  vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess );
+        UploadToken UploadImage( const vk::Image& image, const vk::Extent3D& extent, const void* data, vk::DeviceSize size,
+                                 vk::ImageLayout finalLayout, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess );
+
+        // submits everything recorded so far, returns the token of that batch
+        UploadToken Flush();
+
+        bool IsComplete( UploadToken token );
+        void Wait( UploadToken token );
+
+        // to be called by the graphics side for its next submit: records the
+        // ownership acquire barriers of the flushed batches in commandBuffer and
+        // appends the semaphores that submit has to wait on
+        void AcquireOnGraphics( const vk::CommandBuffer& commandBuffer, std::vector<vk::Semaphore>& waitSemaphores,
+                                std::vector<vk::PipelineStageFlags>& waitStages );
+
+      private:
+        struct Batch {
+            UploadToken token;
+            vk::CommandPool commandPool;
+            vk::CommandBuffer commandBuffer;
+            vk::Fence fence;
+            vk::Semaphore semaphore;
+            vk::DeviceSize ringEnd;
+            // the semaphore was signaled for the graphics queue, which hasn't
+            // submitted the matching wait yet
+            bool awaitingGraphics;
+            std::vector<std::pair<vk::Buffer, Allocation>> dedicatedStaging;
+        };
+
+        bool OwnershipTransfer() const { return transferFamily != graphicsFamily; }
+
+        Batch& CurrentBatch();
+        std::unique_ptr<Batch> NewBatch();
+        void Collect();
+        void WaitOldest();
+        bool ReserveRing( vk::DeviceSize size, vk::DeviceSize alignment, vk::DeviceSize& offset );
+        void Stage( const void* data, vk::DeviceSize size, vk::Buffer& stagingBuffer, vk::DeviceSize& stagingOffset );
+
+        std::shared_ptr<VulkanContext> context;
+        uint32_t transferFamily;
+        uint32_t graphicsFamily;
+
+        vk::Buffer ringBuffer;
+        Allocation ringMemory;
+        vk::DeviceSize ringSize;
+        vk::DeviceSize ringHead;
+        vk::DeviceSize ringTail;
+        vk::DeviceSize copyAlignment;
+
+        UploadToken nextToken;
+        UploadToken completedToken;
+        std::unique_ptr<Batch> recording;
+        std::deque<std::unique_ptr<Batch>> inFlight;
+        std::vector<std::unique_ptr<Batch>> spareBatches;
+        std::vector<std::unique_ptr<Batch>> awaitingGraphicsBatches;
+
+        std::vector<vk::BufferMemoryBarrier> pendingBufferAcquires;
+        std::vector<vk::ImageMemoryBarrier> pendingImageAcquires;
+        vk::PipelineStageFlags pendingAcquireStages;
+        std::vector<vk::BufferMemoryBarrier> batchBufferAcquires;
+        std::vector<vk::ImageMemoryBarrier> batchImageAcquires;
+        vk::PipelineStageFlags batchAcquireStages;
+        std::vector<vk::Semaphore> pendingSemaphores;
+    };
+}
@@ -0,0 +1,54 @@
+#include "vertex_layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined( __SSE2__ ) or defined( _M_X64 ) or ( defined( _M_IX86_FP ) and _M_IX86_FP >= 2 )
+#define ZEALOUS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    void EncodeSnorm16( const float* source, int16_t* destination, size_t count ) {
+        size_t i = 0;
+#if defined( ZEALOUS_SSE2 )
+        // the conversion rounds to nearest even, packing saturates
+        const __m128 lower = _mm_set1_ps( -1.f );
+        const __m128 upper = _mm_set1_ps( 1.f );
+        const __m128 scale = _mm_set1_ps( 32767.f );
+        for ( ; i + 8 <= count; i += 8 ) {
+            const __m128 a = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( source + i ), lower ), upper );
+            const __m128 b = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( source + i + 4 ), lower ), upper );
+            const __m128i packed = _mm_packs_epi32( _mm_cvtps_epi32( _mm_mul_ps( a, scale ) ),
+                                                    _mm_cvtps_epi32( _mm_mul_ps( b, scale ) ) );
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( destination + i ), packed );
+        }
+#endif
+        for ( ; i < count; ++i )
+            destination[i] = ( int16_t )std::nearbyint( std::min( std::max( source[i], -1.f ), 1.f ) * 32767.f );
+    }
+
+    //--------------------------------------------------------------------------
+    void EncodeUnorm8( const float* source, uint8_t* destination, size_t count ) {
+        size_t i = 0;
+#if defined( ZEALOUS_SSE2 )
+        const __m128 lower = _mm_setzero_ps();
+        const __m128 upper = _mm_set1_ps( 1.f );
+        const __m128 scale = _mm_set1_ps( 255.f );
+        for ( ; i + 16 <= count; i += 16 ) {
+            __m128i words[2];
+            for ( uint32_t half = 0; half < 2; ++half ) {
+                const float* block = source + i + half * 8;
+                const __m128 a = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( block ), lower ), upper );
+                const __m128 b = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( block + 4 ), lower ), upper );
+                words[half] = _mm_packs_epi32( _mm_cvtps_epi32( _mm_mul_ps( a, scale ) ),
+                                               _mm_cvtps_epi32( _mm_mul_ps( b, scale ) ) );
+            }
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( destination + i ), _mm_packus_epi16( words[0], words[1] ) );
+        }
+#endif
+        for ( ; i < count; ++i )
+            destination[i] = ( uint8_t )std::nearbyint( std::min( std::max( source[i], 0.f ), 1.f ) * 255.f );
+    }
+}
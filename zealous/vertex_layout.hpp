@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // What a vertex attribute is stored as, N components of type T the device
+    // reads through format F
+    template <typename T, uint32_t N, vk::Format F>
+    struct VertexFormat {
+        using Component = T;
+        using Element = std::array<T, N>;
+        static constexpr uint32_t kComponentCount = N;
+        static constexpr vk::Format kFormat = F;
+        static constexpr uint32_t kSize = sizeof( T ) * N;
+        static_assert( sizeof( Element ) == kSize );
+    };
+
+    using Float2 = VertexFormat<float, 2, vk::Format::eR32G32Sfloat>;
+    using Float4 = VertexFormat<float, 4, vk::Format::eR32G32B32A32Sfloat>;
+    // read back as floats in [-1, 1]
+    using Snorm16x2 = VertexFormat<int16_t, 2, vk::Format::eR16G16Snorm>;
+    using Snorm16x4 = VertexFormat<int16_t, 4, vk::Format::eR16G16B16A16Snorm>;
+    // read back as floats in [0, 1]
+    using Unorm8x4 = VertexFormat<uint8_t, 4, vk::Format::eR8G8B8A8Unorm>;
+
+    //--------------------------------------------------------------------------
+    // shader location, the stream it's fetched from, and its format
+    template <uint32_t Location, uint32_t Stream, typename Format>
+    struct VertexAttribute {
+        static constexpr uint32_t kLocation = Location;
+        static constexpr uint32_t kStream = Stream;
+        using AttributeFormat = Format;
+    };
+
+    //--------------------------------------------------------------------------
+    // A vertex as attributes split over streams, each stream its own tightly
+    // packed vertex buffer bound at the binding of the same index. Attributes
+    // sit in their stream in declaration order. Passes that only need some
+    // streams, positions for a depth or shadow pass, build their pipeline
+    // from those and fetch nothing else.
+    template <typename... Attributes>
+    class VertexLayout {
+      public:
+        static constexpr uint32_t kAttributeCount = sizeof...( Attributes );
+        static_assert( kAttributeCount != 0 );
+        static constexpr std::array<uint32_t, kAttributeCount> kLocations = { Attributes::kLocation... };
+        static constexpr std::array<uint32_t, kAttributeCount> kStreams = { Attributes::kStream... };
+        static constexpr std::array<uint32_t, kAttributeCount> kSizes = { Attributes::AttributeFormat::kSize... };
+        static constexpr std::array<vk::Format, kAttributeCount> kFormats = { Attributes::AttributeFormat::kFormat... };
+        static constexpr uint32_t kStreamCount = std::max( { Attributes::kStream... } ) + 1;
+        static constexpr uint32_t kAllStreams = ( 1u << kStreamCount ) - 1;
+
+        // bytes per vertex in a stream
+        static constexpr uint32_t Stride( uint32_t stream ) {
+            uint32_t stride = 0;
+            for ( uint32_t i = 0; i < kAttributeCount; ++i )
+                stride += kStreams[i] == stream ? kSizes[i] : 0;
+            return stride;
+        }
+
+        // of the attribute at that location, within its stream
+        static constexpr uint32_t Offset( uint32_t location ) {
+            const uint32_t index = IndexOf( location );
+            uint32_t offset = 0;
+            for ( uint32_t i = 0; i < index; ++i )
+                offset += kStreams[i] == kStreams[index] ? kSizes[i] : 0;
+            return offset;
+        }
+
+        static std::vector<vk::VertexInputBindingDescription> Bindings( uint32_t streamMask = kAllStreams ) {
+            std::vector<vk::VertexInputBindingDescription> bindings;
+            for ( uint32_t stream = 0; stream < kStreamCount; ++stream ) {
+                if ( ( streamMask & ( 1u << stream ) ) != 0 and Stride( stream ) != 0 )
+                    bindings.push_back( vk::VertexInputBindingDescription( stream, Stride( stream ), vk::VertexInputRate::eVertex ) );
+            }
+            return bindings;
+        }
+
+        static std::vector<vk::VertexInputAttributeDescription> AttributeDescriptions( uint32_t streamMask = kAllStreams ) {
+            static_assert( UniqueLocations(), "two attributes share a location" );
+            std::vector<vk::VertexInputAttributeDescription> attributes;
+            for ( uint32_t i = 0; i < kAttributeCount; ++i ) {
+                if ( ( streamMask & ( 1u << kStreams[i] ) ) != 0 )
+                    attributes.push_back( vk::VertexInputAttributeDescription( kLocations[i], kStreams[i], kFormats[i], Offset( kLocations[i] ) ) );
+            }
+            return attributes;
+        }
+
+      private:
+        static constexpr uint32_t IndexOf( uint32_t location ) {
+            for ( uint32_t i = 0; i < kAttributeCount; ++i ) {
+                if ( kLocations[i] == location )
+                    return i;
+            }
+            return kAttributeCount;
+        }
+
+        static constexpr bool UniqueLocations() {
+            for ( uint32_t i = 0; i < kAttributeCount; ++i ) {
+                if ( IndexOf( kLocations[i] ) != i )
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    //--------------------------------------------------------------------------
+    // Float data to what the formats store, count components rather than
+    // vertices. Clamped and rounded to nearest like the device expects, with
+    // SSE2 where there is: 8 components at a time to snorm16, 16 to unorm8.
+    void EncodeSnorm16( const float* source, int16_t* destination, size_t count );
+    void EncodeUnorm8( const float* source, uint8_t* destination, size_t count );
+}
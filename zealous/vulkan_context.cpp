@@ -5,8 +5,19 @@
 namespace zealous {
     //--------------------------------------------------------------------------
     VulkanContext::VulkanContext()
-        : presentQueueFamilyIndex( -1 )
+        : headless( false )
+        , presentQueueFamilyIndex( -1 )
         , graphicsQueueFamilyIndex( -1 )
+        , transferQueueFamilyIndex( -1 )
+        , computeQueueFamilyIndex( -1 )
+        , presentPolicy( zealous::PresentPolicy::eVsync )
+        , presentMode  ( vk::PresentModeKHR::eFifo )
+        , framesInFlight( 2 )
+        , currentFrame  ( 0 )
+        , frameSerials  ( 2, 0 )
+        , submittedFrameSerial( 0 )
+        , completedFrameSerial( 0 )
+        , swapchainOutOfDate  ( false )
         , width ( 0 )
         , height( 0 ) {
     }
@@ -24,4 +35,9 @@ namespace zealous {
     std::vector<vk::SurfaceFormatKHR> VulkanContext::SurfaceFormats( const vk::SurfaceKHR& surface ) const {
         return physicalDevice.getSurfaceFormatsKHR( surface );
     }
+
+    //--------------------------------------------------------------------------
+    std::vector<vk::PresentModeKHR> VulkanContext::SurfacePresentModes( const vk::SurfaceKHR& surface ) const {
+        return physicalDevice.getSurfacePresentModesKHR( surface );
+    }
 }
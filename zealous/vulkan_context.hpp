@@ -1,10 +1,25 @@
 #pragma once
 
+#include "deletion_queue.hpp"
+#include "memory_allocator.hpp"
+#include "pipeline_cache.hpp"
+
+#include <algorithm>
 #include <vulkan/vulkan.hpp>
 
 struct SDL_Window;
 
 namespace zealous {
+    //--------------------------------------------------------------------------
+    // how the swapchain trades latency, tearing and throughput, each policy
+    // falls back on what the surface supports
+    enum class PresentPolicy {
+        eThroughput,    // mailbox, triple buffered
+        eLowLatency,    // immediate, or mailbox with 2 images
+        eVsync,         // fifo
+        eAdaptiveVsync  // fifo relaxed, tears only when a frame is late
+    };
+
     //--------------------------------------------------------------------------
     class VulkanContext {
       public:
@@ -16,29 +31,78 @@ namespace zealous {
         int WindowWidth() const { return width; }
         int WindowHeight() const { return height; }
 
+        // no window, surface nor swapchain: frames render into offscreen images
+        // of WindowWidth() x WindowHeight() that are never presented
+        bool Headless() const { return headless; }
+
         const vk::Instance& Instance() const { return instance; }
         const vk::SurfaceKHR& WindowSurface() const { return windowSurface; }
         const vk::PhysicalDevice& PhysicalDevice() const { return physicalDevice; }
+        const vk::PhysicalDeviceProperties& PhysicalDeviceProperties() const { return physicalDeviceProperties; }
         const vk::PhysicalDeviceMemoryProperties& PhysicalDeviceMemoryProperties() const { return physicalDeviceMemoryProperties; }
+        const vk::PhysicalDeviceFeatures& EnabledFeatures() const { return enabledFeatures; }
         const vk::Device& Device() const { return device; }
+        MemoryAllocator& Allocator() { return allocator; }
+        PersistentPipelineCache& PipelineCache() { return pipelineCache; }
         const vk::Queue& PresentQueue() const { return presentQueue; }
         const vk::Queue& GraphicsQueue() const { return graphicsQueue; }
-        const vk::Semaphore& ImageAvailableSemaphore() const { return imageAvailableSemaphore; }
-        const vk::Semaphore& DoneRenderingSemaphore() const { return doneRenderingSemaphore; }
+        const vk::Queue& TransferQueue() const { return transferQueue; }
+        const vk::Queue& ComputeQueue() const { return computeQueue; }
+        const std::vector<vk::Semaphore>& ImageAvailableSemaphores() const { return imageAvailableSemaphores; }
+        const std::vector<vk::Semaphore>& DoneRenderingSemaphores() const { return doneRenderingSemaphores; }
         const vk::SwapchainKHR& Swapchain() const { return swapchain; }
+        const vk::Format& SwapchainFormat() const { return swapchainFormat; }
         const std::vector<vk::Image>& SwapchainImages() const { return swapchainImages; }
-        const vk::CommandPool& CommandPool() const { return commandPool; }
+        const std::vector<vk::ImageView>& SwapchainImageViews() const { return swapchainImageViews; }
+        // backing the swapchain images when headless, empty otherwise
+        const std::vector<Allocation>& OffscreenMemory() const { return offscreenMemory; }
+        const vk::RenderPass& RenderPass() const { return renderPass; }
+        const std::vector<vk::Framebuffer>& Framebuffers() const { return framebuffers; }
+        const std::vector<vk::CommandPool>& CommandPools() const { return commandPools; }
         const std::vector<vk::CommandBuffer>& CommandBuffers() const { return commandBuffers; }
         const std::vector<vk::Fence>& Fences() const { return fences; }
+        const std::vector<vk::Fence>& ImageFences() const { return imageFences; }
+
+        // frames in flight are decoupled from the swapchain image count, every
+        // per-frame object ( semaphores, fences, command pools and buffers ) is indexed by CurrentFrame()
+        uint32_t FramesInFlight() const { return framesInFlight; }
+        uint32_t CurrentFrame() const { return currentFrame; }
+        void AdvanceFrame() { currentFrame = ( currentFrame + 1 ) % framesInFlight; }
+
+        // monotonic frame serials, an object last used by frame S can be
+        // destroyed as soon as CompletedFrameSerial() >= S, without any wait
+        uint64_t SubmittedFrameSerial() const { return submittedFrameSerial; }
+        uint64_t CompletedFrameSerial() const { return completedFrameSerial; }
+        void MarkFrameSubmitted( uint32_t frame ) { frameSerials[frame] = ++submittedFrameSerial; }
+        void MarkFrameCompleted( uint32_t frame ) { completedFrameSerial = std::max( completedFrameSerial, frameSerials[frame] ); }
+
+        // set by out-of-date / suboptimal results and window events, the
+        // swapchain is only rebuilt when this is raised
+        bool SwapchainOutOfDate() const { return swapchainOutOfDate; }
+        void SetSwapchainOutOfDate( bool outOfDate ) { swapchainOutOfDate = outOfDate; }
+
+        // retire with SubmittedFrameSerial(), collected with CompletedFrameSerial()
+        DeletionQueue& Deletions() { return deletionQueue; }
 
         vk::SurfaceCapabilitiesKHR SurfaceCapabilities( const vk::SurfaceKHR& surface ) const;
         std::vector<vk::SurfaceFormatKHR> SurfaceFormats( const vk::SurfaceKHR& surface ) const;
+        std::vector<vk::PresentModeKHR> SurfacePresentModes( const vk::SurfaceKHR& surface ) const;
+
+        // requested policy, and the present mode it resolved to on the current swapchain
+        zealous::PresentPolicy PresentPolicy() const { return presentPolicy; }
+        vk::PresentModeKHR PresentMode() const { return presentMode; }
 
         uint32_t PresentQueueFamilyIndex() const { return presentQueueFamilyIndex; }
         uint32_t GraphicsQueueFamilyIndex() const { return graphicsQueueFamilyIndex; }
+        // same as the graphics family when the device has no transfer-only family
+        uint32_t TransferQueueFamilyIndex() const { return transferQueueFamilyIndex; }
+        // a compute-only family when the device has one, so dispatches run
+        // alongside rendering; the graphics family otherwise
+        uint32_t ComputeQueueFamilyIndex() const { return computeQueueFamilyIndex; }
 
         const vk::DebugReportCallbackEXT& DebugReportCallback() const { return debugReportCallback; }
 
+        void SetHeadless( bool headless ) { this->headless = headless; }
         void SetSDLWindow( SDL_Window* sdlWindow ) { window = sdlWindow; }
         void SetWindowWidth( int width ) { this->width = width; }
         void SetWindowHeight( int height ) { this->height = height; }
@@ -47,38 +111,78 @@ namespace zealous {
         void SetWindowSurface( const vk::SurfaceKHR& windowSurface ) { this->windowSurface = windowSurface; }
         void SetPresentQueueFamilyIndex( uint32_t familyIndex ) { this->presentQueueFamilyIndex = familyIndex; }
         void SetGraphicsQueueFamilyIndex( uint32_t familyIndex ) { this->graphicsQueueFamilyIndex = familyIndex; }
+        void SetTransferQueueFamilyIndex( uint32_t familyIndex ) { this->transferQueueFamilyIndex = familyIndex; }
+        void SetComputeQueueFamilyIndex( uint32_t familyIndex ) { this->computeQueueFamilyIndex = familyIndex; }
         void SetPhysicalDevice( const vk::PhysicalDevice& physicalDevice ) { this->physicalDevice = physicalDevice; }
+        void SetPhysicalDeviceProperties( const vk::PhysicalDeviceProperties& properties ) { this->physicalDeviceProperties = properties; }
         void SetPhysicalDeviceMemoryProperties( const vk::PhysicalDeviceMemoryProperties& memoryProperties ) { this->physicalDeviceMemoryProperties = memoryProperties; }
+        void SetEnabledFeatures( const vk::PhysicalDeviceFeatures& features ) { this->enabledFeatures = features; }
         void SetDevice( const vk::Device& device ) { this->device = device; }
         void SetPresentQueue( const vk::Queue& queue ) { this->presentQueue = queue; }
         void SetGraphicsQueue( const vk::Queue& queue ) { this->graphicsQueue = queue; }
-        void SetImageAvailableSemaphore( const vk::Semaphore& semaphore ) { this->imageAvailableSemaphore = semaphore; }
-        void SetDoneRenderingSemaphore( const vk::Semaphore& semaphore ) { this->doneRenderingSemaphore = semaphore; }
+        void SetTransferQueue( const vk::Queue& queue ) { this->transferQueue = queue; }
+        void SetComputeQueue( const vk::Queue& queue ) { this->computeQueue = queue; }
+        void SetImageAvailableSemaphores( std::vector<vk::Semaphore>&& semaphores ) { this->imageAvailableSemaphores = semaphores; }
+        void SetDoneRenderingSemaphores( std::vector<vk::Semaphore>&& semaphores ) { this->doneRenderingSemaphores = semaphores; }
         void SetSwapchain( const vk::SwapchainKHR& swapchain ) { this->swapchain = swapchain; }
+        void SetPresentPolicy( zealous::PresentPolicy policy ) { this->presentPolicy = policy; }
+        void SetPresentMode( vk::PresentModeKHR mode ) { this->presentMode = mode; }
+        void SetSwapchainFormat( const vk::Format& format ) { this->swapchainFormat = format; }
         void SetSwapchainImages( std::vector<vk::Image>&& swapchainImages ) { this->swapchainImages = swapchainImages; }
-        void SetCommandPool( const vk::CommandPool& pool ) { this->commandPool = pool; }
+        void SetSwapchainImageViews( std::vector<vk::ImageView>&& imageViews ) { this->swapchainImageViews = imageViews; }
+        void SetOffscreenMemory( std::vector<Allocation>&& memory ) { this->offscreenMemory = memory; }
+        void SetRenderPass( const vk::RenderPass& renderPass ) { this->renderPass = renderPass; }
+        void SetFramebuffers( std::vector<vk::Framebuffer>&& framebuffers ) { this->framebuffers = framebuffers; }
+        void SetCommandPools( std::vector<vk::CommandPool>&& pools ) { this->commandPools = pools; }
         void SetCommandBuffers( std::vector<vk::CommandBuffer>&& commandBuffers ) { this->commandBuffers = commandBuffers; }
         void SetFences( std::vector<vk::Fence>&& fences ) { this->fences = fences; }
+        void SetImageFences( std::vector<vk::Fence>&& fences ) { this->imageFences = fences; }
+        void SetImageFence( uint32_t imageIndex, const vk::Fence& fence ) { this->imageFences[imageIndex] = fence; }
+        void SetFramesInFlight( uint32_t count ) { this->framesInFlight = count; this->currentFrame = 0; this->frameSerials.assign( count, 0 ); }
 
         void SetDebugReportCallback( const vk::DebugReportCallbackEXT& callback ) { this->debugReportCallback = callback; }
 
       private:
+        bool headless;
         vk::Instance instance;
         vk::SurfaceKHR windowSurface;
         vk::PhysicalDevice physicalDevice;
+        vk::PhysicalDeviceProperties physicalDeviceProperties;
         vk::PhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
+        vk::PhysicalDeviceFeatures enabledFeatures;
         vk::Device device;
-        vk::Semaphore imageAvailableSemaphore;
-        vk::Semaphore doneRenderingSemaphore;
+        MemoryAllocator allocator;
+        PersistentPipelineCache pipelineCache;
+        std::vector<vk::Semaphore> imageAvailableSemaphores;
+        std::vector<vk::Semaphore> doneRenderingSemaphores;
         uint32_t presentQueueFamilyIndex;
         uint32_t graphicsQueueFamilyIndex;
+        uint32_t transferQueueFamilyIndex;
+        uint32_t computeQueueFamilyIndex;
         vk::Queue presentQueue;
         vk::Queue graphicsQueue;
+        vk::Queue transferQueue;
+        vk::Queue computeQueue;
         vk::SwapchainKHR swapchain;
+        zealous::PresentPolicy presentPolicy;
+        vk::PresentModeKHR presentMode;
+        vk::Format swapchainFormat;
         std::vector<vk::Image> swapchainImages;
-        vk::CommandPool commandPool;
+        std::vector<vk::ImageView> swapchainImageViews;
+        std::vector<Allocation> offscreenMemory;
+        vk::RenderPass renderPass;
+        std::vector<vk::Framebuffer> framebuffers;
+        std::vector<vk::CommandPool> commandPools;
         std::vector<vk::CommandBuffer> commandBuffers;
         std::vector<vk::Fence> fences;
+        std::vector<vk::Fence> imageFences;
+        uint32_t framesInFlight;
+        uint32_t currentFrame;
+        std::vector<uint64_t> frameSerials;
+        uint64_t submittedFrameSerial;
+        uint64_t completedFrameSerial;
+        bool swapchainOutOfDate;
+        DeletionQueue deletionQueue;
         int width;
         int height;
 
@@ -0,0 +1,62 @@
+#include "vulkan_handles.hpp"
+
+#include <array>
+#include <atomic>
+#include <ostream>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // pipelines may be built on worker threads
+    static std::array<std::atomic<int64_t>, ( size_t )HandleType::eCount> sLiveHandles = {};
+
+    //--------------------------------------------------------------------------
+    const char* HandleTypeName( HandleType type ) {
+        switch ( type ) {
+            case HandleType::eBuffer:              return "buffer";
+            case HandleType::eImage:               return "image";
+            case HandleType::eImageView:           return "image view";
+            case HandleType::eFramebuffer:         return "framebuffer";
+            case HandleType::eSwapchain:           return "swapchain";
+            case HandleType::eRenderPass:          return "render pass";
+            case HandleType::eSemaphore:           return "semaphore";
+            case HandleType::eFence:               return "fence";
+            case HandleType::eCommandPool:         return "command pool";
+            case HandleType::eDescriptorPool:      return "descriptor pool";
+            case HandleType::eDescriptorSetLayout: return "descriptor set layout";
+            case HandleType::ePipelineLayout:      return "pipeline layout";
+            case HandleType::ePipeline:            return "pipeline";
+            case HandleType::eShaderModule:        return "shader module";
+            case HandleType::eQueryPool:           return "query pool";
+            case HandleType::eSampler:             return "sampler";
+            default:                               return "?";
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void CountHandleCreated( HandleType type ) {
+        sLiveHandles[( size_t )type].fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    //--------------------------------------------------------------------------
+    void CountHandleDestroyed( HandleType type ) {
+        sLiveHandles[( size_t )type].fetch_sub( 1, std::memory_order_relaxed );
+    }
+
+    //--------------------------------------------------------------------------
+    int64_t LiveHandleCount( HandleType type ) {
+        return sLiveHandles[( size_t )type].load( std::memory_order_relaxed );
+    }
+
+    //--------------------------------------------------------------------------
+    int64_t PrintLiveHandles( std::ostream& stream ) {
+        int64_t total = 0;
+        for ( size_t i = 0; i < sLiveHandles.size(); ++i ) {
+            const int64_t live = LiveHandleCount( ( HandleType )i );
+            if ( live == 0 )
+                continue;
+            stream << "UniqueHandle : " << live << " " << HandleTypeName( ( HandleType )i ) << "(s) still alive" << std::endl;
+            total += live;
+        }
+        return total;
+    }
+}
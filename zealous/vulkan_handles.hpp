@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <vulkan/vulkan.hpp>
+
+namespace zealous {
+    //--------------------------------------------------------------------------
+    // every handle type UniqueHandle can own, each with a live count so
+    // whatever is still alive when the device goes away is reported
+    enum class HandleType {
+        eBuffer,
+        eImage,
+        eImageView,
+        eFramebuffer,
+        eSwapchain,
+        eRenderPass,
+        eSemaphore,
+        eFence,
+        eCommandPool,
+        eDescriptorPool,
+        eDescriptorSetLayout,
+        ePipelineLayout,
+        ePipeline,
+        eShaderModule,
+        eQueryPool,
+        eSampler,
+        eCount
+    };
+    const char* HandleTypeName( HandleType type );
+
+    void CountHandleCreated( HandleType type );
+    void CountHandleDestroyed( HandleType type );
+    int64_t LiveHandleCount( HandleType type );
+    // one line per type with handles still alive, returns how many there are
+    int64_t PrintLiveHandles( std::ostream& stream );
+
+    //--------------------------------------------------------------------------
+    template<typename T>
+    struct HandleTraits;
+
+#define ZEALOUS_HANDLE_TRAITS( Handle, handleType, destroyCall )                        \
+    template<>                                                                          \
+    struct HandleTraits<vk::Handle> {                                                   \
+        static constexpr HandleType kType = HandleType::handleType;                     \
+        static void Destroy( const vk::Device& device, const vk::Handle& handle ) {     \
+            device.destroyCall( handle );                                               \
+        }                                                                               \
+    }
+
+    ZEALOUS_HANDLE_TRAITS( Buffer, eBuffer, destroyBuffer );
+    ZEALOUS_HANDLE_TRAITS( Image, eImage, destroyImage );
+    ZEALOUS_HANDLE_TRAITS( ImageView, eImageView, destroyImageView );
+    ZEALOUS_HANDLE_TRAITS( Framebuffer, eFramebuffer, destroyFramebuffer );
+    ZEALOUS_HANDLE_TRAITS( SwapchainKHR, eSwapchain, destroySwapchainKHR );
+    ZEALOUS_HANDLE_TRAITS( RenderPass, eRenderPass, destroyRenderPass );
+    ZEALOUS_HANDLE_TRAITS( Semaphore, eSemaphore, destroySemaphore );
+    ZEALOUS_HANDLE_TRAITS( Fence, eFence, destroyFence );
+    ZEALOUS_HANDLE_TRAITS( CommandPool, eCommandPool, destroyCommandPool );
+    ZEALOUS_HANDLE_TRAITS( DescriptorPool, eDescriptorPool, destroyDescriptorPool );
+    ZEALOUS_HANDLE_TRAITS( DescriptorSetLayout, eDescriptorSetLayout, destroyDescriptorSetLayout );
+    ZEALOUS_HANDLE_TRAITS( PipelineLayout, ePipelineLayout, destroyPipelineLayout );
+    ZEALOUS_HANDLE_TRAITS( Pipeline, ePipeline, destroyPipeline );
+    ZEALOUS_HANDLE_TRAITS( ShaderModule, eShaderModule, destroyShaderModule );
+    ZEALOUS_HANDLE_TRAITS( QueryPool, eQueryPool, destroyQueryPool );
+    ZEALOUS_HANDLE_TRAITS( Sampler, eSampler, destroySampler );
+
+#undef ZEALOUS_HANDLE_TRAITS
+
+    //--------------------------------------------------------------------------
+    template<typename T>
+    void DestroyHandle( const vk::Device& device, const T& handle ) {
+        HandleTraits<T>::Destroy( device, handle );
+        CountHandleDestroyed( HandleTraits<T>::kType );
+    }
+
+    //--------------------------------------------------------------------------
+    // Sole owner of a device level handle, destroyed when reset, reassigned or
+    // going out of scope. Converts to the raw handle so it can be passed to
+    // Vulkan-Hpp as is; anything the GPU may still use must be handed to a
+    // DeletionQueue instead of being reset.
+    template<typename T>
+    class UniqueHandle {
+      public:
+        UniqueHandle() = default;
+        UniqueHandle( const vk::Device& device, const T& handle )
+            : device( device )
+            , handle( handle ) {
+            if ( handle )
+                CountHandleCreated( HandleTraits<T>::kType );
+        }
+        ~UniqueHandle() { Reset(); }
+
+        UniqueHandle( UniqueHandle&& other ) noexcept
+            : device( other.device )
+            , handle( other.Release() ) {
+        }
+        UniqueHandle& operator=( UniqueHandle&& other ) {
+            if ( this != &other ) {
+                Reset();
+                device = other.device;
+                handle = other.Release();
+            }
+            return *this;
+        }
+        UniqueHandle( const UniqueHandle& ) = delete;
+        UniqueHandle& operator=( const UniqueHandle& ) = delete;
+
+        const T& Get() const { return handle; }
+        operator const T& () const { return handle; }
+        explicit operator bool() const { return !!handle; }
+        const vk::Device& Device() const { return device; }
+
+        void Reset() {
+            if ( handle )
+                DestroyHandle( device, handle );
+            handle = T();
+        }
+
+        // gives up ownership, the handle stays counted as live until the
+        // caller destroys it with DestroyHandle
+        T Release() {
+            const T released = handle;
+            handle = T();
+            return released;
+        }
+
+      private:
+        vk::Device device;
+        T handle;
+    };
+
+    //--------------------------------------------------------------------------
+    using UniqueBuffer = UniqueHandle<vk::Buffer>;
+    using UniqueImage = UniqueHandle<vk::Image>;
+    using UniqueImageView = UniqueHandle<vk::ImageView>;
+    using UniqueFramebuffer = UniqueHandle<vk::Framebuffer>;
+    using UniqueSwapchain = UniqueHandle<vk::SwapchainKHR>;
+    using UniqueSemaphore = UniqueHandle<vk::Semaphore>;
+    using UniqueFence = UniqueHandle<vk::Fence>;
+    using UniqueCommandPool = UniqueHandle<vk::CommandPool>;
+    using UniqueDescriptorPool = UniqueHandle<vk::DescriptorPool>;
+    using UniqueDescriptorSetLayout = UniqueHandle<vk::DescriptorSetLayout>;
+    using UniquePipelineLayout = UniqueHandle<vk::PipelineLayout>;
+    using UniquePipeline = UniqueHandle<vk::Pipeline>;
+    using UniqueShaderModule = UniqueHandle<vk::ShaderModule>;
+    using UniqueSampler = UniqueHandle<vk::Sampler>;
+}
@@ -3,14 +3,18 @@
 #include "container_helpers.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <fstream>
 #include <iostream>
+#include <string>
 #include <vulkan/vulkan.hpp>
 #include <SDL_vulkan.h>
 
 namespace zealous {
     //--------------------------------------------------------------------------
-    static bool sDisplayCallbacks = false;
+    // startup stages run on several threads
+    static std::atomic<bool> sDisplayCallbacks( false );
 
     //--------------------------------------------------------------------------
     VkBool32 VulkanDebugReportCallback(
@@ -35,17 +39,35 @@ namespace zealous {
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
     void InitVulkanInstance( VulkanContext& context ) {
-        // SDL offers a helper function to determine all necessary extensions, use that
-        unsigned int extCount;
-        SDL_Vulkan_GetInstanceExtensions( context.SDLWindow(), &extCount, nullptr );
-        std::vector<const char*> desiredExts( extCount, nullptr );
-        SDL_Vulkan_GetInstanceExtensions( context.SDLWindow(), &extCount, desiredExts.data() );
-        if ( !Contains( desiredExts, "VK_EXT_debug_report" ) )
+        // SDL offers a helper function to determine all necessary extensions, use that;
+        // no window needed once the Vulkan library is loaded, so the instance
+        // can be created while the window is; headless needs no surface
+        // extension at all
+        std::vector<const char*> desiredExts;
+        if ( not context.Headless() ) {
+            unsigned int extCount;
+            SDL_Vulkan_GetInstanceExtensions( nullptr, &extCount, nullptr );
+            desiredExts.resize( extCount, nullptr );
+            SDL_Vulkan_GetInstanceExtensions( nullptr, &extCount, desiredExts.data() );
+        }
+
+        // validation is optional, machines without the SDK ( CI ) run without
+        const std::vector<vk::ExtensionProperties> extProps = vk::enumerateInstanceExtensionProperties();
+        const bool hasDebugReport = ContainsIf( extProps, []( const vk::ExtensionProperties & extension ) {
+            return std::string( "VK_EXT_debug_report" ) == extension.extensionName;
+        } );
+        if ( hasDebugReport and !Contains( desiredExts, "VK_EXT_debug_report" ) )
             desiredExts.push_back( "VK_EXT_debug_report" );
 
-        const std::vector<const char*> validationLayers = {
-            "VK_LAYER_LUNARG_standard_validation"
-        };
+        const std::vector<vk::LayerProperties> layerProps = vk::enumerateInstanceLayerProperties();
+        std::vector<const char*> validationLayers;
+        for ( const char* layer : { "VK_LAYER_LUNARG_standard_validation" } ) {
+            const bool available = ContainsIf( layerProps, [layer]( const vk::LayerProperties & properties ) {
+                return std::string( layer ) == properties.layerName;
+            } );
+            if ( available )
+                validationLayers.push_back( layer );
+        }
 
         const vk::InstanceCreateInfo instanceCreateInfo = vk::InstanceCreateInfo()
                 .setEnabledExtensionCount( ( uint32_t )desiredExts.size() )
@@ -74,6 +96,8 @@ namespace zealous {
 
         PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT =
             ( PFN_vkCreateDebugReportCallbackEXT ) instance.getProcAddr( "vkCreateDebugReportCallbackEXT" );
+        if ( vkCreateDebugReportCallbackEXT == nullptr )
+            return;
         VkDebugReportCallbackEXT debugReportCallback_;
         VkDebugReportCallbackCreateInfoEXT createInfo_( createInfo );
         vkCreateDebugReportCallbackEXT( instance, &createInfo_, nullptr, &debugReportCallback_ );
@@ -85,6 +109,8 @@ namespace zealous {
     //--------------------------------------------------------------------------
     void DeInitVulkanDebugLayer( VulkanContext& context ) {
         const vk::Instance& instance = context.Instance();
+        if ( not context.DebugReportCallback() )
+            return;
 
         PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT =
             ( PFN_vkDestroyDebugReportCallbackEXT )instance.getProcAddr( "vkDestroyDebugReportCallbackEXT" );
@@ -93,6 +119,9 @@ namespace zealous {
 
     //--------------------------------------------------------------------------
     void InitVulkanSurface( VulkanContext& context ) {
+        if ( context.Headless() )
+            return;
+
         VkSurfaceKHR vkSurface;
         SDL_Vulkan_CreateSurface( context.SDLWindow(), context.Instance(), &vkSurface );
         vk::SurfaceKHR surface( vkSurface );
@@ -101,27 +130,123 @@ namespace zealous {
 
     //--------------------------------------------------------------------------
     void DeInitVulkanSurface( VulkanContext& context ) {
+        if ( context.Headless() )
+            return;
+
         const vk::Instance& instance = context.Instance();
         instance.destroySurfaceKHR( context.WindowSurface() );
         context.SetWindowSurface( vk::SurfaceKHR() );
     }
 
     //--------------------------------------------------------------------------
-    std::vector<const char*> DesiredDeviceExtensions() {
+    std::vector<const char*> DesiredDeviceExtensions( const VulkanContext& context ) {
+        if ( context.Headless() )
+            return std::vector<const char*> {};
         return std::vector<const char*> { "VK_KHR_swapchain" };
     }
 
+    //--------------------------------------------------------------------------
+    // what InitVulkanPhysicalDevice settled on, kept between runs so the next
+    // start can skip the search
+    struct DeviceChoice {
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t graphicsQueueFamilyIndex;
+        uint32_t presentQueueFamilyIndex;
+        uint32_t transferQueueFamilyIndex;
+        uint32_t computeQueueFamilyIndex;
+    };
+    static const char* const kDeviceChoicePath = "device_choice.txt";
+
+    //--------------------------------------------------------------------------
+    bool LoadDeviceChoice( DeviceChoice& choice ) {
+        std::ifstream file( kDeviceChoicePath );
+        return !!( file >> choice.vendorID >> choice.deviceID
+                   >> choice.graphicsQueueFamilyIndex >> choice.presentQueueFamilyIndex >> choice.transferQueueFamilyIndex
+                   >> choice.computeQueueFamilyIndex );
+    }
+
+    //--------------------------------------------------------------------------
+    void SaveDeviceChoice( const DeviceChoice& choice ) {
+        std::ofstream file( kDeviceChoicePath, std::ios::trunc );
+        file << choice.vendorID << " " << choice.deviceID << " "
+             << choice.graphicsQueueFamilyIndex << " " << choice.presentQueueFamilyIndex << " " << choice.transferQueueFamilyIndex << " "
+             << choice.computeQueueFamilyIndex << std::endl;
+    }
+
+    //--------------------------------------------------------------------------
+    // the descriptor heap arrays are indexed from push constants
+    bool SupportsRequiredFeatures( const vk::PhysicalDevice& physicalDevice ) {
+        const vk::PhysicalDeviceFeatures features = physicalDevice.getFeatures();
+        return features.shaderStorageBufferArrayDynamicIndexing and features.shaderSampledImageArrayDynamicIndexing;
+    }
+
+    //--------------------------------------------------------------------------
+    void SetPhysicalDeviceChoice( VulkanContext& context, const vk::PhysicalDevice& physicalDevice,
+                                  const vk::PhysicalDeviceProperties& properties, const DeviceChoice& choice ) {
+        context.SetPhysicalDevice( physicalDevice );
+        context.SetGraphicsQueueFamilyIndex( choice.graphicsQueueFamilyIndex );
+        context.SetPresentQueueFamilyIndex( choice.presentQueueFamilyIndex );
+        context.SetTransferQueueFamilyIndex( choice.transferQueueFamilyIndex );
+        context.SetComputeQueueFamilyIndex( choice.computeQueueFamilyIndex );
+
+        // get the device and memory properties while we're at it
+        context.SetPhysicalDeviceProperties( properties );
+        const vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
+        context.SetPhysicalDeviceMemoryProperties( memoryProperties );
+    }
+
+    //--------------------------------------------------------------------------
+    bool UseCachedDeviceChoice( VulkanContext& context, const std::vector<vk::PhysicalDevice>& physDevs ) {
+        DeviceChoice choice;
+        if ( not LoadDeviceChoice( choice ) )
+            return false;
+
+        for ( const vk::PhysicalDevice& physicalDevice : physDevs ) {
+            const vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+            if ( properties.vendorID != choice.vendorID or properties.deviceID != choice.deviceID )
+                continue;
+            if ( not SupportsRequiredFeatures( physicalDevice ) )
+                return false;
+
+            // families can move with a driver update, and the surface is a new
+            // one, so the choice is checked again rather than trusted
+            const std::vector<vk::QueueFamilyProperties> familyProps = physicalDevice.getQueueFamilyProperties();
+            const uint32_t familyCount = ( uint32_t )familyProps.size();
+            if ( choice.graphicsQueueFamilyIndex >= familyCount or choice.presentQueueFamilyIndex >= familyCount
+                    or choice.transferQueueFamilyIndex >= familyCount or choice.computeQueueFamilyIndex >= familyCount )
+                return false;
+            if ( not ( familyProps[choice.graphicsQueueFamilyIndex].queueFlags & vk::QueueFlagBits::eGraphics ) )
+                return false;
+            if ( not ( familyProps[choice.transferQueueFamilyIndex].queueFlags & ( vk::QueueFlagBits::eTransfer | vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute ) ) )
+                return false;
+            if ( not ( familyProps[choice.computeQueueFamilyIndex].queueFlags & vk::QueueFlagBits::eCompute ) )
+                return false;
+            if ( not context.Headless() and not physicalDevice.getSurfaceSupportKHR( choice.presentQueueFamilyIndex, context.WindowSurface() ) )
+                return false;
+
+            SetPhysicalDeviceChoice( context, physicalDevice, properties, choice );
+            return true;
+        }
+        return false;
+    }
+
     //--------------------------------------------------------------------------
     void InitVulkanPhysicalDevice( VulkanContext& context ) {
         const vk::Instance& instance = context.Instance();
         // choosing a physical device among all
         std::vector<vk::PhysicalDevice> physDevs = instance.enumeratePhysicalDevices();
 
+        if ( UseCachedDeviceChoice( context, physDevs ) )
+            return;
+
         // we are activating a subset of extensions and looking for a device
         // with all those extensions available
-        const auto desiredExts = DesiredDeviceExtensions();
+        const auto desiredExts = DesiredDeviceExtensions( context );
 
         uint32_t presentQueueFamilyIndex, graphicsQueueFamilyIndex;
+        DeviceChoice chosen;
+        bool found = false;
         auto physDevIt = physDevs.begin();
 
         for ( physDevIt; physDevIt != physDevs.end(); ++physDevIt ) {
@@ -133,7 +258,8 @@ namespace zealous {
 
             const std::vector<vk::QueueFamilyProperties> familyProps = physicalDevice.getQueueFamilyProperties();
             for ( uint32_t i = 0, end = ( uint32_t )familyProps.size(); i < end; ++i ) {
-                const bool presentSupported = physicalDevice.getSurfaceSupportKHR( i, context.WindowSurface() );
+                // nothing is presented headless, the graphics family stands in
+                const bool presentSupported = context.Headless() or physicalDevice.getSurfaceSupportKHR( i, context.WindowSurface() );
                 const bool graphicsSupported = ( bool )( familyProps[i].queueFlags & vk::QueueFlagBits::eGraphics );
 
                 if ( presentSupported and graphicsSupported ) {
@@ -164,18 +290,45 @@ namespace zealous {
                     } );
                 } );
 
-                if ( acceptsAllExtensions ) {
-                    // success ! let's set our state
-                    context.SetPhysicalDevice( physicalDevice );
-                    context.SetGraphicsQueueFamilyIndex( graphicsQueueFamilyIndex );
-                    context.SetPresentQueueFamilyIndex( graphicsQueueFamilyIndex );
+                if ( acceptsAllExtensions and SupportsRequiredFeatures( physicalDevice ) ) {
+                    // a transfer-only family usually maps to the copy engines,
+                    // uploads there run alongside rendering
+                    uint32_t transferQueueFamilyIndex = graphicsQueueFamilyIndex;
+                    for ( uint32_t i = 0, end = ( uint32_t )familyProps.size(); i < end; ++i ) {
+                        const vk::QueueFlags flags = familyProps[i].queueFlags;
+                        if ( ( flags & vk::QueueFlagBits::eTransfer ) and not ( flags & ( vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute ) ) ) {
+                            transferQueueFamilyIndex = i;
+                            break;
+                        }
+                    }
+
+                    // same for an async compute family, if there is none the
+                    // graphics family takes the dispatches, provided it can
+                    uint32_t computeQueueFamilyIndex = graphicsQueueFamilyIndex;
+                    for ( uint32_t i = 0, end = ( uint32_t )familyProps.size(); i < end; ++i ) {
+                        const vk::QueueFlags flags = familyProps[i].queueFlags;
+                        if ( ( flags & vk::QueueFlagBits::eCompute ) and not ( flags & vk::QueueFlagBits::eGraphics ) ) {
+                            computeQueueFamilyIndex = i;
+                            break;
+                        }
+                    }
 
-                    // get the memory properties while we're at it
-                    const vk::PhysicalDeviceMemoryProperties memoryProperties = physicalDevice.getMemoryProperties();
-                    context.SetPhysicalDeviceMemoryProperties( memoryProperties );
+                    // success ! let's set our state
+                    const vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+                    chosen.vendorID = properties.vendorID;
+                    chosen.deviceID = properties.deviceID;
+                    chosen.graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+                    chosen.presentQueueFamilyIndex = graphicsQueueFamilyIndex;
+                    chosen.transferQueueFamilyIndex = transferQueueFamilyIndex;
+                    chosen.computeQueueFamilyIndex = computeQueueFamilyIndex;
+                    SetPhysicalDeviceChoice( context, physicalDevice, properties, chosen );
+                    found = true;
                 }
             }
         }
+
+        if ( found )
+            SaveDeviceChoice( chosen );
     }
 
     //--------------------------------------------------------------------------
@@ -189,21 +342,47 @@ namespace zealous {
         const vk::Instance& instance = context.Instance();
         const vk::PhysicalDevice& physicalDevice = context.PhysicalDevice();
 
-        const auto desiredExts = DesiredDeviceExtensions();
+        const auto desiredExts = DesiredDeviceExtensions( context );
 
-        const vk::DeviceQueueCreateInfo queueCreateInfo[1] = {
+        const float queuePriority = 1.f;
+        std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos = {
             vk::DeviceQueueCreateInfo()
             .setQueueCount( 1 )
             .setQueueFamilyIndex( context.GraphicsQueueFamilyIndex() )
+            .setPQueuePriorities( &queuePriority )
         };
+        if ( context.TransferQueueFamilyIndex() != context.GraphicsQueueFamilyIndex() ) {
+            queueCreateInfos.push_back( vk::DeviceQueueCreateInfo()
+                                        .setQueueCount( 1 )
+                                        .setQueueFamilyIndex( context.TransferQueueFamilyIndex() )
+                                        .setPQueuePriorities( &queuePriority ) );
+        }
+        if ( context.ComputeQueueFamilyIndex() != context.GraphicsQueueFamilyIndex()
+                and context.ComputeQueueFamilyIndex() != context.TransferQueueFamilyIndex() ) {
+            queueCreateInfos.push_back( vk::DeviceQueueCreateInfo()
+                                        .setQueueCount( 1 )
+                                        .setQueueFamilyIndex( context.ComputeQueueFamilyIndex() )
+                                        .setPQueuePriorities( &queuePriority ) );
+        }
+
+        // besides the required ones, only what the renderer knows how to do
+        // without, it checks EnabledFeatures() to pick its draw path
+        const vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
+        const vk::PhysicalDeviceFeatures enabledFeatures = vk::PhysicalDeviceFeatures()
+                .setMultiDrawIndirect( supportedFeatures.multiDrawIndirect )
+                .setDrawIndirectFirstInstance( supportedFeatures.drawIndirectFirstInstance )
+                .setShaderStorageBufferArrayDynamicIndexing( VK_TRUE )
+                .setShaderSampledImageArrayDynamicIndexing( VK_TRUE );
 
         vk::DeviceCreateInfo deviceCreateInfo = vk::DeviceCreateInfo()
+                                                .setPEnabledFeatures( &enabledFeatures )
                                                 .setEnabledExtensionCount( ( uint32_t )desiredExts.size() )
                                                 .setPpEnabledExtensionNames( desiredExts.data() )
-                                                .setQueueCreateInfoCount( 1 )
-                                                .setPQueueCreateInfos( queueCreateInfo );
+                                                .setQueueCreateInfoCount( ( uint32_t )queueCreateInfos.size() )
+                                                .setPQueueCreateInfos( queueCreateInfos.data() );
         const vk::Device& device = physicalDevice.createDevice( deviceCreateInfo );
         context.SetDevice( device );
+        context.SetEnabledFeatures( enabledFeatures );
     }
 
     //--------------------------------------------------------------------------
@@ -212,6 +391,28 @@ namespace zealous {
         context.SetDevice( vk::Device() );
     }
 
+    //--------------------------------------------------------------------------
+    void InitVulkanAllocator( VulkanContext& context ) {
+        context.Allocator().Init( context.Device(), context.PhysicalDeviceMemoryProperties() );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanAllocator( VulkanContext& context ) {
+        context.Allocator().PrintStats( std::cout );
+        context.Allocator().DeInit();
+    }
+
+    //--------------------------------------------------------------------------
+    void InitVulkanPipelineCache( VulkanContext& context ) {
+        context.PipelineCache().Init( context.Device(), context.PhysicalDeviceProperties(), "pipeline_cache.bin" );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanPipelineCache( VulkanContext& context ) {
+        context.PipelineCache().PrintStats( std::cout );
+        context.PipelineCache().DeInit();
+    }
+
     //--------------------------------------------------------------------------
     void InitVulkanQueues( VulkanContext& context ) {
         const vk::Device& device = context.Device();
@@ -220,6 +421,13 @@ namespace zealous {
 
         vk::Queue presentQueue = device.getQueue( context.PresentQueueFamilyIndex(), 0 );
         context.SetPresentQueue( graphicsQueue );
+
+        vk::Queue transferQueue = device.getQueue( context.TransferQueueFamilyIndex(), 0 );
+        context.SetTransferQueue( transferQueue );
+
+        // the same queue as graphics when there is no async compute family
+        vk::Queue computeQueue = device.getQueue( context.ComputeQueueFamilyIndex(), 0 );
+        context.SetComputeQueue( computeQueue );
     }
 
     //--------------------------------------------------------------------------
@@ -231,28 +439,91 @@ namespace zealous {
     void InitVulkanSemaphores( VulkanContext& context ) {
         const vk::Device& device = context.Device();
 
+        // one pair per frame in flight, a semaphore can't be waited on by two
+        // frames at once
         const vk::SemaphoreCreateInfo createInfo = vk::SemaphoreCreateInfo();
-        context.SetImageAvailableSemaphore( device.createSemaphore( createInfo ) );
-        context.SetDoneRenderingSemaphore( device.createSemaphore( createInfo ) );
+        const uint32_t frameCount = context.FramesInFlight();
+        std::vector<vk::Semaphore> imageAvailableSemaphores( frameCount );
+        std::vector<vk::Semaphore> doneRenderingSemaphores( frameCount );
+        for ( uint32_t i = 0 ; i < frameCount ; ++i ) {
+            imageAvailableSemaphores[i] = device.createSemaphore( createInfo );
+            doneRenderingSemaphores[i] = device.createSemaphore( createInfo );
+        }
+
+        context.SetImageAvailableSemaphores( std::move( imageAvailableSemaphores ) );
+        context.SetDoneRenderingSemaphores( std::move( doneRenderingSemaphores ) );
     }
 
     //--------------------------------------------------------------------------
     void DeInitVulkanSemaphores( VulkanContext& context ) {
         const vk::Device& device = context.Device();
-        device.destroySemaphore( context.ImageAvailableSemaphore() );
-        device.destroySemaphore( context.DoneRenderingSemaphore() );
+        for ( auto semaphore : context.ImageAvailableSemaphores() )
+            device.destroySemaphore( semaphore );
+        for ( auto semaphore : context.DoneRenderingSemaphores() )
+            device.destroySemaphore( semaphore );
+        context.SetImageAvailableSemaphores( std::vector<vk::Semaphore> {} );
+        context.SetDoneRenderingSemaphores( std::vector<vk::Semaphore> {} );
+    }
+
+    //--------------------------------------------------------------------------
+    struct PresentChoice {
+        vk::PresentModeKHR mode;
+        uint32_t imageCount;
+    };
+
+    //--------------------------------------------------------------------------
+    PresentChoice ChoosePresentMode( PresentPolicy policy, const std::vector<vk::PresentModeKHR>& modes ) {
+        // candidates in order of preference, fifo is always supported so every
+        // policy ends up there
+        std::vector<PresentChoice> candidates;
+        switch ( policy ) {
+            case PresentPolicy::eThroughput:
+                candidates = { { vk::PresentModeKHR::eMailbox, 3 },
+                               { vk::PresentModeKHR::eImmediate, 3 },
+                               { vk::PresentModeKHR::eFifo, 3 } };
+                break;
+            case PresentPolicy::eLowLatency:
+                candidates = { { vk::PresentModeKHR::eImmediate, 2 },
+                               { vk::PresentModeKHR::eMailbox, 2 },
+                               { vk::PresentModeKHR::eFifoRelaxed, 2 },
+                               { vk::PresentModeKHR::eFifo, 2 } };
+                break;
+            case PresentPolicy::eVsync:
+                candidates = { { vk::PresentModeKHR::eFifo, 2 } };
+                break;
+            case PresentPolicy::eAdaptiveVsync:
+                candidates = { { vk::PresentModeKHR::eFifoRelaxed, 2 },
+                               { vk::PresentModeKHR::eFifo, 2 } };
+                break;
+        }
+
+        for ( const PresentChoice& candidate : candidates ) {
+            if ( Contains( modes, candidate.mode ) )
+                return candidate;
+        }
+        return PresentChoice{ vk::PresentModeKHR::eFifo, 2 };
     }
 
     //--------------------------------------------------------------------------
     void InitVulkanSwapchain( VulkanContext& context ) {
+        // offscreen images stand in for the swapchain, the extent is the one
+        // set on the context
+        if ( context.Headless() ) {
+            context.SetSwapchainFormat( vk::Format::eR8G8B8A8Unorm );
+            return;
+        }
+
         const vk::SurfaceKHR& windowSurface = context.WindowSurface();
 
         // check whether the surface has the capabilities needed
         const vk::SurfaceCapabilitiesKHR caps = context.SurfaceCapabilities( windowSurface );
         assert( caps.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst );
 
-        // image count ?
-        const uint32_t imageCount = std::min( caps.maxImageCount, caps.minImageCount + 1 );
+        // present mode and image count, from the policy and what the surface allows
+        const PresentChoice choice = ChoosePresentMode( context.PresentPolicy(), context.SurfacePresentModes( windowSurface ) );
+        uint32_t imageCount = std::max( caps.minImageCount, choice.imageCount );
+        if ( caps.maxImageCount != 0 )
+            imageCount = std::min( caps.maxImageCount, imageCount );
 
         // choose the most appropriate surface format
         std::vector<vk::SurfaceFormatKHR> formats = context.SurfaceFormats( windowSurface );
@@ -286,27 +557,77 @@ namespace zealous {
                 .setImageSharingMode( vk::SharingMode::eExclusive )
                 .setImageUsage( vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eColorAttachment )
                 .setMinImageCount( imageCount )
-                .setPresentMode( vk::PresentModeKHR::eFifo )
+                .setPresentMode( choice.mode )
                 .setSurface( windowSurface )
                 .setPreTransform( caps.currentTransform )
                 .setOldSwapchain( oldSwapchain );
         const vk::SwapchainKHR& swapchain = device.createSwapchainKHR( createInfo );
         context.SetSwapchain( swapchain );
+        context.SetSwapchainFormat( format.format );
+        context.SetPresentMode( choice.mode );
 
-        if ( !!oldSwapchain )
-            device.destroySwapchainKHR( oldSwapchain );
+        // the old swapchain, if any, is retired by UpdateVulkan
     }
 
     //--------------------------------------------------------------------------
     void DeInitVulkanSwapchain( VulkanContext& context ) {
+        if ( context.Headless() )
+            return;
+
         const vk::Device& device = context.Device();
         const vk::SwapchainKHR& swapchain = context.Swapchain();
         device.destroySwapchainKHR( swapchain );
         context.SetSwapchain( vk::SwapchainKHR() );
     }
 
+    //--------------------------------------------------------------------------
+    void InitVulkanOffscreenImages( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+
+        // one per frame in flight, an image is free again as soon as the
+        // fence of the frame that last rendered it signaled
+        const vk::ImageCreateInfo createInfo = vk::ImageCreateInfo()
+                                               .setImageType( vk::ImageType::e2D )
+                                               .setFormat( context.SwapchainFormat() )
+                                               .setExtent( vk::Extent3D( context.WindowWidth(), context.WindowHeight(), 1 ) )
+                                               .setMipLevels( 1 )
+                                               .setArrayLayers( 1 )
+                                               .setSamples( vk::SampleCountFlagBits::e1 )
+                                               .setTiling( vk::ImageTiling::eOptimal )
+                                               .setUsage( vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc )
+                                               .setSharingMode( vk::SharingMode::eExclusive )
+                                               .setInitialLayout( vk::ImageLayout::eUndefined );
+        const MemoryUsage usage = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+
+        std::vector<vk::Image> images( context.FramesInFlight() );
+        std::vector<Allocation> memory( images.size() );
+        for ( size_t i = 0; i < images.size(); ++i ) {
+            images[i] = device.createImage( createInfo );
+            memory[i] = context.Allocator().AllocateImage( images[i], usage );
+        }
+
+        context.SetSwapchainImages( std::move( images ) );
+        context.SetOffscreenMemory( std::move( memory ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanOffscreenImages( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+        std::vector<Allocation> memory = context.OffscreenMemory();
+        for ( auto image : context.SwapchainImages() )
+            device.destroyImage( image );
+        for ( auto& allocation : memory )
+            context.Allocator().Free( allocation );
+        context.SetOffscreenMemory( std::vector<Allocation> {} );
+    }
+
     //--------------------------------------------------------------------------
     void InitVulkanSwapchainImages( VulkanContext& context ) {
+        if ( context.Headless() ) {
+            InitVulkanOffscreenImages( context );
+            return;
+        }
+
         const vk::SwapchainKHR& swapchain = context.Swapchain();
         const vk::Device& device = context.Device();
 
@@ -316,37 +637,147 @@ namespace zealous {
 
     //--------------------------------------------------------------------------
     void DeInitVulkanSwapchainImages( VulkanContext& context ) {
+        if ( context.Headless() )
+            DeInitVulkanOffscreenImages( context );
         context.SetSwapchainImages( std::vector<vk::Image> {} );
     }
 
     //--------------------------------------------------------------------------
-    void InitVulkanCommandPool( VulkanContext& context ) {
+    void InitVulkanSwapchainImageViews( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+
+        vk::ImageSubresourceRange subresourceRange = vk::ImageSubresourceRange()
+                .setAspectMask( vk::ImageAspectFlagBits::eColor )
+                .setBaseMipLevel( 0 )
+                .setLevelCount( 1 )
+                .setBaseArrayLayer( 0 )
+                .setLayerCount( 1 );
+
+        std::vector<vk::ImageView> imageViews;
+        for ( const vk::Image& image : context.SwapchainImages() ) {
+            vk::ImageViewCreateInfo createInfo = vk::ImageViewCreateInfo()
+                                                 .setImage( image )
+                                                 .setViewType( vk::ImageViewType::e2D )
+                                                 .setFormat( context.SwapchainFormat() )
+                                                 .setSubresourceRange( subresourceRange );
+            imageViews.push_back( device.createImageView( createInfo ) );
+        }
+
+        context.SetSwapchainImageViews( std::move( imageViews ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanSwapchainImageViews( VulkanContext& context ) {
         const vk::Device& device = context.Device();
+        for ( auto imageView : context.SwapchainImageViews() )
+            device.destroyImageView( imageView );
+        context.SetSwapchainImageViews( std::vector<vk::ImageView> {} );
+    }
 
+    //--------------------------------------------------------------------------
+    void InitVulkanRenderPass( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+
+        // every pixel gets overwritten, no need to load the previous content;
+        // the render graph transitions the image around the render pass, from
+        // whatever it was to present, or to a copy source when headless
+        vk::AttachmentDescription colorAttachment = vk::AttachmentDescription()
+                .setFormat( context.SwapchainFormat() )
+                .setSamples( vk::SampleCountFlagBits::e1 )
+                .setLoadOp( vk::AttachmentLoadOp::eDontCare )
+                .setStoreOp( vk::AttachmentStoreOp::eStore )
+                .setStencilLoadOp( vk::AttachmentLoadOp::eDontCare )
+                .setStencilStoreOp( vk::AttachmentStoreOp::eDontCare )
+                .setInitialLayout( vk::ImageLayout::eColorAttachmentOptimal )
+                .setFinalLayout( vk::ImageLayout::eColorAttachmentOptimal );
+
+        vk::AttachmentReference colorReference = vk::AttachmentReference()
+                .setAttachment( 0 )
+                .setLayout( vk::ImageLayout::eColorAttachmentOptimal );
+
+        vk::SubpassDescription subpass = vk::SubpassDescription()
+                                         .setPipelineBindPoint( vk::PipelineBindPoint::eGraphics )
+                                         .setColorAttachmentCount( 1 )
+                                         .setPColorAttachments( &colorReference );
+
+        vk::RenderPassCreateInfo createInfo = vk::RenderPassCreateInfo()
+                                              .setAttachmentCount( 1 )
+                                              .setPAttachments( &colorAttachment )
+                                              .setSubpassCount( 1 )
+                                              .setPSubpasses( &subpass );
+        context.SetRenderPass( device.createRenderPass( createInfo ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanRenderPass( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+        device.destroyRenderPass( context.RenderPass() );
+        context.SetRenderPass( vk::RenderPass() );
+    }
+
+    //--------------------------------------------------------------------------
+    void InitVulkanFramebuffers( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+
+        std::vector<vk::Framebuffer> framebuffers;
+        for ( const vk::ImageView& imageView : context.SwapchainImageViews() ) {
+            vk::FramebufferCreateInfo createInfo = vk::FramebufferCreateInfo()
+                                                   .setRenderPass( context.RenderPass() )
+                                                   .setAttachmentCount( 1 )
+                                                   .setPAttachments( &imageView )
+                                                   .setWidth( context.WindowWidth() )
+                                                   .setHeight( context.WindowHeight() )
+                                                   .setLayers( 1 );
+            framebuffers.push_back( device.createFramebuffer( createInfo ) );
+        }
+
+        context.SetFramebuffers( std::move( framebuffers ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void DeInitVulkanFramebuffers( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+        for ( auto framebuffer : context.Framebuffers() )
+            device.destroyFramebuffer( framebuffer );
+        context.SetFramebuffers( std::vector<vk::Framebuffer> {} );
+    }
+
+    //--------------------------------------------------------------------------
+    void InitVulkanCommandPools( VulkanContext& context ) {
+        const vk::Device& device = context.Device();
+
+        // one transient pool per frame in flight, reset as a whole at the start
+        // of the frame instead of resetting command buffers one by one
         vk::CommandPoolCreateInfo createInfo = vk::CommandPoolCreateInfo()
                                                .setQueueFamilyIndex( context.GraphicsQueueFamilyIndex() )
-                                               .setFlags( vk::CommandPoolCreateFlagBits::eResetCommandBuffer );
-        vk::CommandPool pool = device.createCommandPool( createInfo );
+                                               .setFlags( vk::CommandPoolCreateFlagBits::eTransient );
+        std::vector<vk::CommandPool> pools( context.FramesInFlight() );
+        for ( auto& pool : pools )
+            pool = device.createCommandPool( createInfo );
 
-        context.SetCommandPool( pool );
+        context.SetCommandPools( std::move( pools ) );
     }
 
     //--------------------------------------------------------------------------
-    void DeInitVulkanCommandPool( VulkanContext& context ) {
+    void DeInitVulkanCommandPools( VulkanContext& context ) {
         const vk::Device& device = context.Device();
-        device.destroyCommandPool( context.CommandPool() );
+        for ( auto pool : context.CommandPools() )
+            device.destroyCommandPool( pool );
+        context.SetCommandPools( std::vector<vk::CommandPool> {} );
     }
 
     //--------------------------------------------------------------------------
     void InitVulkanCommandBuffers( VulkanContext& context ) {
         const vk::Device& device = context.Device();
-        const vk::CommandPool& commandPool = context.CommandPool();
 
-        vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
-                .setCommandPool( commandPool )
-                .setLevel( vk::CommandBufferLevel::ePrimary )
-                .setCommandBufferCount( ( uint32_t )context.SwapchainImages().size() );
-        std::vector<vk::CommandBuffer> commandBuffers = device.allocateCommandBuffers( allocInfo );
+        std::vector<vk::CommandBuffer> commandBuffers;
+        for ( const vk::CommandPool& commandPool : context.CommandPools() ) {
+            vk::CommandBufferAllocateInfo allocInfo = vk::CommandBufferAllocateInfo()
+                    .setCommandPool( commandPool )
+                    .setLevel( vk::CommandBufferLevel::ePrimary )
+                    .setCommandBufferCount( 1 );
+            commandBuffers.push_back( device.allocateCommandBuffers( allocInfo )[0] );
+        }
 
         context.SetCommandBuffers( std::move( commandBuffers ) );
     }
@@ -354,7 +785,10 @@ namespace zealous {
     //--------------------------------------------------------------------------
     void DeInitVulkanCommandBuffers( VulkanContext& context ) {
         const vk::Device& device = context.Device();
-        device.freeCommandBuffers( context.CommandPool(), vk::ArrayProxy<const vk::CommandBuffer>( context.CommandBuffers() ) );
+        const std::vector<vk::CommandPool>& pools = context.CommandPools();
+        const std::vector<vk::CommandBuffer>& commandBuffers = context.CommandBuffers();
+        for ( size_t i = 0; i < commandBuffers.size(); ++i )
+            device.freeCommandBuffers( pools[i], commandBuffers[i] );
         context.SetCommandBuffers( std::vector<vk::CommandBuffer> {} );
     }
 
@@ -363,12 +797,15 @@ namespace zealous {
         const vk::Device& device = context.Device();
         vk::FenceCreateInfo createInfo = vk::FenceCreateInfo()
                                          .setFlags( vk::FenceCreateFlagBits::eSignaled );
-        const size_t fenceCount = context.SwapchainImages().size();
+        const size_t fenceCount = context.FramesInFlight();
         std::vector<vk::Fence> fences{ fenceCount };
         for ( size_t i = 0 ; i < fenceCount ; ++i )
             fences[i] = device.createFence( createInfo );
 
         context.SetFences( std::move( fences ) );
+
+        // no image is in use by any frame yet
+        context.SetImageFences( std::vector<vk::Fence>( context.SwapchainImages().size() ) );
     }
 
     //--------------------------------------------------------------------------
@@ -376,6 +813,7 @@ namespace zealous {
         const vk::Device& device = context.Device();
         std::vector<vk::Fence> fences = context.Fences();
         context.SetFences( std::vector<vk::Fence> {} );
+        context.SetImageFences( std::vector<vk::Fence> {} );
 
         device.waitForFences( vk::ArrayProxy<const vk::Fence>( fences ), true, std::numeric_limits<uint64_t>::max() );
         for ( auto fence : fences ) {
@@ -383,35 +821,102 @@ namespace zealous {
         }
     }
 
+    //--------------------------------------------------------------------------
+    void DeInitVulkanDeletions( VulkanContext& context ) {
+        // every fence has been waited on at this point
+        context.Deletions().Flush();
+    }
+
+    //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    std::vector<uint32_t> LoadShaderCode( const std::string& path ) {
+        std::ifstream file( path, std::ios::binary | std::ios::ate );
+        assert( file.is_open() );
+
+        const size_t size = ( size_t )file.tellg();
+        std::vector<uint32_t> code( ( size + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t ) );
+        file.seekg( 0 );
+        file.read( reinterpret_cast<char*>( code.data() ), size );
+        return code;
+    }
+
+    //--------------------------------------------------------------------------
+    vk::ShaderModule CreateShaderModule( const vk::Device& device, const std::vector<uint32_t>& code ) {
+        vk::ShaderModuleCreateInfo createInfo = vk::ShaderModuleCreateInfo()
+                                                .setCodeSize( code.size() * sizeof( uint32_t ) )
+                                                .setPCode( code.data() );
+        return device.createShaderModule( createInfo );
+    }
+
+    //--------------------------------------------------------------------------
+    vk::ShaderModule LoadShaderModule( const vk::Device& device, const std::string& path ) {
+        return CreateShaderModule( device, LoadShaderCode( path ) );
+    }
+
     //--------------------------------------------------------------------------
+    //--------------------------------------------------------------------------
+    StartupGraph::StageId AddInitVulkanStages( StartupGraph& graph, VulkanContext& context, StartupGraph::StageId windowStage ) {
+        using StageId = StartupGraph::StageId;
+        VulkanContext* target = &context;
+        auto addStage = [&graph, target]( const char* name, void ( *init )( VulkanContext& ), const std::vector<StageId>& dependencies ) {
+            return graph.AddStage( name, [target, init] { init( *target ); }, dependencies );
+        };
+
+        const StageId instance = graph.AddStage( "vulkan instance", [target] {
+            sDisplayCallbacks = true;
+            InitVulkanInstance( *target );
+        } );
+        const StageId debugLayer = addStage( "debug layer", InitVulkanDebugLayer, { instance } );
+        const StageId surface = addStage( "surface", InitVulkanSurface, { instance, windowStage } );
+        const StageId physicalDevice = addStage( "physical device", InitVulkanPhysicalDevice, { surface, debugLayer } );
+        const StageId device = addStage( "device", InitVulkanDevice, { physicalDevice } );
+
+        // everything below only needs the device, and what it builds on
+        const StageId allocator = addStage( "allocator", InitVulkanAllocator, { device } );
+        const StageId pipelineCache = addStage( "pipeline cache", InitVulkanPipelineCache, { device } );
+        const StageId queues = addStage( "queues", InitVulkanQueues, { device } );
+        const StageId semaphores = addStage( "semaphores", InitVulkanSemaphores, { device } );
+        const StageId swapchain = addStage( "swapchain", InitVulkanSwapchain, { device } );
+        const StageId swapchainImages = addStage( "swapchain images", InitVulkanSwapchainImages, { swapchain, allocator } );
+        const StageId swapchainImageViews = addStage( "swapchain image views", InitVulkanSwapchainImageViews, { swapchainImages } );
+        const StageId renderPass = addStage( "render pass", InitVulkanRenderPass, { swapchain } );
+        const StageId framebuffers = addStage( "framebuffers", InitVulkanFramebuffers, { swapchainImageViews, renderPass } );
+        const StageId commandPools = addStage( "command pools", InitVulkanCommandPools, { device } );
+        const StageId commandBuffers = addStage( "command buffers", InitVulkanCommandBuffers, { commandPools } );
+        const StageId fences = addStage( "fences", InitVulkanFences, { swapchainImages } );
+
+        return graph.AddStage( "vulkan ready", [] {
+            sDisplayCallbacks = false;
+        }, { allocator, pipelineCache, queues, semaphores, framebuffers, commandBuffers, fences } );
+    }
+
     //--------------------------------------------------------------------------
     void InitVulkan( VulkanContext& context ) {
-        sDisplayCallbacks = true;
-        InitVulkanInstance( context );
-        InitVulkanDebugLayer( context );
-        InitVulkanSurface( context );
-        InitVulkanPhysicalDevice( context );
-        InitVulkanDevice( context );
-        InitVulkanQueues( context );
-        InitVulkanSemaphores( context );
-        InitVulkanSwapchain( context );
-        InitVulkanSwapchainImages( context );
-        InitVulkanCommandPool( context );
-        InitVulkanCommandBuffers( context );
-        InitVulkanFences( context );
-        sDisplayCallbacks = false;
+        // same stages, in dependency order on the calling thread; the window
+        // is already there
+        StartupGraph graph;
+        const StartupGraph::StageId window = graph.AddStage( "window", [] {} );
+        AddInitVulkanStages( graph, context, window );
+        graph.Run( 0 );
     }
 
     //--------------------------------------------------------------------------
     void DeInitVulkan( VulkanContext& context ) {
         sDisplayCallbacks = true;
         DeInitVulkanFences( context );
+        DeInitVulkanDeletions( context );
         DeInitVulkanCommandBuffers( context );
-        DeInitVulkanCommandPool( context );
+        DeInitVulkanCommandPools( context );
+        DeInitVulkanFramebuffers( context );
+        DeInitVulkanRenderPass( context );
+        DeInitVulkanSwapchainImageViews( context );
         DeInitVulkanSwapchainImages( context );
         DeInitVulkanSwapchain( context );
         DeInitVulkanSemaphores( context );
         DeInitVulkanQueues( context );
+        DeInitVulkanPipelineCache( context );
+        DeInitVulkanAllocator( context );
+        PrintLiveHandles( std::cerr );
         DeInitVulkanDevice( context );
         DeInitVulkanPhysicalDevice( context );
         DeInitVulkanSurface( context );
@@ -423,25 +928,42 @@ namespace zealous {
     //--------------------------------------------------------------------------
     //--------------------------------------------------------------------------
     bool MustUpdateVulkan( VulkanContext& context ) {
-        int w, h;
-        SDL_Vulkan_GetDrawableSize( context.SDLWindow(), &w, &h );
-        return ( context.WindowWidth() != w or context.WindowHeight() != h );
+        return context.SwapchainOutOfDate();
     }
 
     //--------------------------------------------------------------------------
-    void UpdateVulkan( VulkanContext& context ) {
+    bool UpdateVulkan( VulkanContext& context ) {
+        // a minimized window has a 0x0 drawable, no swapchain can be built for
+        // it, keep the request pending until the window comes back
+        int w, h;
+        SDL_Vulkan_GetDrawableSize( context.SDLWindow(), &w, &h );
+        if ( w == 0 or h == 0 )
+            return false;
+
         sDisplayCallbacks = true;
-        DeInitVulkanFences( context );
-        DeInitVulkanCommandBuffers( context );
-        DeInitVulkanCommandPool( context );
-        DeInitVulkanSwapchainImages( context );
-        //DeInitVulkanSwapchain( context );
+
+        // no wait here: frames in flight keep using the old objects, the
+        // deletion queue destroys them once the last of them is done; the old
+        // swapchain is still needed to build the new one
+        const vk::Device& device = context.Device();
+        const uint64_t serial = context.SubmittedFrameSerial();
+        DeletionQueue& deletions = context.Deletions();
+        for ( auto framebuffer : context.Framebuffers() )
+            deletions.Retire( UniqueFramebuffer( device, framebuffer ), serial );
+        for ( auto imageView : context.SwapchainImageViews() )
+            deletions.Retire( UniqueImageView( device, imageView ), serial );
+        UniqueSwapchain oldSwapchain( device, context.Swapchain() );
 
         InitVulkanSwapchain( context );
         InitVulkanSwapchainImages( context );
-        InitVulkanCommandPool( context );
-        InitVulkanCommandBuffers( context );
-        InitVulkanFences( context );
+        InitVulkanSwapchainImageViews( context );
+        InitVulkanFramebuffers( context );
+        deletions.Retire( std::move( oldSwapchain ), serial );
+
+        // the new images aren't used by any frame yet
+        context.SetImageFences( std::vector<vk::Fence>( context.SwapchainImages().size() ) );
+        context.SetSwapchainOutOfDate( false );
         sDisplayCallbacks = false;
+        return true;
     }
 }
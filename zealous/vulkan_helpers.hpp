@@ -1,11 +1,22 @@
 #pragma once
 
+#include "startup_graph.hpp"
 #include "vulkan_context.hpp"
 
+#include <string>
+#include <vector>
+
 namespace zealous {
     void InitVulkan( VulkanContext& context );
+    // InitVulkan as startup stages, the surface waits on windowStage; returns
+    // the stage after which the context is complete
+    StartupGraph::StageId AddInitVulkanStages( StartupGraph& graph, VulkanContext& context, StartupGraph::StageId windowStage );
     void DeInitVulkan( VulkanContext& context );
 
     bool MustUpdateVulkan( VulkanContext& context );
-    void UpdateVulkan( VulkanContext& context );
+    bool UpdateVulkan( VulkanContext& context );
+
+    std::vector<uint32_t> LoadShaderCode( const std::string& path );
+    vk::ShaderModule CreateShaderModule( const vk::Device& device, const std::vector<uint32_t>& code );
+    vk::ShaderModule LoadShaderModule( const vk::Device& device, const std::string& path );
 }
@@ -1,159 +1,984 @@
 #include "vulkan_render.hpp"
+#include "simd_math.hpp"
+#include "tracer.hpp"
+#include "vulkan_helpers.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <ostream>
 #include <SDL_timer.h>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 namespace zealous {
+    //--------------------------------------------------------------------------
+    // per-frame values read by the shaders, at the start of each frame's
+    // partition of the frame data
+    struct FrameUniforms {
+        std::array<float, 4> clearColor;
+        std::array<float, 4> params;    // x: time in seconds
+        std::array<float, 4> view;      // xy: center, z: zoom
+    };
+
+    //--------------------------------------------------------------------------
+    // push constants of shaders/instanced.vert
+    struct DrawConstants {
+        uint32_t instanceBuffer;
+        uint32_t firstInstance;
+    };
+
+    //--------------------------------------------------------------------------
+    // the instances are split over a few indirect draws rather than one so the
+    // path without multiDrawIndirect is exercised with the same data
+    static constexpr uint32_t kIndirectDrawCount = 4;
+
+    //--------------------------------------------------------------------------
+    static constexpr uint32_t kSlicesPerThread = 4;
+
+    //--------------------------------------------------------------------------
+    // per frame, besides the uniforms and the animated instances
+    static constexpr vk::DeviceSize kFrameDataHeadroom = 64 * 1024;
+
+    //--------------------------------------------------------------------------
+    const char* FrameStageName( FrameStage stage ) {
+        switch ( stage ) {
+            case FrameStage::eWait:    return "wait";
+            case FrameStage::eAcquire: return "acquire";
+            case FrameStage::eRecord:  return "record";
+            case FrameStage::eSubmit:  return "submit";
+            case FrameStage::ePresent: return "present";
+            default:                   return "?";
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    static double ElapsedMilliseconds( uint64_t start, uint64_t end ) {
+        return 1000.0 * ( end - start ) / SDL_GetPerformanceFrequency();
+    }
+
+    //--------------------------------------------------------------------------
+    Renderer::Renderer()
+        : instanceCount( 1 << 20 )
+        , drawCount( 0 )
+        , instancesPerDraw( 0 )
+        , positionData( nullptr )
+        , colorData( nullptr )
+        , vertexCount( 0 )
+        , indexData( nullptr )
+        , indexCount( 0 )
+        , instanceData( nullptr )
+        , cpuAnimation( false )
+        , recordingThreads( 0 )
+        , sceneDrawCount( 4096 )
+        , particleCount( 0 )
+        , asyncCompute( true )
+        , particleTime( 0.0 )
+        , gpuCulling( false )
+        , blockedMilliseconds( 0.0 ) {
+    }
+
+    //--------------------------------------------------------------------------
+    static const char* const kShaderPaths[] = {
+        "shaders/fullscreen.vert.spv",
+        "shaders/clear_color.frag.spv",
+        "shaders/instanced.vert.spv",
+        "shaders/instanced.frag.spv",
+        "shaders/particles.comp.spv",
+        "shaders/cull.comp.spv"
+    };
+
+    //--------------------------------------------------------------------------
+    void Renderer::LoadAssets() {
+        if ( assetPackPath.empty() or not MapGeometry() )
+            GenerateGeometry();
+
+        for ( const char* path : kShaderPaths )
+            shaderCode[path] = LoadShaderCode( path );
+    }
+
+    //--------------------------------------------------------------------------
+    bool Renderer::WriteAssetPack( const std::string& path ) {
+        GenerateGeometry();
+        AssetPackWriter writer;
+        writer.AddBuffer( "triangle.positions", AssetKind::eVertices, positions.data(), InstancedVertexLayout::Stride( kPositionStream ), vertexCount );
+        writer.AddBuffer( "triangle.colors", AssetKind::eVertices, colors.data(), InstancedVertexLayout::Stride( kColorStream ), vertexCount );
+        writer.AddBuffer( "triangle.indices", AssetKind::eIndices, indices.data(), sizeof( uint16_t ), ( uint32_t )indices.size() );
+        if ( not instances.empty() )
+            writer.AddBuffer( "grid.instances", AssetKind::eInstances, instances.data(), sizeof( InstanceData ), ( uint32_t )instances.size() );
+        const bool written = writer.Write( path );
+        instances = std::vector<InstanceData>();
+        instanceData = nullptr;
+        return written;
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::GenerateGeometry() {
+        // the triangle every instance draws, built as floats and quantized
+        // to the formats of its streams
+        const size_t nVertices = kTriangleVertexCount;
+        std::array<float, kTriangleVertexCount> angles;
+        std::array<float, kTriangleVertexCount> sines;
+        std::array<float, kTriangleVertexCount> cosines;
+        for ( size_t i = 0; i < nVertices; ++i )
+            angles[i] = 2.f * float( M_PI ) * i / nVertices;
+        BatchSinCos( angles.data(), sines.data(), cosines.data(), nVertices );
+
+        std::array<float, 2 * kTriangleVertexCount> positionFloats;
+        std::array<float, 4 * kTriangleVertexCount> colorFloats;
+        for ( size_t i = 0; i < nVertices; ++i ) {
+            positionFloats[2 * i + 0] = sines[i];
+            positionFloats[2 * i + 1] = cosines[i];
+
+            constexpr std::array<float, 4> colorUsed = {1.f, 0.f, 0.f, 1.f};
+            std::copy( colorUsed.begin(), colorUsed.end(), colorFloats.begin() + 4 * i );
+        }
+        EncodeSnorm16( positionFloats.data(), positions[0].data(), positionFloats.size() );
+        EncodeUnorm8( colorFloats.data(), colors[0].data(), colorFloats.size() );
+        indices = { 0, 1, 2 };
+
+        // instances on a square grid covering clip space, each one spinning
+        // with its own phase; particles make their own on the GPU
+        if ( particleCount != 0 )
+            instanceCount = particleCount;
+        const uint32_t side = ( uint32_t )std::ceil( std::sqrt( ( double )instanceCount ) );
+        const float cell = 2.f / side;
+        instances.resize( particleCount != 0 ? 0 : instanceCount );
+        for ( uint32_t i = 0; i < instances.size(); ++i ) {
+            InstanceData& instance = instances[i];
+            instance.offset[0] = -1.f + cell * ( ( i % side ) + 0.5f );
+            instance.offset[1] = -1.f + cell * ( ( i / side ) + 0.5f );
+            instance.scale = cell * 0.5f;
+            instance.phase = 2.f * float( M_PI ) * ( ( i * 2654435761u ) / 4294967296.f );
+        }
+
+        positionData = positions.data();
+        colorData = colors.data();
+        vertexCount = ( uint32_t )positions.size();
+        indexData = indices.data();
+        indexCount = ( uint32_t )indices.size();
+        instanceData = instances.empty() ? nullptr : instances.data();
+    }
+
+    //--------------------------------------------------------------------------
+    bool Renderer::MapGeometry() {
+        if ( not assetPack.Open( assetPackPath ) ) {
+            std::cerr << "Could not open asset pack " << assetPackPath << ", generating the geometry" << std::endl;
+            return false;
+        }
+
+        // nothing is read but the table of contents, the strides are checked
+        // against what the pipeline expects; particles make their own instances
+        const AssetView positionAsset = assetPack.Find( "triangle.positions" );
+        const AssetView colorAsset = assetPack.Find( "triangle.colors" );
+        const AssetView indexAsset = assetPack.Find( "triangle.indices" );
+        const AssetView instanceAsset = assetPack.Find( "grid.instances" );
+        const bool vertexUsable = positionAsset and positionAsset.entry->stride == InstancedVertexLayout::Stride( kPositionStream )
+                                  and colorAsset and colorAsset.entry->stride == InstancedVertexLayout::Stride( kColorStream )
+                                  and positionAsset.entry->count == colorAsset.entry->count;
+        const bool indexUsable = indexAsset and indexAsset.entry->stride == sizeof( uint16_t ) and indexAsset.entry->count != 0;
+        const bool instanceUsable = particleCount != 0
+                                    or ( instanceAsset and instanceAsset.entry->stride == sizeof( InstanceData ) and instanceAsset.entry->count != 0 );
+        if ( not vertexUsable or not indexUsable or not instanceUsable ) {
+            std::cerr << "Asset pack " << assetPackPath << " has no usable geometry, generating it" << std::endl;
+            assetPack.Close();
+            return false;
+        }
+
+        positionData = positionAsset.data;
+        colorData = colorAsset.data;
+        vertexCount = positionAsset.entry->count;
+        indexData = static_cast<const uint16_t*>( indexAsset.data );
+        indexCount = indexAsset.entry->count;
+        if ( particleCount != 0 )
+            instanceCount = particleCount;
+        else {
+            instanceData = static_cast<const InstanceData*>( instanceAsset.data );
+            instanceCount = instanceAsset.entry->count;
+        }
+        return true;
+    }
+
     //--------------------------------------------------------------------------
     void Renderer::InitRender( std::shared_ptr<VulkanContext> context ) {
         this->context = context;
 
+        uploadManager.Init( context );
+        descriptorHeap.Init( context, uploadManager );
+
+        // assets loaded ahead of time, by the startup graph, or now
+        if ( shaderCode.empty() )
+            LoadAssets();
+
+        if ( particleCount != 0 ) {
+            particles.Init( context, particleCount, shaderCode.at( "shaders/particles.comp.spv" ) );
+            particles.SetAsync( asyncCompute );
+            instanceCount = particles.ParticleCount();
+            particleTime = 0.0;
+        }
+        InitFrameUniforms();
+        InitGeometry();
+        InitPipeline();
+        if ( GpuCullingEnabled() )
+            culling.Init( context, descriptorHeap, instanceCount, indexCount, shaderCode.at( "shaders/cull.comp.spv" ) );
+        shaderCode.clear();
+
+        commandBufferCache.Init( context->Device(), context->GraphicsQueueFamilyIndex(), context->Deletions() );
+        renderState = 0;
+
+        const std::vector<vk::QueueFamilyProperties> families = context->PhysicalDevice().getQueueFamilyProperties();
+        gpuProfiler.Init( context->Device(), context->PhysicalDeviceProperties(),
+                          families[context->GraphicsQueueFamilyIndex()].timestampValidBits, context->FramesInFlight() );
+        renderGraph.Init( context );
+
+        if ( recordingThreads != 0 ) {
+            threadPool.Init( recordingThreads - 1 );
+            parallelRecorder.Init( context->Device(), context->GraphicsQueueFamilyIndex(), threadPool.SlotCount(), context->FramesInFlight() );
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    UniqueBuffer Renderer::CreateStaticBuffer( const void* data, vk::DeviceSize size, vk::BufferUsageFlags usage,
+            vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess, Allocation& memory ) {
+        // device local, filled through the staging ring, ownership goes back
+        // to the graphics family with the upload
+        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
+                                          .setSharingMode( vk::SharingMode::eExclusive )
+                                          .setSize( size )
+                                          .setUsage( usage | vk::BufferUsageFlagBits::eTransferDst );
+        UniqueBuffer buffer( context->Device(), context->Device().createBuffer( createInfo ) );
+
+        const MemoryUsage memoryUsage = { vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags() };
+        memory = context->Allocator().AllocateBuffer( buffer, memoryUsage );
+        uploadManager.UploadBuffer( buffer, 0, data, size, dstStage, dstAccess );
+        return buffer;
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::InitGeometry() {
+        // without drawIndirectFirstInstance every draw starts at instance 0 and
+        // the chunk offset is pushed as a constant instead
+        const bool firstInstance = !!context->EnabledFeatures().drawIndirectFirstInstance;
+        drawCount = std::min( kIndirectDrawCount, instanceCount );
+        instancesPerDraw = ( instanceCount + drawCount - 1 ) / drawCount;
+        // rounding up may leave nothing for the last draws, 5 instances are
+        // 3 draws of 2, 2 and 1
+        drawCount = ( instanceCount + instancesPerDraw - 1 ) / instancesPerDraw;
+        std::vector<vk::DrawIndexedIndirectCommand> commands( drawCount );
+        for ( uint32_t draw = 0; draw < drawCount; ++draw ) {
+            const uint32_t first = draw * instancesPerDraw;
+            commands[draw] = vk::DrawIndexedIndirectCommand()
+                             .setIndexCount( indexCount )
+                             .setInstanceCount( std::min( instancesPerDraw, instanceCount - first ) )
+                             .setFirstIndex( 0 )
+                             .setVertexOffset( 0 )
+                             .setFirstInstance( firstInstance ? first : 0 );
+        }
+
+        // straight from where LoadAssets left them, the mapped pack included:
+        // the staging copy is the only one
+        positionBuffer = CreateStaticBuffer( positionData, vertexCount * InstancedVertexLayout::Stride( kPositionStream ), vk::BufferUsageFlagBits::eVertexBuffer,
+                                             vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead, positionMemory );
+        colorBuffer = CreateStaticBuffer( colorData, vertexCount * InstancedVertexLayout::Stride( kColorStream ), vk::BufferUsageFlagBits::eVertexBuffer,
+                                          vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead, colorMemory );
+        indexBuffer = CreateStaticBuffer( indexData, indexCount * sizeof( uint16_t ), vk::BufferUsageFlagBits::eIndexBuffer,
+                                          vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead, indexMemory );
+        if ( instanceData != nullptr and CpuAnimationEnabled() ) {
+            // every instance circles the center of its cell at half the size,
+            // the triangle stays within the cell
+            orbitCenterX.resize( instanceCount );
+            orbitCenterY.resize( instanceCount );
+            orbitRadius.resize( instanceCount );
+            orbitScale.resize( instanceCount );
+            orbitPhase.resize( instanceCount );
+            for ( uint32_t i = 0; i < instanceCount; ++i ) {
+                orbitCenterX[i] = instanceData[i].offset[0];
+                orbitCenterY[i] = instanceData[i].offset[1];
+                orbitRadius[i] = instanceData[i].scale * 0.5f;
+                orbitScale[i] = instanceData[i].scale * 0.5f;
+                orbitPhase[i] = instanceData[i].phase;
+            }
+            // each frame slot reads the range its frames will write
+            for ( uint32_t frame = 0; frame < context->FramesInFlight(); ++frame ) {
+                RingAllocation uniforms;
+                RingAllocation instances;
+                AllocateFrameData( frame, uniforms, instances );
+                instanceHeapIndices.push_back( descriptorHeap.RegisterBuffer( frameData.Buffer(), instances.offset, instances.size ) );
+            }
+        } else if ( instanceData != nullptr ) {
+            instanceBuffer = CreateStaticBuffer( instanceData, instanceCount * sizeof( InstanceData ), vk::BufferUsageFlagBits::eStorageBuffer,
+                                                 vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader,
+                                                 vk::AccessFlagBits::eShaderRead, instanceMemory );
+            instanceHeapIndices.assign( 1, descriptorHeap.RegisterBuffer( instanceBuffer ) );
+        } else {
+            for ( uint32_t frame = 0; frame < context->FramesInFlight(); ++frame )
+                instanceHeapIndices.push_back( descriptorHeap.RegisterBuffer( particles.InstanceBuffer( frame ) ) );
+        }
+        indirectBuffer = CreateStaticBuffer( commands.data(), commands.size() * sizeof( vk::DrawIndexedIndirectCommand ), vk::BufferUsageFlagBits::eIndirectBuffer,
+                                             vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, indirectMemory );
+        uploadManager.Flush();
+
+        // the staging copy is all the upload needed
+        instances = std::vector<InstanceData>();
+        assetPack.Close();
+        positionData = nullptr;
+        colorData = nullptr;
+        indexData = nullptr;
+        instanceData = nullptr;
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::DeInitGeometry() {
+        MemoryAllocator& allocator = context->Allocator();
+        for ( uint32_t index : instanceHeapIndices )
+            descriptorHeap.Release( HeapKind::eBuffer, index );
+        instanceHeapIndices.clear();
+        orbitCenterX = std::vector<float>();
+        orbitCenterY = std::vector<float>();
+        orbitRadius = std::vector<float>();
+        orbitScale = std::vector<float>();
+        orbitPhase = std::vector<float>();
+        indirectBuffer.Reset();
+        allocator.Free( indirectMemory );
+        instanceBuffer.Reset();
+        allocator.Free( instanceMemory );
+        indexBuffer.Reset();
+        allocator.Free( indexMemory );
+        colorBuffer.Reset();
+        allocator.Free( colorMemory );
+        positionBuffer.Reset();
+        allocator.Free( positionMemory );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::InitFrameUniforms() {
         const vk::Device& device = context->Device();
 
-        // create the buffer with the vertex data
-        struct Vertex_Pos2f_Color4f {
-            std::array<float, 2> pos;
-            std::array<float, 4> color;
-        };
-        static_assert( sizeof( Vertex_Pos2f_Color4f ) == 6 * sizeof( float ) );
+        // the uniforms sit at the start of each frame's partition of the
+        // ring, bound through a dynamic offset; the rest is room for the
+        // animated instances and whatever else a frame writes
+        vk::DeviceSize bytesPerFrame = sizeof( FrameUniforms ) + kFrameDataHeadroom;
+        if ( CpuAnimationEnabled() )
+            bytesPerFrame += vk::DeviceSize( instanceCount ) * sizeof( InstanceData );
+        frameData.Init( context, bytesPerFrame, vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+                        | vk::BufferUsageFlagBits::eIndirectBuffer );
 
-        std::array<Vertex_Pos2f_Color4f, 3> vertices;
-        const size_t nVertices = vertices.size();
-        for ( int i = 0; i < vertices.size(); ++i ) {
-            Vertex_Pos2f_Color4f& vertex = vertices[i];
+        // descriptors
+        vk::DescriptorSetLayoutBinding binding = vk::DescriptorSetLayoutBinding()
+                .setBinding( 0 )
+                .setDescriptorType( vk::DescriptorType::eUniformBufferDynamic )
+                .setDescriptorCount( 1 )
+                .setStageFlags( vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment );
+        vk::DescriptorSetLayoutCreateInfo layoutInfo = vk::DescriptorSetLayoutCreateInfo()
+                .setBindingCount( 1 )
+                .setPBindings( &binding );
+        descriptorSetLayout = UniqueDescriptorSetLayout( device, device.createDescriptorSetLayout( layoutInfo ) );
 
-            const float angle = ( 2.f * float( M_PI ) * i / nVertices );
-            vertex.pos[0] = std::sin( angle );
-            vertex.pos[1] = std::cos( angle );
+        vk::DescriptorPoolSize poolSize = vk::DescriptorPoolSize()
+                                          .setType( vk::DescriptorType::eUniformBufferDynamic )
+                                          .setDescriptorCount( 1 );
+        vk::DescriptorPoolCreateInfo poolInfo = vk::DescriptorPoolCreateInfo()
+                                                .setMaxSets( 1 )
+                                                .setPoolSizeCount( 1 )
+                                                .setPPoolSizes( &poolSize );
+        descriptorPool = UniqueDescriptorPool( device, device.createDescriptorPool( poolInfo ) );
 
-            constexpr std::array<float, 4> colorUsed = {1.f, 0.f, 0.f, 1.f};
-            vertex.color = colorUsed;
+        vk::DescriptorSetAllocateInfo setInfo = vk::DescriptorSetAllocateInfo()
+                                                .setDescriptorPool( descriptorPool )
+                                                .setDescriptorSetCount( 1 )
+                                                .setPSetLayouts( &descriptorSetLayout.Get() );
+        descriptorSet = device.allocateDescriptorSets( setInfo )[0];
+
+        vk::DescriptorBufferInfo bufferInfo = vk::DescriptorBufferInfo()
+                                              .setBuffer( frameData.Buffer() )
+                                              .setOffset( 0 )
+                                              .setRange( sizeof( FrameUniforms ) );
+        vk::WriteDescriptorSet write = vk::WriteDescriptorSet()
+                                       .setDstSet( descriptorSet )
+                                       .setDstBinding( 0 )
+                                       .setDescriptorCount( 1 )
+                                       .setDescriptorType( vk::DescriptorType::eUniformBufferDynamic )
+                                       .setPBufferInfo( &bufferInfo );
+        device.updateDescriptorSets( write, nullptr );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::DeInitFrameUniforms() {
+        descriptorPool.Reset();
+        descriptorSetLayout.Reset();
+        frameData.DeInit();
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::AllocateFrameData( uint32_t frameIndex, RingAllocation& uniforms, RingAllocation& instances ) {
+        frameData.BeginFrame( frameIndex );
+        uniforms = frameData.Allocate( sizeof( FrameUniforms ) );
+        assert( uniforms.offset == frameData.FrameOffset( frameIndex ) );
+        if ( CpuAnimationEnabled() ) {
+            instances = frameData.Allocate( vk::DeviceSize( instanceCount ) * sizeof( InstanceData ), alignof( InstanceData ) );
+            assert( instances );
         }
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::InitPipeline() {
+        const vk::Device& device = context->Device();
 
-        constexpr size_t bufferSize = sizeof( vertices );
+        // set 0 the frame uniforms, set 1 the descriptor heap
+        const std::array<vk::DescriptorSetLayout, 2> setLayouts = { descriptorSetLayout.Get(), descriptorHeap.SetLayout() };
+        const vk::PushConstantRange pushConstants( vk::ShaderStageFlagBits::eVertex, 0, sizeof( DrawConstants ) );
+        vk::PipelineLayoutCreateInfo layoutInfo = vk::PipelineLayoutCreateInfo()
+                .setSetLayoutCount( ( uint32_t )setLayouts.size() )
+                .setPSetLayouts( setLayouts.data() )
+                .setPushConstantRangeCount( 1 )
+                .setPPushConstantRanges( &pushConstants );
+        pipelineLayout = UniquePipelineLayout( device, device.createPipelineLayout( layoutInfo ) );
 
-        const uint32_t familyIndex = context->GraphicsQueueFamilyIndex();
-        vk::BufferCreateInfo createInfo = vk::BufferCreateInfo()
-                                          .setQueueFamilyIndexCount( 1 )
-                                          .setPQueueFamilyIndices( &familyIndex )
-                                          .setSharingMode( vk::SharingMode::eConcurrent )
-                                          .setSize( bufferSize )
-                                          .setUsage( vk::BufferUsageFlagBits::eUniformBuffer );
-        buffer = device.createBuffer( createInfo );
-
-        const vk::MemoryRequirements reqs = device.getBufferMemoryRequirements( buffer );
-        vk::MemoryAllocateInfo allocInfo = vk::MemoryAllocateInfo()
-                                           .setAllocationSize( reqs.size );
-
-        // determine the memory type index
-        const vk::MemoryPropertyFlags desiredFlags = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-        const vk::PhysicalDeviceMemoryProperties& memoryProperties = context->PhysicalDeviceMemoryProperties();
-        for ( uint32_t i = 0, typeBits = reqs.memoryTypeBits; i < memoryProperties.memoryTypeCount; i++ ) {
-            if ( ( typeBits & 1 ) == 1 ) {
-                // Type is available, does it match user properties?
-                if ( ( memoryProperties.memoryTypes[i].propertyFlags & desiredFlags ) == desiredFlags ) {
-                    allocInfo.setMemoryTypeIndex( i );
-                    break;
+        pipelineManager.Init( context, kPipelineWorkers );
+
+        // nothing at all is drawn without the clear, it's worth the wait
+        clearPipeline = pipelineManager.Request( PipelineDesc( "shaders/fullscreen.vert.spv", "shaders/clear_color.frag.spv" ) ).Wait();
+
+        // instances come from the heap, only the vertices are attributes
+        instancedDesc = PipelineDesc( "shaders/instanced.vert.spv", "shaders/instanced.frag.spv" );
+        instancedDesc.bindings = InstancedVertexLayout::Bindings();
+        instancedDesc.attributes = InstancedVertexLayout::AttributeDescriptions();
+        // not waited on, the instances show up once it's built
+        instancedPipeline = vk::Pipeline();
+        materialPipelines = {};
+        materialPipelines[0] = pipelineManager.Request( instancedDesc );
+    }
+
+    //--------------------------------------------------------------------------
+    GraphicsPipelineDesc Renderer::PipelineDesc( const char* vertexPath, const char* fragmentPath ) const {
+        // constant 0 sizes the heap buffer array, ignored by shaders without it
+        GraphicsPipelineDesc desc;
+        desc.vertexCode = std::make_shared<const std::vector<uint32_t>>( shaderCode.at( vertexPath ) );
+        desc.fragmentCode = std::make_shared<const std::vector<uint32_t>>( shaderCode.at( fragmentPath ) );
+        desc.vertexConstants = { descriptorHeap.Capacity( HeapKind::eBuffer ) };
+        desc.layout = pipelineLayout;
+        desc.renderPass = context->RenderPass();
+        return desc;
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::SelectMaterial( uint32_t material ) {
+        // first use requests the variant, the current one keeps drawing until
+        // it's built; switching re-records the cached commands
+        PipelineHandle& handle = materialPipelines[material % kMaterialCount];
+        if ( not handle ) {
+            GraphicsPipelineDesc desc = instancedDesc;
+            desc.blend = material % kMaterialCount == 0 ? BlendMode::eOpaque : BlendMode::eAdditive;
+            handle = pipelineManager.Request( desc );
+        }
+        const vk::Pipeline pipeline = handle.Get();
+        if ( pipeline and pipeline != instancedPipeline ) {
+            instancedPipeline = pipeline;
+            InvalidateRender();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::DeInitPipeline() {
+        pipelineManager.DeInit();
+        materialPipelines = {};
+        instancedPipeline = vk::Pipeline();
+        clearPipeline = vk::Pipeline();
+        pipelineLayout.Reset();
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::WaitForPipelines() {
+        for ( const PipelineHandle& handle : materialPipelines )
+            handle.Wait();
+        SelectMaterial( 0 );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::InvalidateRender() {
+        // frames still in flight keep replaying the old buffers
+        commandBufferCache.Invalidate( context->SubmittedFrameSerial() );
+        ++renderState;
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::BeginSecondary( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex ) {
+        vk::CommandBufferInheritanceInfo inheritance = vk::CommandBufferInheritanceInfo()
+                .setRenderPass( context->RenderPass() )
+                .setSubpass( 0 )
+                .setFramebuffer( context->Framebuffers()[imageIndex] );
+        vk::CommandBufferBeginInfo info = vk::CommandBufferBeginInfo()
+                                          .setFlags( vk::CommandBufferUsageFlagBits::eRenderPassContinue )
+                                          .setPInheritanceInfo( &inheritance );
+        commandBuffer.begin( info );
+
+        // nothing is inherited from the primary nor from the other secondaries
+        const float width = ( float )context->WindowWidth();
+        const float height = ( float )context->WindowHeight();
+        commandBuffer.setViewport( 0, vk::Viewport( 0.f, 0.f, width, height, 0.f, 1.f ) );
+        commandBuffer.setScissor( 0, vk::Rect2D( vk::Offset2D( 0, 0 ), vk::Extent2D( context->WindowWidth(), context->WindowHeight() ) ) );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::RecordClear( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex ) {
+        // the color itself lives in the frame's partition of the ring
+        const uint32_t dynamicOffset = ( uint32_t )frameData.FrameOffset( frameIndex );
+        commandBuffer.bindPipeline( vk::PipelineBindPoint::eGraphics, clearPipeline );
+        commandBuffer.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, dynamicOffset );
+        commandBuffer.draw( 3, 1, 0, 0 );
+    }
+
+    //--------------------------------------------------------------------------
+    uint32_t Renderer::InstanceHeapIndex( uint32_t frameIndex ) const {
+        return instanceHeapIndices[instanceHeapIndices.size() == 1 ? 0 : frameIndex];
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::BindInstancedGeometry( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex ) {
+        const uint32_t dynamicOffset = ( uint32_t )frameData.FrameOffset( frameIndex );
+        commandBuffer.bindPipeline( vk::PipelineBindPoint::eGraphics, instancedPipeline );
+        const std::array<vk::DescriptorSet, 2> sets = { descriptorSet, descriptorHeap.Set( frameIndex ) };
+        commandBuffer.bindDescriptorSets( vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, dynamicOffset );
+        // culled, the draw reads the compacted instances
+        const uint32_t instances = GpuCullingEnabled() ? culling.VisibleHeapIndex( frameIndex ) : InstanceHeapIndex( frameIndex );
+        const DrawConstants constants = { instances, 0 };
+        commandBuffer.pushConstants( pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof( constants ), &constants );
+        // one binding per stream, in stream order
+        const std::array<vk::Buffer, InstancedVertexLayout::kStreamCount> streams = { positionBuffer.Get(), colorBuffer.Get() };
+        const std::array<vk::DeviceSize, InstancedVertexLayout::kStreamCount> offsets = {};
+        commandBuffer.bindVertexBuffers( 0, streams, offsets );
+        commandBuffer.bindIndexBuffer( indexBuffer, 0, vk::IndexType::eUint16 );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::RecordInstances( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex ) {
+        BindInstancedGeometry( commandBuffer, frameIndex );
+
+        const vk::PhysicalDeviceFeatures& features = context->EnabledFeatures();
+        const uint32_t commandStride = sizeof( vk::DrawIndexedIndirectCommand );
+        if ( GpuCullingEnabled() )
+            commandBuffer.drawIndexedIndirect( culling.IndirectBuffer( frameIndex ), 0, 1, commandStride );
+        else if ( features.multiDrawIndirect and features.drawIndirectFirstInstance )
+            commandBuffer.drawIndexedIndirect( indirectBuffer, 0, drawCount, commandStride );
+        else {
+            for ( uint32_t draw = 0; draw < drawCount; ++draw ) {
+                if ( not features.drawIndirectFirstInstance ) {
+                    const DrawConstants constants = { InstanceHeapIndex( frameIndex ), draw * instancesPerDraw };
+                    commandBuffer.pushConstants( pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof( constants ), &constants );
                 }
+                commandBuffer.drawIndexedIndirect( indirectBuffer, vk::DeviceSize( draw ) * commandStride, 1, commandStride );
             }
-            typeBits >>= 1;
         }
+    }
 
-        deviceMemory = device.allocateMemory( allocInfo );
-        void* memory = device.mapMemory( deviceMemory, 0, bufferSize );
-        memcpy( memory, &vertices, bufferSize );
-        device.unmapMemory( deviceMemory );
+    //--------------------------------------------------------------------------
+    void Renderer::RecordStaticCommands( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex, uint32_t frameIndex ) {
+        BeginSecondary( commandBuffer, imageIndex );
+        {
+            RecordClear( commandBuffer, frameIndex );
+            // re-recorded once the pipeline is built
+            if ( instancedPipeline )
+                RecordInstances( commandBuffer, frameIndex );
+        }
+        commandBuffer.end();
+    }
 
-        device.bindBufferMemory( buffer, deviceMemory, 0 );
+    //--------------------------------------------------------------------------
+    void Renderer::RecordSlice( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex, uint32_t frameIndex,
+                                uint32_t slice, uint32_t sliceCount ) {
+        // the scene is sceneDrawCount direct draws, each slice records a
+        // contiguous range of them; the clear goes first, with slice 0
+        const uint32_t firstDraw = uint32_t( uint64_t( slice ) * sceneDrawCount / sliceCount );
+        const uint32_t endDraw = uint32_t( uint64_t( slice + 1 ) * sceneDrawCount / sliceCount );
+
+        BeginSecondary( commandBuffer, imageIndex );
+        {
+            if ( slice == 0 )
+                RecordClear( commandBuffer, frameIndex );
+
+            // skipped until the pipeline is built
+            if ( instancedPipeline ) {
+                BindInstancedGeometry( commandBuffer, frameIndex );
+                for ( uint32_t draw = firstDraw; draw < endDraw; ++draw ) {
+                    const uint32_t firstInstance = uint32_t( uint64_t( draw ) * instanceCount / sceneDrawCount );
+                    const uint32_t endInstance = uint32_t( uint64_t( draw + 1 ) * instanceCount / sceneDrawCount );
+                    commandBuffer.drawIndexed( indexCount, endInstance - firstInstance, 0, 0, firstInstance );
+                }
+            }
+        }
+        commandBuffer.end();
     }
 
     //--------------------------------------------------------------------------
-    void Renderer::RenderOnce() {
-        const vk::Device& device = context->Device();
-        auto valueResult = device.acquireNextImageKHR( context->Swapchain(),
-                           std::numeric_limits<uint64_t>::max(),
-                           context->ImageAvailableSemaphore(),
-                           vk::Fence() );
+    void Renderer::RecordParallel( ThreadPool& pool, ParallelRecorder& recorder, uint32_t imageIndex, uint32_t frameIndex,
+                                   std::vector<vk::CommandBuffer>& commandBuffers ) {
+        // a few slices per thread so the ones finishing early have something
+        // to steal
+        const uint32_t sliceCount = std::min( sceneDrawCount, pool.SlotCount() * kSlicesPerThread );
+        commandBuffers.resize( sliceCount );
+
+        pool.ParallelFor( sliceCount, [&]( uint32_t slice, uint32_t slot ) {
+            TRACE_SCOPE( "record slice" );
+            const vk::CommandBuffer commandBuffer = recorder.Allocate( slot, frameIndex );
+            RecordSlice( commandBuffer, imageIndex, frameIndex, slice, sliceCount );
+            commandBuffers[slice] = commandBuffer;
+        } );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::BenchmarkRecording( uint32_t maxThreads, uint32_t iterations, std::ostream& stream ) {
+        // nothing recorded here is submitted, the pools can be reset at will
+        std::vector<vk::CommandBuffer> commandBuffers;
+        double singleThreadAverage = 0.0;
+        stream << "Recording " << sceneDrawCount << " draws, " << iterations << " iterations" << std::endl;
+        for ( uint32_t threads = 1; threads <= maxThreads; ++threads ) {
+            ThreadPool pool;
+            pool.Init( threads - 1 );
+            ParallelRecorder recorder;
+            recorder.Init( context->Device(), context->GraphicsQueueFamilyIndex(), pool.SlotCount(), 1 );
+
+            FrameStats stats;
+            for ( uint32_t i = 0; i < iterations; ++i ) {
+                recorder.BeginFrame( 0 );
+                const uint64_t start = SDL_GetPerformanceCounter();
+                RecordParallel( pool, recorder, 0, 0, commandBuffers );
+                const uint64_t end = SDL_GetPerformanceCounter();
+                stats.AddSample( 1000.0 * ( end - start ) / SDL_GetPerformanceFrequency() );
+            }
+            if ( threads == 1 )
+                singleThreadAverage = stats.Average();
+
+            stream << "  " << threads << " thread(s) : avg " << stats.Average()
+                   << " / p99 " << stats.Percentile( 99.0 ) << " ms, speedup "
+                   << singleThreadAverage / stats.Average() << ", " << pool.StealCount() << " steal(s)" << std::endl;
+
+            recorder.DeInit();
+            pool.DeInit();
+        }
+    }
 
-        assert( valueResult.result == vk::Result::eSuccess );
-        const uint32_t value = valueResult.value;
+    //--------------------------------------------------------------------------
+    void Renderer::BenchmarkParticles( uint32_t frames, std::ostream& stream ) {
+        if ( particleCount == 0 ) {
+            stream << "No particles to benchmark" << std::endl;
+            return;
+        }
+
+        // GPU bound on purpose: frames are only limited by how fast the GPU
+        // retires them, the difference between the two runs is the overlap
+        stream << "Stepping " << particles.ParticleCount() << " particles, " << frames << " frames"
+               << ( particles.AsyncAvailable() ? "" : ", no compute-only family: async shares the graphics queue" ) << std::endl;
+        const bool wasAsync = particles.Async();
+        FrameSnapshot snapshot = FrameSnapshot();
+        double serialMilliseconds = 0.0;
+        for ( const bool async : { false, true } ) {
+            context->Device().waitIdle();
+            particles.SetAsync( async );
+            if ( particles.Async() != async ) {
+                stream << "  serial : the graphics family can't dispatch" << std::endl;
+                continue;
+            }
 
-        const vk::Fence& fence = context->Fences()[value];
+            const uint64_t start = SDL_GetPerformanceCounter();
+            for ( uint32_t i = 0; i < frames; ++i ) {
+                snapshot.time += 1.0 / 60.0;
+                RenderOnce( snapshot );
+            }
+            context->Device().waitIdle();
+            const uint64_t end = SDL_GetPerformanceCounter();
+
+            const double frameMilliseconds = ElapsedMilliseconds( start, end ) / frames;
+            if ( not async )
+                serialMilliseconds = frameMilliseconds;
+            stream << "  " << ( async ? "async " : "serial" ) << " : " << frameMilliseconds << " ms/frame, "
+                   << particles.ParticleCount() * 1000.0 / frameMilliseconds << " particles/s";
+            if ( async and serialMilliseconds > 0.0 )
+                stream << ", speedup " << serialMilliseconds / frameMilliseconds;
+            stream << std::endl;
+        }
+        particles.SetAsync( wasAsync );
+    }
+
+    //--------------------------------------------------------------------------
+    void Renderer::RenderOnce( const FrameSnapshot& snapshot ) {
+        const vk::Device& device = context->Device();
+        const uint32_t frame = context->CurrentFrame();
+        blockedMilliseconds = 0.0;
+
+        // wait for the GPU to be done with this frame slot before touching any
+        // of its objects, the other frames in flight keep the GPU busy meanwhile
+        const vk::Fence& fence = context->Fences()[frame];
         vk::ArrayProxy<const vk::Fence> proxy{ fence };
-        vk::Result result = device.waitForFences( proxy,
-                            true, std::numeric_limits<uint64_t>::max() );
+        const uint64_t waitStart = SDL_GetPerformanceCounter();
+        vk::Result result;
+        {
+            TRACE_SCOPE( "waitForFences" );
+            result = device.waitForFences( proxy, true, std::numeric_limits<uint64_t>::max() );
+        }
         assert( result == vk::Result::eSuccess );
 
+        // whatever was retired before that frame can go now
+        context->MarkFrameCompleted( frame );
+        context->Deletions().Collect( context->CompletedFrameSerial() );
+
+        const vk::Semaphore& imageAvailableSemaphore = context->ImageAvailableSemaphores()[frame];
+        const vk::Semaphore& doneRenderingSemaphore = context->DoneRenderingSemaphores()[frame];
+        const uint64_t acquireStart = SDL_GetPerformanceCounter();
+        double waitMilliseconds = ElapsedMilliseconds( waitStart, acquireStart );
+
+        // headless, each frame slot has its own offscreen image and nothing
+        // signals the acquire semaphore
+        const bool headless = context->Headless();
+        uint32_t value = frame;
+        if ( not headless ) {
+            try {
+                TRACE_SCOPE( "acquireNextImageKHR" );
+                auto valueResult = device.acquireNextImageKHR( context->Swapchain(),
+                                   std::numeric_limits<uint64_t>::max(),
+                                   imageAvailableSemaphore,
+                                   vk::Fence() );
+
+                // a suboptimal image is still acquired, render it and rebuild after
+                if ( valueResult.result == vk::Result::eSuboptimalKHR )
+                    context->SetSwapchainOutOfDate( true );
+                else
+                    assert( valueResult.result == vk::Result::eSuccess );
+                value = valueResult.value;
+            } catch ( const vk::OutOfDateKHRError& ) {
+                // nothing was acquired nor signaled, the fence is still signaled
+                // and the frame slot can be reused as is after the rebuild
+                context->SetSwapchainOutOfDate( true );
+                blockedMilliseconds = waitMilliseconds + ElapsedMilliseconds( acquireStart, SDL_GetPerformanceCounter() );
+                return;
+            }
+        }
+        const uint64_t acquireEnd = SDL_GetPerformanceCounter();
+        stageStats[( size_t )FrameStage::eAcquire].AddSample( ElapsedMilliseconds( acquireStart, acquireEnd ) );
+
+        // the image may still be used by another frame slot when the swapchain
+        // hands images out of order
+        const vk::Fence& imageFence = context->ImageFences()[value];
+        if ( !!imageFence and imageFence != fence ) {
+            TRACE_SCOPE( "waitForFences image" );
+            result = device.waitForFences( imageFence, true, std::numeric_limits<uint64_t>::max() );
+            assert( result == vk::Result::eSuccess );
+        }
+        context->SetImageFence( value, fence );
+        const uint64_t recordStart = SDL_GetPerformanceCounter();
+        waitMilliseconds += ElapsedMilliseconds( acquireEnd, recordStart );
+        stageStats[( size_t )FrameStage::eWait].AddSample( waitMilliseconds );
+        blockedMilliseconds = waitMilliseconds + ElapsedMilliseconds( acquireStart, acquireEnd );
+
         device.resetFences( proxy );
 
-        const vk::CommandBuffer& commandBuffer = context->CommandBuffers()[value];
-        commandBuffer.reset( vk::CommandBufferResetFlags() );
+        // descriptors registered or released since this frame slot last ran;
+        // writing its set invalidates what was recorded with it
+        if ( descriptorHeap.BeginFrame( frame ) )
+            InvalidateRender();
+        SelectMaterial( snapshot.material );
+
+        // everything recorded for this frame slot last time is done, recycle
+        // the whole pool at once
+        device.resetCommandPool( context->CommandPools()[frame], vk::CommandPoolResetFlags() );
+        if ( recordingThreads != 0 )
+            parallelRecorder.BeginFrame( frame );
+
+        // per-frame values go to this frame's partition of the ring, not into
+        // the commands; the fence waited on above freed all of it
+        RingAllocation uniformAllocation;
+        RingAllocation instanceAllocation;
+        AllocateFrameData( frame, uniformAllocation, instanceAllocation );
+        FrameUniforms& uniforms = *uniformAllocation.As<FrameUniforms>();
+        uniforms.clearColor = snapshot.clearColor;
+        uniforms.params[0] = ( float )std::fmod( snapshot.time, 2.0 * M_PI );
+        uniforms.view = snapshot.view;
+        if ( instanceAllocation ) {
+            TRACE_SCOPE( "animate instances" );
+            const uint64_t animateStart = SDL_GetPerformanceCounter();
+            const OrbitBatch batch = { orbitCenterX.data(), orbitCenterY.data(), orbitRadius.data(), orbitScale.data(), orbitPhase.data() };
+            BatchOrbitInstances( batch, uniforms.params[0], instanceAllocation.As<float>(), instanceCount );
+            animationStats.AddSample( ElapsedMilliseconds( animateStart, SDL_GetPerformanceCounter() ) );
+        }
+        frameData.Flush();
+
+        // either the cached buffer replayed as is, or the scene recorded anew
+        // on the pool threads
+        std::vector<vk::CommandBuffer> secondaryCommands;
+        if ( recordingThreads == 0 ) {
+            TRACE_SCOPE( "record cached" );
+            vk::CommandBuffer staticCommands;
+            if ( commandBufferCache.Acquire( value, frame, renderState, staticCommands ) )
+                RecordStaticCommands( staticCommands, value, frame );
+            secondaryCommands.push_back( staticCommands );
+        } else {
+            TRACE_SCOPE( "record parallel" );
+            const uint64_t parallelStart = SDL_GetPerformanceCounter();
+            RecordParallel( threadPool, parallelRecorder, value, frame, secondaryCommands );
+            const uint64_t parallelEnd = SDL_GetPerformanceCounter();
+            recordStats.AddSample( ElapsedMilliseconds( parallelStart, parallelEnd ) );
+        }
+
+        std::vector<vk::Semaphore> waitSemaphores;
+        std::vector<vk::PipelineStageFlags> waitStages;
+        if ( not headless ) {
+            waitSemaphores.push_back( imageAvailableSemaphore );
+            waitStages.push_back( vk::PipelineStageFlagBits::eColorAttachmentOutput );
+        }
+
+        const vk::CommandBuffer& commandBuffer = context->CommandBuffers()[frame];
         vk::CommandBufferBeginInfo info = vk::CommandBufferBeginInfo()
-                                          .setFlags( vk::CommandBufferUsageFlagBits::eSimultaneousUse );
+                                          .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit );
         commandBuffer.begin( info );
         {
-            // save the image barrier
-            vk::ImageSubresourceRange subresourceRange = vk::ImageSubresourceRange()
-                    .setAspectMask( vk::ImageAspectFlagBits::eColor )
-                    .setBaseMipLevel( 0 )
-                    .setLevelCount( 1 )
-                    .setBaseArrayLayer( 0 )
-                    .setLayerCount( 1 );
-
-            const vk::Image& image = context->SwapchainImages()[value];
-            vk::ImageMemoryBarrier barrier = vk::ImageMemoryBarrier()
-                                             .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
-                                             .setDstAccessMask( vk::AccessFlagBits::eMemoryRead )
-                                             .setOldLayout( vk::ImageLayout::eUndefined )
-                                             .setNewLayout( vk::ImageLayout::eTransferDstOptimal )
-                                             .setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
-                                             .setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
-                                             .setImage( image )
-                                             .setSubresourceRange( subresourceRange );
-            commandBuffer.pipelineBarrier( vk::PipelineStageFlagBits::eTransfer,
-                                           vk::PipelineStageFlagBits::eTransfer,
-                                           vk::DependencyFlags(),
-                                           nullptr,
-                                           nullptr,
-                                           barrier );
-
-            std::array<float, 4> color;
-            double currentTime = ( double )SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
-            color[0] = ( float )( 0.5 + 0.5 * SDL_sin( currentTime ) );
-            color[1] = ( float )( 0.5 + 0.5 * SDL_sin( currentTime + M_PI * 2 / 3 ) );
-            color[2] = ( float )( 0.5 + 0.5 * SDL_sin( currentTime + M_PI * 4 / 3 ) );
-            color[3] = 1;
-
-            vk::ClearColorValue clearValue = vk::ClearColorValue()
-                                             .setFloat32( color );
-            commandBuffer.clearColorImage( image, vk::ImageLayout::eTransferDstOptimal, clearValue, subresourceRange );
+            TRACE_SCOPE( "record primary" );
+            gpuProfiler.BeginFrame( commandBuffer, frame );
+            GpuProfileScope frameScope( gpuProfiler, commandBuffer, "frame" );
+
+            // take ownership of whatever finished uploading since last frame
+            {
+                GpuProfileScope scope( gpuProfiler, commandBuffer, "upload barriers" );
+                uploadManager.AcquireOnGraphics( commandBuffer, waitSemaphores, waitStages );
+            }
+
+            // the rest of the frame as a graph, which puts the barriers
+            // between passes and the swapchain image transitions; the acquire
+            // semaphore is waited on at color attachment output
+            renderGraph.Begin( frame );
+            const vk::ImageSubresourceRange colorRange( vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 );
+            const ResourceState acquired = { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlags(), vk::ImageLayout::eUndefined };
+            const RenderGraph::ResourceId backbuffer = renderGraph.ImportImage( "backbuffer", context->SwapchainImages()[value], colorRange, acquired );
+            renderGraph.Export( backbuffer, headless ? Access::eTransferRead : Access::ePresent );
+            const RenderGraph::ResourceId instances = renderGraph.ImportBuffer( "instances",
+                    particleCount != 0 ? particles.InstanceBuffer( frame ) : CpuAnimationEnabled() ? frameData.Buffer() : instanceBuffer.Get() );
+
+            // async, the step runs on the compute queue while the GPU still
+            // renders the previous frame; serial, it carries the simulation
+            // over even on frames nothing is drawn
+            if ( particleCount != 0 ) {
+                const float dt = ( float )std::min( 0.1, std::max( 0.0, snapshot.time - particleTime ) );
+                particleTime = snapshot.time;
+                if ( particles.Async() )
+                    particles.Submit( frame, dt, waitSemaphores, waitStages );
+                else {
+                    const RenderGraph::PassId pass = renderGraph.AddPass( "particles", [this, frame, dt]( const vk::CommandBuffer & commands ) {
+                        GpuProfileScope scope( gpuProfiler, commands, "particles" );
+                        particles.Record( commands, frame, dt );
+                    }, true );
+                    renderGraph.Use( pass, instances, Access::eComputeWrite );
+                }
+            }
+
+            // the visible instances of this frame, after the particle step
+            // that may have moved them
+            RenderGraph::ResourceId visible = 0;
+            RenderGraph::ResourceId indirect = 0;
+            if ( GpuCullingEnabled() ) {
+                visible = renderGraph.ImportBuffer( "visible instances", culling.VisibleBuffer( frame ) );
+                indirect = renderGraph.ImportBuffer( "culled draw", culling.IndirectBuffer( frame ) );
+                const std::array<float, 4> view = snapshot.view;
+                const RenderGraph::PassId pass = renderGraph.AddPass( "cull", [this, frame, view]( const vk::CommandBuffer & commands ) {
+                    GpuProfileScope scope( gpuProfiler, commands, "cull" );
+                    culling.Record( commands, frame, InstanceHeapIndex( frame ), view );
+                } );
+                renderGraph.Use( pass, instances, Access::eComputeRead );
+                renderGraph.Use( pass, visible, Access::eComputeWrite );
+                renderGraph.Use( pass, indirect, Access::eComputeWrite );
+            }
+
+            const RenderGraph::PassId mainPass = renderGraph.AddPass( "main", [&]( const vk::CommandBuffer & commands ) {
+                GpuProfileScope scope( gpuProfiler, commands, "render pass" );
+                vk::RenderPassBeginInfo renderPassInfo = vk::RenderPassBeginInfo()
+                        .setRenderPass( context->RenderPass() )
+                        .setFramebuffer( context->Framebuffers()[value] )
+                        .setRenderArea( vk::Rect2D( vk::Offset2D( 0, 0 ), vk::Extent2D( context->WindowWidth(), context->WindowHeight() ) ) );
+                commands.beginRenderPass( renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers );
+                commands.executeCommands( secondaryCommands );
+                commands.endRenderPass();
+            } );
+            renderGraph.Use( mainPass, backbuffer, Access::eColorAttachmentWrite );
+            // while the instanced pipeline compiles nothing reads the
+            // instances, and the cull pass goes
+            if ( instancedPipeline and GpuCullingEnabled() ) {
+                renderGraph.Use( mainPass, visible, Access::eVertexShaderRead );
+                renderGraph.Use( mainPass, indirect, Access::eIndirectRead );
+            } else if ( instancedPipeline )
+                renderGraph.Use( mainPass, instances, Access::eVertexShaderRead );
+
+            renderGraph.Compile();
+            renderGraph.Execute( commandBuffer );
         }
         commandBuffer.end();
+        const uint64_t submitStart = SDL_GetPerformanceCounter();
+        stageStats[( size_t )FrameStage::eRecord].AddSample( ElapsedMilliseconds( recordStart, submitStart ) );
 
-        vk::PipelineStageFlags waitDestStageMask = vk::PipelineStageFlagBits::eTransfer;
+        // nothing would ever wait on the done semaphore headless
         vk::SubmitInfo submitInfo = vk::SubmitInfo()
-                                    .setWaitSemaphoreCount( 1 )
-                                    .setPWaitSemaphores( &context->ImageAvailableSemaphore() )
-                                    .setPWaitDstStageMask( &waitDestStageMask )
+                                    .setWaitSemaphoreCount( ( uint32_t )waitSemaphores.size() )
+                                    .setPWaitSemaphores( waitSemaphores.data() )
+                                    .setPWaitDstStageMask( waitStages.data() )
                                     .setCommandBufferCount( 1 )
                                     .setPCommandBuffers( &commandBuffer )
-                                    .setSignalSemaphoreCount( 1 )
-                                    .setPSignalSemaphores( &context->DoneRenderingSemaphore() );
-        context->GraphicsQueue().submit( submitInfo, fence );
+                                    .setSignalSemaphoreCount( headless ? 0 : 1 )
+                                    .setPSignalSemaphores( &doneRenderingSemaphore );
+        {
+            TRACE_SCOPE( "submit" );
+            context->GraphicsQueue().submit( submitInfo, fence );
+        }
+        context->MarkFrameSubmitted( frame );
+        const uint64_t presentStart = SDL_GetPerformanceCounter();
+        stageStats[( size_t )FrameStage::eSubmit].AddSample( ElapsedMilliseconds( submitStart, presentStart ) );
+
+        if ( headless ) {
+            context->AdvanceFrame();
+            return;
+        }
 
         vk::PresentInfoKHR presentInfo = vk::PresentInfoKHR()
                                          .setWaitSemaphoreCount( 1 )
-                                         .setPWaitSemaphores( &context->DoneRenderingSemaphore() )
+                                         .setPWaitSemaphores( &doneRenderingSemaphore )
                                          .setSwapchainCount( 1 )
                                          .setPSwapchains( &context->Swapchain() )
                                          .setPImageIndices( &value );
-        context->PresentQueue().presentKHR( presentInfo );
+        try {
+            TRACE_SCOPE( "presentKHR" );
+            result = context->PresentQueue().presentKHR( presentInfo );
+            if ( result == vk::Result::eSuboptimalKHR )
+                context->SetSwapchainOutOfDate( true );
+        } catch ( const vk::OutOfDateKHRError& ) {
+            context->SetSwapchainOutOfDate( true );
+        }
+
+        const uint64_t presentEnd = SDL_GetPerformanceCounter();
+        stageStats[( size_t )FrameStage::ePresent].AddSample( ElapsedMilliseconds( presentStart, presentEnd ) );
+        acquireToPresentStats.AddSample( ElapsedMilliseconds( acquireStart, presentEnd ) );
+
+        context->AdvanceFrame();
     }
 
     //--------------------------------------------------------------------------
     void Renderer::DeInitRender() {
+        context->Device().waitIdle();
+
+        if ( recordingThreads != 0 ) {
+            parallelRecorder.DeInit();
+            threadPool.DeInit();
+        }
+        if ( particleCount != 0 )
+            particles.DeInit();
+        if ( GpuCullingEnabled() )
+            culling.DeInit();
+        renderGraph.DeInit();
+        gpuProfiler.DeInit();
+        commandBufferCache.DeInit();
+        uploadManager.DeInit();
+        DeInitPipeline();
+        DeInitGeometry();
+        DeInitFrameUniforms();
+        descriptorHeap.DeInit();
+
         context.reset();
     }
 }
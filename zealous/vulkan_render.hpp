@@ -1,16 +1,251 @@
 #pragma once
+#include "asset_pack.hpp"
+#include "command_buffer_cache.hpp"
+#include "descriptor_heap.hpp"
+#include "frame_ring_buffer.hpp"
+#include "frame_snapshot.hpp"
+#include "frame_stats.hpp"
+#include "gpu_culling.hpp"
+#include "gpu_profiler.hpp"
+#include "parallel_recorder.hpp"
+#include "particle_simulation.hpp"
+#include "pipeline_manager.hpp"
+#include "render_graph.hpp"
+#include "thread_pool.hpp"
+#include "upload_manager.hpp"
+#include "vertex_layout.hpp"
 #include "vulkan_context.hpp"
 
+#include <array>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace zealous {
+    //--------------------------------------------------------------------------
+    // the triangle as the instanced pipeline reads it, 8 bytes a vertex:
+    // positions in a stream of their own for position-only passes, colors in
+    // the other
+    using InstancedVertexLayout = VertexLayout<VertexAttribute<0, 0, Snorm16x2>,
+                                               VertexAttribute<1, 1, Unorm8x4>>;
+    static constexpr uint32_t kPositionStream = 0;
+    static constexpr uint32_t kColorStream = 1;
+
+    //--------------------------------------------------------------------------
+    // per-instance data, read from a descriptor heap buffer by the instanced
+    // pipeline
+    struct InstanceData {
+        std::array<float, 2> offset;
+        float scale;
+        float phase;
+    };
+    static_assert( sizeof( InstanceData ) == 4 * sizeof( float ) );
+
+    //--------------------------------------------------------------------------
+    // CPU side of RenderOnce, timed every frame
+    enum class FrameStage {
+        eWait,      // frame and image fences
+        eAcquire,
+        eRecord,
+        eSubmit,
+        ePresent,
+        eCount
+    };
+    const char* FrameStageName( FrameStage stage );
+
+    //--------------------------------------------------------------------------
     class Renderer {
       public:
+        Renderer();
+
+        // must be set before InitRender, the instance data is static
+        void SetInstanceCount( uint32_t count ) { instanceCount = count; }
+        // 0 replays the cached indirect draws; otherwise the scene is recorded
+        // every frame as sceneDrawCount direct draws, on that many threads
+        void SetRecordingThreads( uint32_t count ) { recordingThreads = count; }
+        void SetSceneDrawCount( uint32_t count ) { sceneDrawCount = count; }
+        // 0 draws the static instance grid; otherwise that many particles are
+        // stepped by a compute shader every frame and drawn instead
+        void SetParticleCount( uint32_t count ) { particleCount = count; }
+        void SetAsyncCompute( bool enabled ) { asyncCompute = enabled; }
+        // the instances are culled on the GPU every frame and drawn at once;
+        // the threaded recording path always draws them all
+        void SetGpuCulling( bool enabled ) { gpuCulling = enabled; }
+        bool GpuCullingEnabled() const { return gpuCulling and recordingThreads == 0; }
+        // the instances orbit their grid cell, moved on the CPU every frame
+        // and written to the frame data rather than uploaded once; the
+        // particles move on their own
+        void SetCpuAnimation( bool enabled ) { cpuAnimation = enabled; }
+        bool CpuAnimationEnabled() const { return cpuAnimation and particleCount == 0; }
+
+        // the geometry is read from that pack, mapped, rather than generated;
+        // it's generated still when the pack can't be used
+        void SetAssetPack( const std::string& path ) { assetPackPath = path; }
+        // CPU side only, geometry and shader code; needs no device so it can
+        // run while Vulkan starts up
+        void LoadAssets();
+        // the geometry LoadAssets would generate, as a pack; needs no device
+        bool WriteAssetPack( const std::string& path );
         void InitRender( std::shared_ptr<VulkanContext> context );
-        void RenderOnce();
+        void RenderOnce( const FrameSnapshot& snapshot );
         void DeInitRender();
 
+        // the swapchain was rebuilt, every cached command buffer is stale
+        void InvalidateRender();
+        // blocks until the pipelines requested so far are built; frames
+        // otherwise skip the draws of variants still compiling
+        void WaitForPipelines();
+
+        // CPU time between the start of acquireNextImageKHR and the return of presentKHR
+        const FrameStats& AcquireToPresentStats() const { return acquireToPresentStats; }
+        const FrameStats& StageStats( FrameStage stage ) const { return stageStats[( size_t )stage]; }
+        // CPU time the last RenderOnce spent blocked on fences and acquire
+        // rather than working
+        double LastBlockedMilliseconds() const { return blockedMilliseconds; }
+
+        uint64_t TrianglesPerFrame() const { return uint64_t( instanceCount ) * kTrianglesPerInstance; }
+        uint32_t IndirectDrawCount() const { return drawCount; }
+
+        // CPU time recording the scene each frame, when recording in parallel
+        const FrameStats& RecordStats() const { return recordStats; }
+        // CPU time writing the animated instances each frame
+        const FrameStats& AnimationStats() const { return animationStats; }
+
+        const GpuProfiler& Profiler() const { return gpuProfiler; }
+        const DescriptorHeap& Heap() const { return descriptorHeap; }
+        const ParticleSimulation& Particles() const { return particles; }
+        const GpuCulling& Culling() const { return culling; }
+        const PipelineManager& Pipelines() const { return pipelineManager; }
+        const RenderGraph& Graph() const { return renderGraph; }
+        const FrameRingBuffer& FrameData() const { return frameData; }
+
+        // records the scene without submitting it with 1 to maxThreads threads
+        // and reports the time per frame for each
+        void BenchmarkRecording( uint32_t maxThreads, uint32_t iterations, std::ostream& stream );
+        // renders that many frames with the particle step serialized on the
+        // graphics queue, then overlapped on the compute queue
+        void BenchmarkParticles( uint32_t frames, std::ostream& stream );
+
       private:
+        static constexpr uint32_t kTrianglesPerInstance = 1;
+        static constexpr uint32_t kTriangleVertexCount = 3;
+        // instance pipeline variants, by FrameSnapshot::material
+        static constexpr uint32_t kMaterialCount = 2;
+        static constexpr uint32_t kPipelineWorkers = 2;
+
+        void GenerateGeometry();
+        bool MapGeometry();
+        void InitGeometry();
+        void DeInitGeometry();
+        UniqueBuffer CreateStaticBuffer( const void* data, vk::DeviceSize size, vk::BufferUsageFlags usage,
+                                         vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess, Allocation& memory );
+        void InitPipeline();
+        void DeInitPipeline();
+        GraphicsPipelineDesc PipelineDesc( const char* vertexPath, const char* fragmentPath ) const;
+        void SelectMaterial( uint32_t material );
+        void InitFrameUniforms();
+        void DeInitFrameUniforms();
+        void AllocateFrameData( uint32_t frameIndex, RingAllocation& uniforms, RingAllocation& instances );
+        void BeginSecondary( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex );
+        void RecordClear( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex );
+        uint32_t InstanceHeapIndex( uint32_t frameIndex ) const;
+        void BindInstancedGeometry( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex );
+        void RecordInstances( const vk::CommandBuffer& commandBuffer, uint32_t frameIndex );
+        void RecordStaticCommands( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex, uint32_t frameIndex );
+        void RecordSlice( const vk::CommandBuffer& commandBuffer, uint32_t imageIndex, uint32_t frameIndex,
+                          uint32_t slice, uint32_t sliceCount );
+        void RecordParallel( ThreadPool& pool, ParallelRecorder& recorder, uint32_t imageIndex, uint32_t frameIndex,
+                             std::vector<vk::CommandBuffer>& commandBuffers );
+
         std::shared_ptr<VulkanContext> context;
-        vk::DeviceMemory deviceMemory;
-        vk::Buffer buffer;
+
+        // one triangle drawn instanceCount times, split over drawCount
+        // indirect commands; a vertex buffer per stream
+        Allocation positionMemory;
+        UniqueBuffer positionBuffer;
+        Allocation colorMemory;
+        UniqueBuffer colorBuffer;
+        Allocation indexMemory;
+        UniqueBuffer indexBuffer;
+        Allocation instanceMemory;
+        UniqueBuffer instanceBuffer;
+        Allocation indirectMemory;
+        UniqueBuffer indirectBuffer;
+        // heap indices of the instance stream, one per frame slot for particles
+        std::vector<uint32_t> instanceHeapIndices;
+        uint32_t instanceCount;
+        uint32_t drawCount;
+        uint32_t instancesPerDraw;
+
+        // filled by LoadAssets, released once on the GPU
+        std::array<Snorm16x2::Element, kTriangleVertexCount> positions;
+        std::array<Unorm8x4::Element, kTriangleVertexCount> colors;
+        std::array<uint16_t, 3> indices;
+        std::vector<InstanceData> instances;
+        // or mapped from the pack, uploaded from the mapping as is
+        std::string assetPackPath;
+        AssetPack assetPack;
+        // what InitGeometry uploads, either of the above
+        const void* positionData;
+        const void* colorData;
+        uint32_t vertexCount;
+        const uint16_t* indexData;
+        uint32_t indexCount;
+        const InstanceData* instanceData;
+        std::map<std::string, std::vector<uint32_t>> shaderCode;
+
+        DescriptorHeap descriptorHeap;
+        UniqueDescriptorSetLayout descriptorSetLayout;
+        UniquePipelineLayout pipelineLayout;
+        // built by the manager, the instanced one may not be ready yet and its
+        // draws are skipped until then
+        PipelineManager pipelineManager;
+        vk::Pipeline clearPipeline;
+        vk::Pipeline instancedPipeline;
+        GraphicsPipelineDesc instancedDesc;
+        std::array<PipelineHandle, kMaterialCount> materialPipelines;
+        UniqueDescriptorPool descriptorPool;
+        vk::DescriptorSet descriptorSet;
+
+        // the uniforms, then the animated instances, always allocated in that
+        // order so the dynamic offset and the instance ranges recorded once
+        // stay right
+        FrameRingBuffer frameData;
+
+        bool cpuAnimation;
+        // the grid as orbits, one array per component for the batch kernels
+        std::vector<float> orbitCenterX;
+        std::vector<float> orbitCenterY;
+        std::vector<float> orbitRadius;
+        std::vector<float> orbitScale;
+        std::vector<float> orbitPhase;
+        FrameStats animationStats;
+
+        UploadManager uploadManager;
+        CommandBufferCache commandBufferCache;
+        uint64_t renderState;
+
+        uint32_t recordingThreads;
+        uint32_t sceneDrawCount;
+        ThreadPool threadPool;
+        ParallelRecorder parallelRecorder;
+        FrameStats recordStats;
+
+        uint32_t particleCount;
+        bool asyncCompute;
+        double particleTime;
+        ParticleSimulation particles;
+
+        bool gpuCulling;
+        GpuCulling culling;
+
+        // rebuilt every frame
+        RenderGraph renderGraph;
+
+        FrameStats acquireToPresentStats;
+        double blockedMilliseconds;
+        std::array<FrameStats, ( size_t )FrameStage::eCount> stageStats;
+        GpuProfiler gpuProfiler;
     };
 }